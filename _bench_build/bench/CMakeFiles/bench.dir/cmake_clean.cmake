@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/micro_bench"
+  "/root/repo/micro_bench.pdb"
+  "CMakeFiles/bench.dir/micro_bench.cpp.o"
+  "CMakeFiles/bench.dir/micro_bench.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/kdtree_layout_bench"
+  "/root/repo/kdtree_layout_bench.pdb"
+  "CMakeFiles/kdtree_layout_bench.dir/kdtree_layout_bench.cpp.o"
+  "CMakeFiles/kdtree_layout_bench.dir/kdtree_layout_bench.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/kdtree_layout_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/rpc_load_bench"
+  "/root/repo/rpc_load_bench.pdb"
+  "CMakeFiles/rpc_load_bench.dir/rpc_load_bench.cpp.o"
+  "CMakeFiles/rpc_load_bench.dir/rpc_load_bench.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rpc_load_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/spatial_index_bench"
+  "/root/repo/spatial_index_bench.pdb"
+  "CMakeFiles/spatial_index_bench.dir/spatial_index_bench.cpp.o"
+  "CMakeFiles/spatial_index_bench.dir/spatial_index_bench.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/spatial_index_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/airport_server"
+  "/root/repo/airport_server.pdb"
+  "CMakeFiles/airport_server.dir/airports_server.cpp.o"
+  "CMakeFiles/airport_server.dir/airports_server.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/airport_server.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,28 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/BruteForce.cpp" "src/CMakeFiles/airportlookup.dir/BruteForce.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/BruteForce.cpp.o.d"
+  "/root/repo/src/KDTree.cpp" "src/CMakeFiles/airportlookup.dir/KDTree.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/KDTree.cpp.o.d"
+  "/root/repo/src/SpatialIndex.cpp" "src/CMakeFiles/airportlookup.dir/SpatialIndex.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/SpatialIndex.cpp.o.d"
+  "/root/repo/src/SphereKDTree.cpp" "src/CMakeFiles/airportlookup.dir/SphereKDTree.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/SphereKDTree.cpp.o.d"
+  "/root/repo/src/TopK.cpp" "src/CMakeFiles/airportlookup.dir/TopK.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/TopK.cpp.o.d"
+  "/root/repo/src/airport_lookup.cpp" "src/CMakeFiles/airportlookup.dir/airport_lookup.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/airport_lookup.cpp.o.d"
+  "/root/repo/src/geo.cpp" "src/CMakeFiles/airportlookup.dir/geo.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/geo.cpp.o.d"
+  "/root/repo/src/nearest_airports.cpp" "src/CMakeFiles/airportlookup.dir/nearest_airports.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/nearest_airports.cpp.o.d"
+  "/root/repo/src/trie.cpp" "src/CMakeFiles/airportlookup.dir/trie.cpp.o" "gcc" "src/CMakeFiles/airportlookup.dir/trie.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_bench_build/src/CMakeFiles/common.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
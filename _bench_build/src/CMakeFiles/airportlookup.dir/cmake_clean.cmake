@@ -0,0 +1,27 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/airportlookup.dir/BruteForce.cpp.o"
+  "CMakeFiles/airportlookup.dir/BruteForce.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/KDTree.cpp.o"
+  "CMakeFiles/airportlookup.dir/KDTree.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/SpatialIndex.cpp.o"
+  "CMakeFiles/airportlookup.dir/SpatialIndex.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/SphereKDTree.cpp.o"
+  "CMakeFiles/airportlookup.dir/SphereKDTree.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/TopK.cpp.o"
+  "CMakeFiles/airportlookup.dir/TopK.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/airport_lookup.cpp.o"
+  "CMakeFiles/airportlookup.dir/airport_lookup.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/geo.cpp.o"
+  "CMakeFiles/airportlookup.dir/geo.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/nearest_airports.cpp.o"
+  "CMakeFiles/airportlookup.dir/nearest_airports.cpp.o.d"
+  "CMakeFiles/airportlookup.dir/trie.cpp.o"
+  "CMakeFiles/airportlookup.dir/trie.cpp.o.d"
+  "libairportlookup.a"
+  "libairportlookup.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/airportlookup.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/airports_snapshot"
+  "/root/repo/airports_snapshot.pdb"
+  "CMakeFiles/airports_snapshot.dir/airports_snapshot.cpp.o"
+  "CMakeFiles/airports_snapshot.dir/airports_snapshot.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/airports_snapshot.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
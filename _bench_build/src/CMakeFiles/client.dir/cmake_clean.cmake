@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/client"
+  "/root/repo/client.pdb"
+  "CMakeFiles/client.dir/places_client.cpp.o"
+  "CMakeFiles/client.dir/places_client.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/client.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,25 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/place_airport_common_xdr.c" "src/CMakeFiles/common.dir/place_airport_common_xdr.c.o" "gcc" "src/CMakeFiles/common.dir/place_airport_common_xdr.c.o.d"
+  "/root/repo/src/places_airports_clnt.c" "src/CMakeFiles/common.dir/places_airports_clnt.c.o" "gcc" "src/CMakeFiles/common.dir/places_airports_clnt.c.o.d"
+  "/root/repo/src/common.cpp" "src/CMakeFiles/common.dir/common.cpp.o" "gcc" "src/CMakeFiles/common.dir/common.cpp.o.d"
+  "/root/repo/src/rpc_async.cpp" "src/CMakeFiles/common.dir/rpc_async.cpp.o" "gcc" "src/CMakeFiles/common.dir/rpc_async.cpp.o.d"
+  "/root/repo/src/snapshot.cpp" "src/CMakeFiles/common.dir/snapshot.cpp.o" "gcc" "src/CMakeFiles/common.dir/snapshot.cpp.o.d"
+  "/root/repo/src/stats.cpp" "src/CMakeFiles/common.dir/stats.cpp.o" "gcc" "src/CMakeFiles/common.dir/stats.cpp.o.d"
+  "/root/repo/src/svc_pool.cpp" "src/CMakeFiles/common.dir/svc_pool.cpp.o" "gcc" "src/CMakeFiles/common.dir/svc_pool.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,23 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/common.dir/common.cpp.o"
+  "CMakeFiles/common.dir/common.cpp.o.d"
+  "CMakeFiles/common.dir/place_airport_common_xdr.c.o"
+  "CMakeFiles/common.dir/place_airport_common_xdr.c.o.d"
+  "CMakeFiles/common.dir/places_airports_clnt.c.o"
+  "CMakeFiles/common.dir/places_airports_clnt.c.o.d"
+  "CMakeFiles/common.dir/rpc_async.cpp.o"
+  "CMakeFiles/common.dir/rpc_async.cpp.o.d"
+  "CMakeFiles/common.dir/snapshot.cpp.o"
+  "CMakeFiles/common.dir/snapshot.cpp.o.d"
+  "CMakeFiles/common.dir/stats.cpp.o"
+  "CMakeFiles/common.dir/stats.cpp.o.d"
+  "CMakeFiles/common.dir/svc_pool.cpp.o"
+  "CMakeFiles/common.dir/svc_pool.cpp.o.d"
+  "libcommon.a"
+  "libcommon.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C CXX)
+  include(CMakeFiles/common.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "/root/repo/places_server"
+  "/root/repo/places_server.pdb"
+  "CMakeFiles/places_server.dir/airports_pool.cpp.o"
+  "CMakeFiles/places_server.dir/airports_pool.cpp.o.d"
+  "CMakeFiles/places_server.dir/places_server.cpp.o"
+  "CMakeFiles/places_server.dir/places_server.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/places_server.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/places_snapshot"
+  "/root/repo/places_snapshot.pdb"
+  "CMakeFiles/places_snapshot.dir/places_snapshot.cpp.o"
+  "CMakeFiles/places_snapshot.dir/places_snapshot.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/places_snapshot.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
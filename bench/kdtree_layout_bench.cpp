@@ -0,0 +1,171 @@
+/*******************************************************************************
+ *   File: kdtree_layout_bench.cpp
+ * Author: Ben Targan
+ *   Desc: Compares the implicit array-backed KD-tree against the previous
+ *         layout of one heap allocated node per airport.
+ *
+ *         usage: kdtree_layout_bench [airportsFile] [nQueries]
+ ******************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "airports/KDTree.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Previous pointer based layout, kept here as the baseline
+/******************************************************************************/
+
+namespace pointer_layout {
+
+static constexpr long double PI() { return std::atan(1) * 4; }
+
+static long double deg2rad(long double deg) { return deg * PI() / 180.0L; }
+
+static long double distance(const location &pt1, const location &pt2) {
+  const long double lat1 = deg2rad(pt1.latitude);
+  const long double lat2 = deg2rad(pt2.latitude);
+  const long double dLon = deg2rad(pt2.longitude) - deg2rad(pt1.longitude);
+  const long double a = std::sin(lat1) * std::sin(lat2);
+  const long double b = std::cos(lat1) * std::cos(lat2) * std::cos(dLon);
+  return 3959.0L * std::acos(a + b);
+}
+
+struct KDNode {
+  AirportRecord           airport;
+  std::unique_ptr<KDNode> left;
+  std::unique_ptr<KDNode> right;
+};
+
+using It = std::vector<AirportRecord>::iterator;
+
+static std::unique_ptr<KDNode> construct(It fm, It to, int depth) {
+  if (fm >= to) return nullptr;
+
+  const auto mid = std::distance(fm, to) / 2;
+  std::nth_element(fm, fm + mid, to,
+                   [depth](const AirportRecord &p1, const AirportRecord &p2) {
+    return (depth & 1) == 0 ? p1.loc.latitude < p2.loc.latitude
+                            : p1.loc.longitude < p2.loc.longitude;
+  });
+
+  return std::unique_ptr<KDNode>(new KDNode{
+    *(fm + mid),
+    construct(fm, fm + mid, depth + 1),
+    construct(fm + mid + 1, to, depth + 1)});
+}
+
+static void kClosest(const std::unique_ptr<KDNode> &node, const location &target,
+                     const size_t k, const bool isEvenNodeLevel,
+                     std::vector<DistAirport> &closest) {
+  if (!node) return;
+
+  location nloc = node->airport.loc;
+  const auto dist = (double)distance(nloc, target);
+  if (closest.size() < k || dist < closest.back().dist) {
+    closest.emplace(
+      std::find_if(closest.begin(), closest.end(),
+                   [dist](const DistAirport &rec) { return dist < rec.dist; }),
+      node->airport, dist);
+    if (closest.size() > k) closest.pop_back();
+  }
+
+  const bool leftCloser = isEvenNodeLevel ?
+    target.latitude < nloc.latitude : target.longitude < nloc.longitude;
+  kClosest(leftCloser ? node->left : node->right, target, k,
+           !isEvenNodeLevel, closest);
+
+  if (isEvenNodeLevel) nloc.longitude = target.longitude;
+  else                 nloc.latitude = target.latitude;
+
+  if (closest.size() < k || distance(nloc, target) < closest.back().dist)
+    kClosest(leftCloser ? node->right : node->left, target, k,
+             !isEvenNodeLevel, closest);
+}
+
+} // namespace pointer_layout
+
+// Measurement helpers
+/******************************************************************************/
+
+template<typename TFn>
+static double secondsOf(TFn fn) {
+  const auto start = Clock::now();
+  fn();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "data/airport-locations.txt";
+  const size_t nQueries = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+
+  const auto recs = *load_Airports(path);
+  const size_t n = recs.size();
+
+  // Targets spread over the bounding box of the data set
+  std::mt19937 gen(4520);
+  std::uniform_real_distribution<double> lat(18.0, 71.0), lon(-170.0, -65.0);
+  std::vector<location> targets(nQueries);
+  for (auto &t : targets) t = { lat(gen), lon(gen) };
+
+  // Build both layouts
+  std::vector<AirportRecord> ptrRecs(recs);
+  std::unique_ptr<pointer_layout::KDNode> ptrRoot;
+  const double ptrBuild = secondsOf([&]() {
+    ptrRoot = pointer_layout::construct(ptrRecs.begin(), ptrRecs.end(), 0);
+  });
+
+  std::unique_ptr<KDTree> flat;
+  const double flatBuild = secondsOf([&]() {
+    flat = std::unique_ptr<KDTree>(new KDTree(TAirportRecs(
+      new std::vector<AirportRecord>(recs))));
+  });
+
+  // Nodes copy their record, each node is its own allocation
+  const size_t ptrBytes = n * (sizeof(pointer_layout::KDNode) + 16);
+  const size_t flatBytes = n * (sizeof(AirportRecord) + 5 * sizeof(double));
+
+  printf("%zu airports, %zu queries\n\n", n, nQueries);
+  printf("%-10s %12s %12s %14s %14s\n",
+         "layout", "build (ms)", "memory (KB)", "k=5 (ns/qry)", "k=20 (ns/qry)");
+
+  double ptrQry[2], flatQry[2];
+  const size_t ks[2] = { 5, 20 };
+  size_t mismatches = 0;
+  for (int i = 0; i < 2; ++i) {
+    const size_t k = ks[i];
+    std::vector<DistAirport> ptrRes, flatRes;
+
+    ptrQry[i] = secondsOf([&]() {
+      for (const auto &t : targets) {
+        ptrRes.clear();
+        pointer_layout::kClosest(ptrRoot, t, k, true, ptrRes);
+      }
+    });
+    flatQry[i] = secondsOf([&]() {
+      for (const auto &t : targets) flatRes = flat->kClosestLocations(t, k);
+    });
+
+    // Both layouts must agree on every answer
+    for (size_t q = 0; q < std::min<size_t>(nQueries, 10000); ++q) {
+      ptrRes.clear();
+      pointer_layout::kClosest(ptrRoot, targets[q], k, true, ptrRes);
+      flatRes = flat->kClosestLocations(targets[q], k);
+      for (size_t j = 0; j < k; ++j)
+        if (std::strcmp(ptrRes[j].airport->code, flatRes[j].airport->code))
+          ++mismatches;
+    }
+  }
+
+  printf("%-10s %12.3f %12zu %14.1f %14.1f\n", "pointer", ptrBuild * 1e3,
+         ptrBytes / 1024, ptrQry[0] * 1e9 / nQueries, ptrQry[1] * 1e9 / nQueries);
+  printf("%-10s %12.3f %12zu %14.1f %14.1f\n", "implicit", flatBuild * 1e3,
+         flatBytes / 1024, flatQry[0] * 1e9 / nQueries, flatQry[1] * 1e9 / nQueries);
+  printf("\nresult mismatches: %zu\n", mismatches);
+
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+/*******************************************************************************
+ *   File: micro_bench.cpp
+ * Author: Ben Targan
+ *   Desc: Google Benchmark suite of the airports and places hot paths, run on
+ *         the bundled data files. Write JSON for tracking regressions with
+ *         --benchmark_out=bench.json --benchmark_out_format=json.
+ *
+ *         usage: micro_bench [--benchmark_filter=<regex>] [...]
+ ******************************************************************************/
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "airports/KDTree.h"
+#include "places/trie.h"
+
+// Bundled data files, the path is set by the build
+static const std::string airportsPath =
+  std::string(LOOKUP_DATA_DIR) + "/airport-locations.txt";
+static const std::string placesPath =
+  std::string(LOOKUP_DATA_DIR) + "/places2k.txt";
+
+// Data sets loaded once and shared by the benchmarks
+/******************************************************************************/
+
+static const std::vector<AirportRecord> &airportRecs() {
+  static const std::vector<AirportRecord> recs =
+    *load_Airports(airportsPath.c_str());
+  return recs;
+}
+
+static const PlaceRecs &placeRecs() {
+  static const TPlaceRecs recs = loadPlacesFromFile(placesPath.c_str(), 20000);
+  return *recs;
+}
+
+static const Trie &placesTrie() {
+  static const Trie trie(TPlaceRecs(new PlaceRecs(placeRecs())));
+  return trie;
+}
+
+static TAirportRecs copyAirports() {
+  return TAirportRecs(new std::vector<AirportRecord>(airportRecs()));
+}
+
+// Engines benchmarked, by argument index
+static const SearchEngine engines[] = {
+  SearchEngine::LatLong, SearchEngine::Sphere, SearchEngine::BruteForce
+};
+static const char *engineNames[] = { "latlong", "sphere", "brute" };
+
+// Query distributions of the k closest searches, by argument index
+enum Targets { PLACE_TARGETS, CONUS_TARGETS, GLOBAL_TARGETS };
+static const char *targetNames[] = { "places", "conus", "global" };
+
+// Fixed set of search targets of a distribution
+static const std::vector<location> &targets(const int dist) {
+  static std::vector<location> sets[3];
+  std::vector<location> &set = sets[dist];
+  if (!set.empty()) return set;
+
+  constexpr size_t n = 4096;
+  std::mt19937 gen(4520);
+  std::uniform_real_distribution<double> conusLat(25.0, 49.0),
+    conusLon(-125.0, -67.0), unit(-1.0, 1.0), lon(-180.0, 180.0);
+  const auto &places = placeRecs().records;
+  for (size_t i = 0; i < n; ++i) {
+    switch (dist) {
+      case PLACE_TARGETS: set.push_back(places[gen() % places.size()].loc());
+        break;
+      case CONUS_TARGETS: set.push_back({ conusLat(gen), conusLon(gen) });
+        break;
+      default:
+        set.push_back({ std::asin(unit(gen)) * 180.0 / M_PI, lon(gen) });
+    }
+  }
+  return set;
+}
+
+// Places whose names are looked up, a fixed random sample
+static const std::vector<const CityRecord *> &sampledPlaces() {
+  static std::vector<const CityRecord *> sample;
+  if (!sample.empty()) return sample;
+
+  constexpr size_t n = 4096;
+  std::mt19937 gen(4520);
+  const auto &records = placeRecs().records;
+  for (size_t i = 0; i < n; ++i)
+    sample.push_back(&records[gen() % records.size()]);
+  return sample;
+}
+
+static std::string nameOf(const CityRecord &rec) {
+  return std::string(&placeRecs().names[rec.nameOff], rec.nameLen);
+}
+
+// Names looked up in the trie, by argument index
+enum Names { NAME_HITS, NAME_MISSES, AMBIGUOUS_PREFIXES };
+static const char *nameKinds[] = { "hits", "misses", "ambiguous_prefixes" };
+
+// Names of a kind taken from the sampled places: their names, their names
+// with letters added so they match none, and the first half of the names
+// that is a prefix of several places
+static const std::vector<std::string> &names(const int kind) {
+  static std::vector<std::string> sets[3];
+  std::vector<std::string> &set = sets[kind];
+  if (!set.empty()) return set;
+
+  std::mt19937 gen(4520);
+  for (const CityRecord *rec : sampledPlaces()) {
+    std::string name = nameOf(*rec);
+    if (kind == NAME_MISSES) {
+      name.insert(gen() % (name.size() + 1), 1, 'q');
+      name += "zx";
+    } else if (kind == AMBIGUOUS_PREFIXES) {
+      name.resize((name.size() + 1) / 2);
+      if (!placesTrie().query(name).isAmbiguous) continue;
+    }
+    set.push_back(name);
+  }
+  return set;
+}
+
+// Airports
+/******************************************************************************/
+
+static void BM_LoadAirports(benchmark::State &state) {
+  for (auto _ : state)
+    benchmark::DoNotOptimize(load_Airports(airportsPath.c_str()));
+  state.SetItemsProcessed(state.iterations() * airportRecs().size());
+}
+BENCHMARK(BM_LoadAirports)->Unit(benchmark::kMicrosecond);
+
+// Arg: engine
+static void BM_SpatialIndexConstruct(benchmark::State &state) {
+  const SearchEngine engine = engines[state.range(0)];
+  for (auto _ : state) {
+    state.PauseTiming();
+    TAirportRecs recs = copyAirports();
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(makeSpatialIndex(engine, std::move(recs)));
+  }
+  state.SetItemsProcessed(state.iterations() * airportRecs().size());
+  state.SetLabel(engineNames[state.range(0)]);
+}
+BENCHMARK(BM_SpatialIndexConstruct)->DenseRange(0, 2)
+  ->Unit(benchmark::kMicrosecond);
+
+// Args: engine, k, target distribution
+static void BM_KClosestLocations(benchmark::State &state) {
+  const auto index = makeSpatialIndex(engines[state.range(0)],
+                                      copyAirports());
+  const size_t k = (size_t)state.range(1);
+  const auto &queries = targets((int)state.range(2));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index->kClosestLocations(queries[i], k));
+    if (++i == queries.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(std::string(engineNames[state.range(0)]) + "/" +
+                 targetNames[state.range(2)]);
+}
+BENCHMARK(BM_KClosestLocations)
+  ->ArgNames({ "engine", "k", "targets" })
+  ->ArgsProduct({ { 0, 1, 2 }, { 1, 5, 25, 256 }, { 0, 1, 2 } });
+
+// Places
+/******************************************************************************/
+
+static void BM_LoadPlacesFromFile(benchmark::State &state) {
+  for (auto _ : state)
+    benchmark::DoNotOptimize(loadPlacesFromFile(placesPath.c_str(), 20000));
+  state.SetItemsProcessed(state.iterations() * placeRecs().records.size());
+}
+BENCHMARK(BM_LoadPlacesFromFile)->Unit(benchmark::kMillisecond);
+
+static void BM_TrieConstruct(benchmark::State &state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    TPlaceRecs recs(new PlaceRecs(placeRecs()));
+    state.ResumeTiming();
+    Trie trie(std::move(recs));
+    benchmark::DoNotOptimize(trie);
+  }
+  state.SetItemsProcessed(state.iterations() * placeRecs().records.size());
+}
+BENCHMARK(BM_TrieConstruct)->Unit(benchmark::kMillisecond);
+
+// Arg: kind of names
+static void BM_TrieQuery(benchmark::State &state) {
+  const Trie &trie = placesTrie();
+  const auto &queries = names((int)state.range(0));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(trie.query(queries[i]));
+    if (++i == queries.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(nameKinds[state.range(0)]);
+}
+BENCHMARK(BM_TrieQuery)->DenseRange(0, 2);
+
+// Lookups with states, as the places server does
+static void BM_QueryPlace(benchmark::State &state) {
+  const Trie &trie = placesTrie();
+
+  // Names with the state of the place they were taken from
+  const PlaceRecs &places = placeRecs();
+  const auto &queries = names(NAME_HITS);
+  std::vector<std::string> states;
+  for (size_t j = 0; j < queries.size(); ++j) {
+    const CityRecord &rec = *sampledPlaces()[j];
+    states.emplace_back(&places.states[rec.stateId * MAX_STATE]);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(queryPlace(trie, queries[i], states[i]));
+    if (++i == queries.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueryPlace);
+
+BENCHMARK_MAIN();
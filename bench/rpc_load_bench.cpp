@@ -0,0 +1,370 @@
+/*******************************************************************************
+ *   File: rpc_load_bench.cpp
+ * Author: Ben Targan
+ *   Desc: Load generator for the places and airports servers. Client threads
+ *         replay a mix of place names from the places file and random
+ *         coordinates, back to back (closed loop) or at a fixed total rate
+ *         (open loop), and the latency percentiles and throughput of each
+ *         server are reported separately. Open loop latencies count from
+ *         when a request was due, so a stalled server is not hidden by the
+ *         clients waiting on it.
+ *
+ *         usage: rpc_load_bench [options] <host>, see showUsage()
+ ******************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <unistd.h>
+#include "common.h"
+#include "airports/airports.h"
+#include "places/places.h"
+#include "places/trie.h"
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * \class LatencyHistogram
+ * \brief Counts of latencies in microseconds. Every power of two range is
+ *        split in 2^SUB_BITS buckets, so reported percentiles are within
+ *        1 / 2^SUB_BITS (1.6 %) above the recorded latencies.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr int SUB_BITS = 6;
+    static constexpr size_t SUB_BUCKETS = (size_t)1 << SUB_BITS;
+
+    LatencyHistogram() : counts((64 - SUB_BITS + 1) * SUB_BUCKETS) { }
+
+    void record(const uint64_t us) {
+      ++counts[bucketOf(us)];
+      ++total;
+      maxUs = std::max(maxUs, us);
+    }
+
+    void merge(const LatencyHistogram &other) {
+      for (size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+      total += other.total;
+      maxUs = std::max(maxUs, other.maxUs);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return maxUs; }
+
+    /**
+     * \brief Latency fraction p of the recorded ones are at or below.
+     * \param p Fraction, 0 to 1
+     */
+    uint64_t percentile(const double p) const {
+      if (total == 0) return 0;
+      const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p * total + 0.5));
+      uint64_t seen = 0;
+      for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(highestOf(i), maxUs);
+      }
+      return maxUs;
+    }
+
+    /**
+     * \brief Prints the counts per power of two range with a bar each.
+     */
+    void print() const {
+      std::vector<uint64_t> groups(counts.size() / SUB_BUCKETS);
+      for (size_t i = 0; i < counts.size(); ++i)
+        groups[i / SUB_BUCKETS] += counts[i];
+      const uint64_t most = *std::max_element(groups.begin(), groups.end());
+      for (size_t g = 0; g < groups.size(); ++g) {
+        if (groups[g] == 0) continue;
+        const int bar = (int)(groups[g] * 40 / std::max<uint64_t>(most, 1));
+        printf("    <= %10.3f ms %10llu  %.*s\n",
+               highestOf((g + 1) * SUB_BUCKETS - 1) / 1000.0,
+               (unsigned long long)groups[g], std::max(bar, 1),
+               "########################################");
+      }
+    }
+
+  private:
+    // Values below SUB_BUCKETS get a bucket each, every power of two range
+    // above that SUB_BUCKETS buckets
+    static size_t bucketOf(const uint64_t us) {
+      if (us < SUB_BUCKETS) return (size_t)us;
+      const int msb = 63 - __builtin_clzll(us);
+      const int shift = msb - SUB_BITS;
+      return ((size_t)(shift + 1) << SUB_BITS) +
+             (size_t)((us >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    // Highest latency counted in a bucket
+    static uint64_t highestOf(const size_t bucket) {
+      if (bucket < SUB_BUCKETS) return bucket;
+      const int shift = (int)(bucket >> SUB_BITS) - 1;
+      const uint64_t low = (uint64_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1)))
+                           << shift;
+      return low + ((uint64_t)1 << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t maxUs = 0;
+};
+
+// Server a phase of the benchmark loads
+enum class Target { Places, Airports };
+
+struct Options {
+  const char *host = nullptr;
+  const char *placesPath = "data/places2k.txt";
+  bool        runPlaces = true;
+  bool        runAirports = true;
+  bool        tcp = false;
+  unsigned    clients = 8;
+  double      rate = 0;             // Total requests per second, 0 closed loop
+  double      warmupSeconds = 2;
+  double      seconds = 10;
+  unsigned    namedPercent = 80;    // Share of places requests made by name
+  in_port_t   placesPort = 0;       // 0 asks the portmapper
+  in_port_t   airportsPort = 0;
+};
+
+// Counts of one client thread, or of all once merged
+struct PhaseStats {
+  LatencyHistogram latencies;   // Of completed calls, in the measured window
+  uint64_t         errReplies = 0;  // Replies carrying an error, e.g. unknown
+  uint64_t         failed = 0;      // Calls that got no reply
+};
+
+static void showUsage(const char *prog) {
+  printf("usage: %s [-s places|airports|both] [-c clients] [-T] [-r rate]\n"
+         "          [-w warmupSeconds] [-d seconds] [-m namedPercent]\n"
+         "          [-f placesFile] [-p placesPort] [-a airportsPort] <host>\n"
+         "  -T uses TCP instead of UDP, -r 0 (the default) sends back to back,\n"
+         "  ports default to the ones registered with the portmapper\n",
+         prog);
+  exit(1);
+}
+
+static Options parseOptions(int argc, char **argv) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "a:c:d:f:m:p:r:s:Tw:")) != -1) {
+    switch (c) {
+      case 'a': opt.airportsPort = (in_port_t)std::atoi(optarg); break;
+      case 'c': opt.clients = std::max(1, std::atoi(optarg)); break;
+      case 'd': opt.seconds = std::atof(optarg); break;
+      case 'f': opt.placesPath = optarg; break;
+      case 'm': opt.namedPercent = std::min(100, std::atoi(optarg)); break;
+      case 'p': opt.placesPort = (in_port_t)std::atoi(optarg); break;
+      case 'r': opt.rate = std::atof(optarg); break;
+      case 'T': opt.tcp = true; break;
+      case 'w': opt.warmupSeconds = std::atof(optarg); break;
+      case 's':
+        opt.runPlaces = std::strcmp(optarg, "airports") != 0;
+        opt.runAirports = std::strcmp(optarg, "places") != 0;
+        if (std::strcmp(optarg, "places") == 0 ||
+            std::strcmp(optarg, "airports") == 0 ||
+            std::strcmp(optarg, "both") == 0) break;
+        // fall through
+      default:
+        showUsage(argv[0]);
+    }
+  }
+  if (optind + 1 != argc || !(opt.seconds > 0) || opt.warmupSeconds < 0)
+    showUsage(argv[0]);
+  opt.host = argv[optind];
+  return opt;
+}
+
+// Creates a client of a server, on a fixed port unless it is 0. Null on
+// failure, after printing why.
+static CLIENT *createClient(const Options &opt, const rpcprog_t prog,
+                            const rpcvers_t vers, const in_port_t port) {
+  CLIENT *clnt = nullptr;
+  if (port == 0) {
+    clnt = clnt_create(opt.host, prog, vers, opt.tcp ? "tcp" : "udp");
+  } else {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    addrinfo *found = nullptr;
+    if (getaddrinfo(opt.host, nullptr, &hints, &found) != 0) {
+      fprintf(stderr, "Unknown host %s\n", opt.host);
+      return nullptr;
+    }
+    sockaddr_in addr = *(const sockaddr_in *)found->ai_addr;
+    freeaddrinfo(found);
+    addr.sin_port = htons(port);
+
+    int sock = RPC_ANYSOCK;
+    clnt = opt.tcp ? clnttcp_create(&addr, prog, vers, &sock, 0, 0)
+                   : clntudp_create(&addr, prog, vers, timeval{1, 0}, &sock);
+  }
+  if (clnt == nullptr) {
+    clnt_pcreateerror(opt.host);
+    return nullptr;
+  }
+
+  // Calls give up after 5 s, lost datagrams are sent again after 1 s
+  timeval timeout{5, 0}, retry{1, 0};
+  clnt_control(clnt, CLSET_TIMEOUT, (char *)&timeout);
+  if (!opt.tcp) clnt_control(clnt, CLSET_RETRY_TIMEOUT, (char *)&retry);
+  return clnt;
+}
+
+// Uniformly random location over the contiguous US, where the airports are
+static location randomLocation(std::mt19937 &gen) {
+  std::uniform_real_distribution<double> lat(25.0, 49.0), lon(-125.0, -67.0);
+  return { lat(gen), lon(gen) };
+}
+
+// Sends one request of the mix. Returns false when no reply came.
+static bool sendRequest(const Target target, CLIENT *clnt,
+                        const PlaceRecs &places, const unsigned namedPercent,
+                        std::mt19937 &gen, bool &errReply) {
+  const location loc = randomLocation(gen);
+  if (target == Target::Airports) {
+    location arg = loc;
+    airports_ret res{};
+    if (airports_qry_1(&arg, &res, clnt) != RPC_SUCCESS) return false;
+    errReply = res.err != 0;
+    clnt_freeres(clnt, (xdrproc_t)xdr_airports_ret, (caddr_t)&res);
+    return true;
+  }
+
+  places_req req{};
+  if (std::uniform_int_distribution<unsigned>(0, 99)(gen) < namedPercent) {
+    const CityRecord &rec = places.records[
+      std::uniform_int_distribution<size_t>(0, places.records.size() - 1)(gen)];
+    req.req_type = REQ_NAMED;
+    req.places_req_u.named.name = (char *)&places.names[rec.nameOff];
+    req.places_req_u.named.state =
+      (char *)&places.states[rec.stateId * MAX_STATE];
+  } else {
+    req.req_type = REQ_LAT_LONG;
+    req.places_req_u.loc = loc;
+  }
+
+  places_ret res{};
+  if (places_qry_1(&req, &res, clnt) != RPC_SUCCESS) return false;
+  errReply = res.err != 0;
+  clnt_freeres(clnt, (xdrproc_t)xdr_places_ret, (caddr_t)&res);
+  return true;
+}
+
+// Loads one server from every client until the measured window ends.
+// Returns false when a client could not be created or nothing was answered.
+static bool runPhase(const Options &opt, const Target target,
+                     const PlaceRecs &places) {
+  const bool isPlaces = target == Target::Places;
+  std::vector<CLIENT *> clnts;
+  for (unsigned i = 0; i < opt.clients; ++i) {
+    CLIENT *clnt = isPlaces ?
+      createClient(opt, PLACES_PROG, PLACES_VERS, opt.placesPort) :
+      createClient(opt, AIRPORTS_PROG, AIRPORTS_VERS, opt.airportsPort);
+    if (clnt == nullptr) {
+      for (CLIENT *c : clnts) clnt_destroy(c);
+      return false;
+    }
+    clnts.push_back(clnt);
+  }
+
+  // Every client sends every clients / rate seconds, staggered so the total
+  // is spread evenly
+  const Clock::duration interval = opt.rate > 0 ?
+    std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(opt.clients / opt.rate)) :
+    Clock::duration::zero();
+  const auto start = Clock::now();
+  const auto measureFrom = start +
+    std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(opt.warmupSeconds));
+  const auto stopAt = measureFrom +
+    std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(opt.seconds));
+
+  std::vector<PhaseStats> stats(opt.clients);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < opt.clients; ++t) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 gen(4520 + t);
+      PhaseStats &mine = stats[t];
+      auto next = start + interval * t / opt.clients;
+      for (;;) {
+        // Open loop requests are due on schedule, even when behind it
+        Clock::time_point sentAt;
+        if (opt.rate > 0) {
+          if (next >= stopAt) break;
+          std::this_thread::sleep_until(next);
+          sentAt = next;
+          next += interval;
+        } else {
+          sentAt = Clock::now();
+          if (sentAt >= stopAt) break;
+        }
+
+        bool errReply = false;
+        const bool ok = sendRequest(target, clnts[t], places,
+                                    opt.namedPercent, gen, errReply);
+        if (sentAt < measureFrom) continue;
+        if (!ok) {
+          ++mine.failed;
+          continue;
+        }
+        mine.errReplies += errReply;
+        mine.latencies.record((uint64_t)
+          std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - sentAt).count());
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  for (CLIENT *clnt : clnts) clnt_destroy(clnt);
+
+  PhaseStats all;
+  for (const auto &s : stats) {
+    all.latencies.merge(s.latencies);
+    all.errReplies += s.errReplies;
+    all.failed += s.failed;
+  }
+
+  const LatencyHistogram &lat = all.latencies;
+  printf("%s: %u clients, %s, ", isPlaces ? "places_server" : "airport_server",
+         opt.clients, opt.tcp ? "tcp" : "udp");
+  if (opt.rate > 0) printf("open loop at %.0f qps", opt.rate);
+  else printf("closed loop");
+  printf(", %.1f s warmup, %.1f s measured\n", opt.warmupSeconds, opt.seconds);
+  printf("  replies %llu (%llu errors), failed %llu, %.1f qps\n",
+         (unsigned long long)lat.count(), (unsigned long long)all.errReplies,
+         (unsigned long long)all.failed, lat.count() / opt.seconds);
+  printf("  latency ms: p50 %.3f  p90 %.3f  p99 %.3f  p999 %.3f  max %.3f\n",
+         lat.percentile(0.5) / 1000.0, lat.percentile(0.9) / 1000.0,
+         lat.percentile(0.99) / 1000.0, lat.percentile(0.999) / 1000.0,
+         lat.max() / 1000.0);
+  if (lat.count() == 0) return false;
+  lat.print();
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const Options opt = parseOptions(argc, argv);
+
+  TPlaceRecs places;
+  if (opt.runPlaces) {
+    try {
+      places = loadPlacesFromFile(opt.placesPath, 20000);
+    } catch (const std::exception &e) {
+      exitWithMessage(e.what());
+    }
+    if (places->records.empty()) exitWithMessage("Places file has no places.");
+  }
+
+  bool ok = true;
+  if (opt.runPlaces) ok = runPhase(opt, Target::Places, *places) && ok;
+  if (opt.runAirports) ok = runPhase(opt, Target::Airports, PlaceRecs()) && ok;
+  return ok ? 0 : 1;
+}
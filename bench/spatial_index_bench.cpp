@@ -0,0 +1,165 @@
+/*******************************************************************************
+ *   File: spatial_index_bench.cpp
+ * Author: Ben Targan
+ *   Desc: Compares the airport search engines on a global data set against a
+ *         brute force scan. The bundled airports are joined by random points
+ *         spread over the whole sphere, targets include the antimeridian and
+ *         polar caps where splitting on degrees is weakest. A second table
+ *         sweeps the data set size to find where the brute force scan stops
+ *         beating the tree (BRUTE_FORCE_MAX_AIRPORTS).
+ *
+ *         usage: spatial_index_bench [airportsFile] [nGlobal] [nQueries]
+ ******************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "airports/BruteForce.h"
+#include "airports/KDTree.h"
+#include "airports/geo.h"
+
+using Clock = std::chrono::steady_clock;
+
+template<typename TFn>
+static double secondsOf(TFn fn) {
+  const auto start = Clock::now();
+  fn();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Uniformly distributed location on the sphere
+static location randomLocation(std::mt19937 &gen) {
+  std::uniform_real_distribution<double> unit(-1.0, 1.0), lon(-180.0, 180.0);
+  return { std::asin(unit(gen)) * 180.0 / M_PI, lon(gen) };
+}
+
+static std::vector<DistAirport> bruteClosest(const std::vector<AirportRecord> &recs,
+                                             const location &target, size_t k) {
+  std::vector<DistAirport> all;
+  all.reserve(recs.size());
+  for (const auto &rec : recs)
+    all.emplace_back(rec, (double)greatCircleMiles(rec.loc, target));
+  std::stable_sort(all.begin(), all.end());
+  all.erase(all.begin() + std::min(k, all.size()), all.end());
+  return all;
+}
+
+static size_t bruteInRange(const std::vector<AirportRecord> &recs,
+                           const location &target, double miles) {
+  size_t n = 0;
+  for (const auto &rec : recs)
+    if ((double)greatCircleMiles(rec.loc, target) <= miles) ++n;
+  return n;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "data/airport-locations.txt";
+  const size_t nGlobal = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+  const size_t nQueries = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000;
+  constexpr size_t k = 5;
+  constexpr double radiusMiles = 150.0;
+
+  std::mt19937 gen(4520);
+  auto recs = *load_Airports(path);
+  std::string name = "Global", state = "ZZ";
+  for (size_t i = 0; i < nGlobal; ++i) {
+    char code[4];
+    snprintf(code, sizeof(code), "%03zu", i % 1000);
+    recs.push_back(AirportRecord{randomLocation(gen), code, name, state});
+  }
+
+  // Global targets, then a band around the antimeridian and the polar caps
+  std::vector<location> targets(nQueries);
+  std::uniform_real_distribution<double> edge(-2.0, 2.0), cap(75.0, 90.0);
+  for (size_t i = 0; i < nQueries; ++i) {
+    switch (i % 3) {
+      case 0: targets[i] = randomLocation(gen); break;
+      case 1: targets[i] = { randomLocation(gen).latitude,
+                             std::remainder(180.0 + edge(gen), 360.0) }; break;
+      default: targets[i] = { (i & 1 ? 1 : -1) * cap(gen),
+                              randomLocation(gen).longitude }; break;
+    }
+  }
+
+  printf("%zu airports, %zu queries\n\n", recs.size(), nQueries);
+  printf("%-12s %12s %14s %16s %12s\n", "engine", "build (ms)",
+         "k=5 (ns/qry)", "radius (ns/qry)", "mismatches");
+
+  // Search time alone, without the exact distances of the results
+  int status = 0;
+  const struct { SearchEngine engine; size_t maxNodes; const char *label; }
+  engines[] = { { SearchEngine::LatLong, 0, "latlong" },
+                { SearchEngine::Sphere, 0, "sphere" },
+                { SearchEngine::Sphere, 64, "sphere n=64" },
+                { SearchEngine::Sphere, 32, "sphere n=32" },
+                { SearchEngine::BruteForce, 0, "brute" } };
+  for (const auto &engine : engines) {
+    std::unique_ptr<SpatialIndex> index;
+    const double build = secondsOf([&]() {
+      index = makeSpatialIndex(engine.engine, TAirportRecs(
+        new std::vector<AirportRecord>(recs)), engine.maxNodes);
+    });
+
+    size_t sink = 0;
+    const double knn = secondsOf([&]() {
+      for (const auto &t : targets) {
+        TopK<k> top;
+        index->kClosest(t, top.get());
+        sink += top.get().size();
+      }
+    });
+    const double radius = secondsOf([&]() {
+      for (const auto &t : targets)
+        sink += index->locationsWithinRadius(t, radiusMiles).size();
+    });
+
+    // Answers are checked by distance, equally distant airports may swap
+    size_t mismatches = 0;
+    for (size_t q = 0; q < std::min<size_t>(nQueries, 1000); ++q) {
+      const auto expect = bruteClosest(recs, targets[q], k);
+      const auto got = index->kClosestLocations(targets[q], k);
+      for (size_t j = 0; j < k; ++j)
+        if (std::fabs(expect[j].dist - got[j].dist) > 1e-6) { ++mismatches; break; }
+      if (bruteInRange(recs, targets[q], radiusMiles) !=
+          index->locationsWithinRadius(targets[q], radiusMiles).size())
+        ++mismatches;
+    }
+
+    printf("%-12s %12.3f %14.1f %16.1f %12zu\n", engine.label, build * 1e3,
+           knn * 1e9 / nQueries, radius * 1e9 / nQueries, mismatches);
+
+    // Only a node budget may miss
+    if (engine.maxNodes == 0 && mismatches != 0) status = 1;
+    if (sink == 0) status = 1;
+  }
+
+  // Crossover of the scan and the tree over growing global data sets
+  printf("\nk=5 ns/qry by data set size, brute force kernel: %s\n",
+         BruteForceIndex::kernelName());
+  printf("%10s %12s %12s\n", "airports", "sphere", "brute");
+  const size_t nSweep = std::min<size_t>(nQueries, 20000);
+  for (size_t n = 64; n <= recs.size(); n *= 2) {
+    std::vector<AirportRecord> subset(recs.end() - n, recs.end());
+    double ns[2];
+    const SearchEngine sweep[] = { SearchEngine::Sphere,
+                                   SearchEngine::BruteForce };
+    for (int e = 0; e < 2; ++e) {
+      const auto index = makeSpatialIndex(sweep[e], TAirportRecs(
+        new std::vector<AirportRecord>(subset)));
+      size_t sink = 0;
+      ns[e] = secondsOf([&]() {
+        for (size_t q = 0; q < nSweep; ++q) {
+          TopK<k> top;
+          index->kClosest(targets[q], top.get());
+          sink += top.get().size();
+        }
+      }) * 1e9 / nSweep;
+      if (sink == 0) status = 1;
+    }
+    printf("%10zu %12.1f %12.1f\n", n, ns[0], ns[1]);
+  }
+
+  return status;
+}
@@ -0,0 +1,208 @@
+/*******************************************************************************
+ *   File: airport_lookup.h
+ * Author: Ben Targan
+ *   Desc: In process places and airports lookups, for programs linking the
+ *         search engines directly instead of calling the servers.
+ ******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "airports/SpatialIndex.h"
+#include "places/trie.h"
+
+/**
+ * \struct Place
+ * \brief Place found by name, copied out of the places index.
+ */
+struct Place {
+  std::string name;         ///< \var City name
+  std::string state;        ///< \var State code
+  location    loc;          ///< \var Location in lat / long
+  uint32_t    population;   ///< \var Population in the 2000 census
+};
+
+/**
+ * \struct PlaceQuery
+ * \brief Name of a place to look up.
+ */
+struct PlaceQuery {
+  std::string name;         ///< \var City name, case-insensitive
+  std::string state;        ///< \var State code, empty for any
+};
+
+/**
+ * \struct PlaceMatch
+ * \brief Result of a lookup by name.
+ */
+struct PlaceMatch {
+  std::vector<Place> places;  ///< \var Empty when not found, candidates when
+                              ///<      ambiguous, else the place
+  bool isAmbiguous;           ///< \var Name matches several places
+};
+
+/**
+ * \class AirportLookup
+ * \brief Places and airports indexes of the servers, queried in process
+ *        without the RPC round trips and XDR encoding.
+ *
+ * Load the airports and / or the places once, from their data files or from
+ * snapshots, then query from any number of threads. Lookups throw
+ * std::logic_error when the data they need was not loaded. The places can be
+ * reloaded while serving when their files change, see refreshPlaces().
+ *
+ * Thread safety: the const members may be called concurrently once loading
+ * returned, and concurrently with refreshPlaces(). The other loading
+ * members must not overlap any other call.
+ */
+class AirportLookup {
+  public:
+    AirportLookup() = default;
+
+    AirportLookup(const AirportLookup &) = delete;
+    AirportLookup &operator=(const AirportLookup &) = delete;
+
+    /**
+     * \brief Loads the airports and builds their search index. Throws on
+     *        IO/file format error.
+     * \param path Path to the airports file, or to a snapshot written by
+     *        airports_snapshot which is mapped and served by the sphere
+     *        engine whatever engine is asked for
+     * \param engine Spatial index to answer the queries with
+     * \param maxNodes Node budget of approximate k closest searches, 0 exact
+     */
+    void loadAirports(const char *path,
+                      SearchEngine engine = SearchEngine::Auto,
+                      size_t maxNodes = 0);
+
+    /**
+     * \brief Loads the places and builds their trie. Throws on IO/file format
+     *        error.
+     * \param path Path to the places file or to a places snapshot
+     * \param airportsPath Airports file to precompute the closest airports of
+     *        every place from, unless the snapshot holds those of the file as
+     *        it is. nullptr for none.
+     */
+    void loadPlaces(const char *path, const char *airportsPath = nullptr);
+
+    /**
+     * \brief Reloads the places, and their closest airports, when a file they
+     *        were loaded from changed since. The new trie is built off to the
+     *        side and replaces the served one as a whole, lookups already
+     *        running and holders of servedPlaces() keep the one they started
+     *        with. Throws on IO/file format error and keeps serving the
+     *        previous places, a failed reload is retried once the files
+     *        change again.
+     * \return True when the places were replaced
+     */
+    bool refreshPlaces();
+
+    /**
+     * \brief Trie of the places being served, for callers reading its records
+     *        directly. Holding it keeps the trie and the records found in it
+     *        valid across refreshPlaces().
+     */
+    std::shared_ptr<const Trie> servedPlaces() const;
+
+    /**
+     * \brief Number of airports loaded, 0 before loadAirports().
+     */
+    size_t airportCount() const;
+
+    /**
+     * \brief Number of places loaded, 0 before loadPlaces().
+     */
+    size_t placeCount() const;
+
+    /**
+     * \brief Looks up a place by name, case-insensitive. The state picks
+     *        between places sharing the name.
+     * \param query Name and optional state of the place
+     * \return The place, or the candidates when ambiguous
+     */
+    PlaceMatch findPlace(const PlaceQuery &query) const;
+
+    /**
+     * \brief Performs findPlace() for every query of a batch. Large batches
+     *        are split over several threads.
+     * \return Matches in the order of the queries
+     */
+    std::vector<PlaceMatch> findPlaces(const std::vector<PlaceQuery> &queries)
+      const;
+
+    /**
+     * \brief Collects the airports closest to a location.
+     * \param target Latitude / longitude to search around
+     * \param k Number of closest airports to collect
+     * \return Up to k airports, closest first. They point into the index.
+     */
+    std::vector<DistAirport> nearestAirports(location target,
+                                             size_t k = NRESULTS) const;
+
+    /**
+     * \brief Performs nearestAirports() for every target of a batch. Large
+     *        batches are split over several threads.
+     * \return Closest airports in the order of the targets
+     */
+    std::vector<std::vector<DistAirport>>
+    nearestAirportsBatch(const std::vector<location> &targets,
+                         size_t k = NRESULTS) const;
+
+    /**
+     * \brief Visits the airports closest to a location without allocating
+     *        for k up to MAX_KRESULTS, the form the airports server answers
+     *        from.
+     * \param target Latitude / longitude to search around
+     * \param k Number of closest airports to collect
+     * \param fn Called with (const AirportRecord &, double miles) for each
+     *        airport, closest first
+     * \return Number of airports visited, less than k for small data sets
+     */
+    template<typename TFn>
+    size_t forNearestAirports(location target, size_t k, TFn fn) const {
+      // Small requests keep to a small collector
+      if (k <= NRESULTS) return visitClosest<NRESULTS>(target, k, fn);
+      if (k <= MAX_KRESULTS) return visitClosest<MAX_KRESULTS>(target, k, fn);
+
+      const auto closest = airportIndex().kClosestLocations(target, k);
+      for (const auto &entry : closest) fn(*entry.airport, entry.dist);
+      return closest.size();
+    }
+
+    /**
+     * \brief Collects the airports within a radius of a location.
+     * \param target Latitude / longitude to search around
+     * \param miles Radius in statute miles
+     * \return Airports in range, closest first. They point into the index.
+     */
+    std::vector<DistAirport> airportsWithin(location target, double miles)
+      const;
+
+  private:
+    const SpatialIndex &airportIndex() const;
+    std::shared_ptr<const Trie> placesTrie() const;
+    static PlaceMatch matchPlace(const Trie &t, const PlaceQuery &query);
+
+    template<size_t K, typename TFn>
+    size_t visitClosest(const location target, const size_t k, TFn &fn) const {
+      TopK<K> top(k);
+      auto &closest = top.get();
+      airportIndex().kClosest(target, closest);
+      closest.finish(target);
+      for (const auto &entry : closest) fn(*entry.airport, entry.dist);
+      return closest.size();
+    }
+
+    std::unique_ptr<SpatialIndex> airports;   ///< Index of loaded airports
+
+    /** Trie of loaded places, replaced as a whole by a refresh. Read and
+     *  written with the atomic shared_ptr functions. */
+    std::shared_ptr<const Trie>   places;
+
+    // Files the places and their closest airports were loaded from, with
+    // their stamps at that time. Only touched while loading.
+    std::string placesPath, airportsPath;
+    FileStamp   placesStamp, airportsStamp;
+};
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ *   File: BruteForce.h
+ * Author: Ben Targan
+ *   Desc: Vectorized linear scan over all airports.
+ ******************************************************************************/
+#pragma once
+#include "airports/SpatialIndex.h"
+
+/**
+ * \class BruteForceIndex
+ * \brief Answers queries by scanning every airport. The unit sphere vectors
+ *        are kept in separate arrays and squared chords are computed a block
+ *        at a time with AVX2 or SSE2 (picked at startup from what the CPU
+ *        supports), so small data sets are searched faster than a tree walk
+ *        with its unpredictable branches.
+ *
+ * Results are ranked by squared chord like the trees and reported with the
+ * exact great circle distance, so all engines give the same answers.
+ *
+ * Thread safety: immutable once constructed, queries only read it.
+ */
+class BruteForceIndex : public SpatialIndex {
+  public:
+    /**
+     * \brief Takes ownership of air records.
+     * \param airRecs Airport records to take ownership of.
+     */
+    explicit BruteForceIndex(TAirportRecs airRecs);
+
+    void kClosest(location target, TopKCollector &closest) const override;
+
+    std::vector<DistAirport>
+    locationsWithinRadius(location target, double miles) const override;
+
+    size_t size() const override;
+
+    const char *name() const override { return "brute"; }
+
+    /**
+     * \brief Name of the chord kernel picked for this CPU.
+     */
+    static const char *kernelName();
+
+  private:
+    TAirportRecs        airports;   ///< Airports loaded from file, file order
+    std::vector<double> xs;         ///< Unit sphere x of each airport
+    std::vector<double> ys;         ///< Unit sphere y of each airport
+    std::vector<double> zs;         ///< Unit sphere z of each airport
+};
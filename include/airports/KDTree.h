@@ -1,57 +1,53 @@
 /*******************************************************************************
  *   File: airportsKdTree.h
  * Author: Connor Wilding
- *   Desc: Public API to build and lookup KD-Tree.
+ *   Desc: Airports file loader and latitude / longitude KD-Tree.
  ******************************************************************************/
 #pragma once
 #include <memory>
 #include "common.h"
+#include "airports/SpatialIndex.h"
 
-/** Type of collection of airports loaded from the airports file */
-using TAirportRecs = std::unique_ptr<std::vector<AirportRecord>>;
-
-// Public interface methods to init and search
+// Public interface methods to load
 /******************************************************************************/
 
 /**
- * \brief Initializes the kd tree data structure with given data.
+ * \brief Loads airport records from an airports file.
  * Throws on IO/file format error.
- * \param airportsPath Path to the airports file to load
+ * \param path Path to the airports file to load
+ * \return Loaded airport records in file order
  */
-extern "C" void initKD(const char* airportsPath);
-
-/**
- * \brief Performs a KNN lookup to get 5 closest airports.
- * Returns pointer to static data structure that does not need to be freed.
- * \param target      Latitude / longitude of target location to perform search
- * \return Ptr to a static arr of 5 elems that does not need to be freed.
- */
-airport* kd5Closest(location target);
-
-/**
- * \struct KDNode
- * \brief A node in the KD tree.
- */
-struct KDNode {
-  AirportRecord           airport;                ///< \var airport Airport entry
-  std::unique_ptr<KDNode> left;         ///< \var left Left KD subtree
-  std::unique_ptr<KDNode> right;        ///< \var right Right KD subtree
-  
-  /**
-   * \brief Constructs a KD-Tree node.
-   * \param pt Airport record
-   * \param lft Left subtree
-   * \param rgt Right subtree
-   */
-	KDNode(AirportRecord pt, std::unique_ptr<KDNode> lft,
-        std::unique_ptr<KDNode> rgt);
-};
+TAirportRecs load_Airports(const char* path);
 
 /**
  * \class AirportsKDTree
  * \brief Airports KD-Tree that allows for a closet locations query
+ *
+ * The tree is implicit: records are ordered so that the median of any index
+ * range [lo, hi) is the root of that subtree and the halves on either side are
+ * its children, so no node objects or child pointers are needed. Coordinates
+ * are kept in separate arrays in the same order, traversal reads only those
+ * and touches a record (and its strings) only to report it.
+ *
+ * Searches rank candidates by squared chord between precomputed unit sphere
+ * vectors and prune with trig-free or single-sin plane tests, the exact great
+ * circle distance is only computed for the reported results. The chord is a
+ * monotone function of the great circle distance, so rankings match a search
+ * done entirely in miles; two airports may only swap places when their
+ * distances agree to within about 1e-9 miles (double rounding of the chord).
+ *
+ * Splitting lines in degrees are not straight on the globe, so a plane test
+ * bounds the angle to the whole other side: a latitude plane by the latitude
+ * difference, a longitude plane by the closer of the split meridian and the
+ * antimeridian (where raw longitudes wrap), reaching over a pole when the
+ * meridian is more than 90 degrees away. Searches are exact everywhere, but
+ * visit more nodes near the poles and the antimeridian than SphereKDTree.
+ *
+ * Thread safety: the tree is immutable once constructed and the const
+ * members keep all search state on the caller's stack, so any number of
+ * threads may query one tree concurrently without locking.
  */
-class KDTree {
+class KDTree : public SpatialIndex {
   public:
     /**
      * \brief Takes ownership of air records and constructs a KD-Tree.
@@ -59,22 +55,56 @@ class KDTree {
      */
     explicit KDTree(TAirportRecs airRecs);
     
+    void kClosest(location target, TopKCollector &closest) const override;
+    
     /**
-     * \brief Collects k closest locations to the target
-     * \param target Target location to collect closest to
-     * \param k Number of closest collections to collect
-     * \return Closest k locations
+     * \brief Collects all locations within a radius of the target by a range
+     *        traversal that skips subtrees entirely out of range.
+     * \param target Target location to collect around
+     * \param miles Radius in statute miles
+     * \return Locations in range, closest first
      */
     std::vector<DistAirport>
-    kClosestLocations(location target, size_t k = 5) const;
+    locationsWithinRadius(location target, double miles) const override;
     
     /**
      * \brief Get number of airport records loaded into the kd tree.
      * \return Number of airport records in the tree.
      */
-    size_t size() const;
+    size_t size() const override;
+    
+    const char *name() const override { return "latlong"; }
   
   private:
-    TAirportRecs airports;          ///< Airports loaded from file
-    std::unique_ptr<KDNode> root;   ///< Root node of the KD tree.
+    struct KnnQuery;
+    struct RadiusQuery;
+    
+    /**
+     * \brief Traverses the subtree [lo, hi) and collects k-closest points.
+     * \param lo First index of the subtree
+     * \param hi Last exclusive index of the subtree
+     * \param query State of the search, collects the closest points
+     * \param isEvenNodeLevel Depth of the subtree root is even
+     */
+    void kClosestPimpl(size_t lo, size_t hi, KnnQuery &query,
+                       bool isEvenNodeLevel) const;
+    
+    /**
+     * \brief Traverses the subtree [lo, hi) and collects every point within
+     *        range. Only subtrees whose splitting plane may be within range
+     *        are visited.
+     * \param lo First index of the subtree
+     * \param hi Last exclusive index of the subtree
+     * \param query State of the search, collects the points in range
+     * \param isEvenNodeLevel Depth of the subtree root is even
+     */
+    void withinRadiusPimpl(size_t lo, size_t hi, RadiusQuery &query,
+                           bool isEvenNodeLevel) const;
+    
+    TAirportRecs        airports;   ///< Airports loaded from file, tree order
+    std::vector<double> lats;       ///< Latitude of each airport, tree order
+    std::vector<double> lons;       ///< Longitude of each airport, tree order
+    std::vector<double> xs;         ///< Unit sphere x of each airport
+    std::vector<double> ys;         ///< Unit sphere y of each airport
+    std::vector<double> zs;         ///< Unit sphere z of each airport
 };
\ No newline at end of file
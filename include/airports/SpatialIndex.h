@@ -0,0 +1,99 @@
+/*******************************************************************************
+ *   File: SpatialIndex.h
+ * Author: Ben Targan
+ *   Desc: Interface shared by the airport search engines.
+ ******************************************************************************/
+#pragma once
+#include <memory>
+#include <vector>
+#include "common.h"
+#include "airports/TopK.h"
+
+/** Type of collection of airports loaded from the airports file */
+using TAirportRecs = std::unique_ptr<std::vector<AirportRecord>>;
+
+/**
+ * \enum SearchEngine
+ * \brief Spatial index used to answer airport queries.
+ */
+enum class SearchEngine {
+  LatLong,    ///< KD-tree splitting on raw latitude / longitude
+  Sphere,     ///< KD-tree over unit sphere vectors, exact anywhere on earth
+  BruteForce, ///< Vectorized scan of every airport
+  Auto,       ///< BruteForce for small data sets, Sphere otherwise
+};
+
+/**
+ * Largest data set SearchEngine::Auto scans with BruteForce. Measured with
+ * spatial_index_bench, where a k = 5 scan stops beating the sphere tree.
+ */
+constexpr size_t BRUTE_FORCE_MAX_AIRPORTS = 256;
+
+/**
+ * \brief Parses a search engine name as given on the command line.
+ * \param name Engine name: latlong, sphere, brute or auto
+ * \param engine OUT parsed engine
+ * \return False when the name is not recognized
+ */
+bool parseSearchEngine(const char *name, SearchEngine &engine);
+
+/**
+ * \class SpatialIndex
+ * \brief Read-only index over airport records answering nearest airport
+ *        queries. Implementations are immutable once constructed, so const
+ *        members may be called from any number of threads at once.
+ */
+class SpatialIndex {
+  public:
+    virtual ~SpatialIndex() = default;
+
+    /**
+     * \brief Offers the airports closest to the target to the collector,
+     *        ranked by squared unit sphere chord. Never allocates.
+     * \param target Target location to collect closest to
+     * \param closest OUT collects the closest capacity() airports, call
+     *        finish() on it for miles and final order
+     */
+    virtual void kClosest(location target, TopKCollector &closest) const = 0;
+
+    /**
+     * \brief Collects k closest locations to the target. Convenience form
+     *        of kClosest() allocating the result.
+     * \param target Target location to collect closest to
+     * \param k Number of closest collections to collect
+     * \return Closest k locations, closest first
+     */
+    std::vector<DistAirport>
+    kClosestLocations(location target, size_t k = 5) const;
+
+    /**
+     * \brief Collects all locations within a radius of the target.
+     * \param target Target location to collect around
+     * \param miles Radius in statute miles
+     * \return Locations in range, closest first
+     */
+    virtual std::vector<DistAirport>
+    locationsWithinRadius(location target, double miles) const = 0;
+
+    /**
+     * \brief Get number of airport records in the index.
+     */
+    virtual size_t size() const = 0;
+
+    /**
+     * \brief Name of the engine for logs.
+     */
+    virtual const char *name() const = 0;
+};
+
+/**
+ * \brief Builds the index of the given engine over the records.
+ * \param engine Engine to build
+ * \param airRecs Airport records the index takes ownership of
+ * \param maxNodes Node budget of an approximate k closest search, 0 for
+ *        exact searches. Only the sphere tree searches approximately.
+ * \return Built index
+ */
+std::unique_ptr<SpatialIndex> makeSpatialIndex(SearchEngine engine,
+                                               TAirportRecs airRecs,
+                                               size_t maxNodes = 0);
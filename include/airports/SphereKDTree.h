@@ -0,0 +1,135 @@
+/*******************************************************************************
+ *   File: SphereKDTree.h
+ * Author: Ben Targan
+ *   Desc: KD-tree over airports projected onto the unit sphere.
+ ******************************************************************************/
+#pragma once
+#include <cstdint>
+#include "airports/SpatialIndex.h"
+#include "airports/geo.h"
+#include "snapshot.h"
+
+/**
+ * \class SphereKDTree
+ * \brief KD-tree over the earth centered unit vectors of the airports.
+ *
+ * The latitude / longitude tree prunes with distances to its splitting lines
+ * that are not lower bounds near the antimeridian or the poles. Here points
+ * live in 3D and the straight line (chord) between two points never exceeds
+ * their great circle distance, so the distance from the target to an axis
+ * aligned splitting plane is a true lower bound of the chord to every point
+ * behind it. Pruning is therefore exact for any data set on the globe, and
+ * splitting on the axis of widest spread keeps cells compact.
+ *
+ * Like KDTree the tree is implicit: the median of any index range [lo, hi) is
+ * the root of that subtree, with its split axis kept per node.
+ *
+ * Searches are iterative. A k closest search walks from the root to a leaf
+ * on the near side of every plane, keeping each far subtree along with the
+ * lower bound of its chords in a small fixed frontier, then resumes from the
+ * frontier until no subtree can beat the k-th closest. The walk state lives
+ * in fixed arrays on the stack, no recursion or allocation.
+ *
+ * With a node budget the search stops after visiting that many nodes and
+ * returns the best found so far, bounding the latency of pathological
+ * queries at the cost of exactness. The frontier is then a priority queue
+ * resuming from the subtree of lowest bound (best bin first), so the budget
+ * is spent where the closest points most likely are. Exact searches have to
+ * visit every subtree that can win regardless of order and go depth first
+ * with a fixed stack instead, which skips the heap upkeep.
+ *
+ * A built tree can be written to a snapshot file and served from a read-only
+ * mapping of it later without parsing or copying (see snapshot.h), processes
+ * serving the same snapshot share its pages.
+ *
+ * Thread safety: immutable once constructed, queries only read it.
+ */
+class SphereKDTree : public SpatialIndex {
+  public:
+    /**
+     * \brief Takes ownership of air records and constructs the tree.
+     * \param airRecs Airport records to take ownership of.
+     * \param maxNodes Most nodes a k closest search visits, 0 for an exact
+     *        search without limit
+     */
+    explicit SphereKDTree(TAirportRecs airRecs, size_t maxNodes = 0);
+
+    /**
+     * \brief Serves the tree stored in a snapshot. Throws
+     *        std::invalid_argument when it does not hold a tree of this build.
+     * \param snapshot Mapped snapshot written by writeSnapshot()
+     * \param maxNodes Most nodes a k closest search visits, 0 for an exact
+     *        search without limit
+     */
+    explicit SphereKDTree(std::unique_ptr<Snapshot> snapshot,
+                          size_t maxNodes = 0);
+
+    /**
+     * \brief Checks whether a file is a tree snapshot.
+     */
+    static bool isSnapshot(const char *path);
+
+    /**
+     * \brief Maps a tree snapshot. Throws std::invalid_argument when it is
+     *        not a valid tree snapshot.
+     */
+    static std::unique_ptr<Snapshot> openSnapshot(const char *path);
+
+    /**
+     * \brief Writes the tree to a snapshot file. Throws std::runtime_error
+     *        on IO error.
+     * \param path Path of the snapshot file, replaced atomically
+     */
+    void writeSnapshot(const char *path) const;
+
+    void kClosest(location target, TopKCollector &closest) const override;
+
+    std::vector<DistAirport>
+    locationsWithinRadius(location target, double miles) const override;
+
+    size_t size() const override;
+
+    const char *name() const override { return "sphere"; }
+
+  private:
+    struct Frame;
+    struct Frontier;
+    struct KnnQuery;
+
+    /**
+     * \brief Walks from the root of a subtree to a leaf on the near side of
+     *        every plane, collecting closest points and handing far subtrees
+     *        to the frontier. Far subtrees the frontier has no room for are
+     *        searched depth first right away.
+     * \param frame Subtree to walk and its lower bound
+     * \param query State of the search
+     * \param frontier Far subtrees waiting to be searched
+     */
+    void descend(Frame frame, KnnQuery &query, Frontier &frontier) const;
+
+    /**
+     * \brief Coordinate of a node along an axis.
+     */
+    double coord(size_t idx, int axis) const {
+      return axis == 0 ? xs[idx] : axis == 1 ? ys[idx] : zs[idx];
+    }
+
+    /**
+     * \brief Points the arrays searches read at the built or mapped data.
+     */
+    void bind(const AirportRecord *recs, const double *coords,
+              const uint8_t *splitAxes, size_t n);
+
+    std::vector<AirportRecord> builtRecs;   ///< Records when built in memory
+    std::vector<double>        builtCoords; ///< x, y then z when built
+    std::vector<uint8_t>       builtAxes;   ///< Split axes when built
+    std::unique_ptr<Snapshot>  snapshot;    ///< Mapping when loaded
+
+    const AirportRecord *airports;  ///< Airports in tree order
+    const double        *xs;        ///< Unit sphere x of each airport
+    const double        *ys;        ///< Unit sphere y of each airport
+    const double        *zs;        ///< Unit sphere z of each airport
+    const uint8_t       *axes;      ///< Split axis of each node: 0 x, 1 y, 2 z
+    size_t               count;     ///< Number of airports
+    size_t               maxNodes;  ///< Node budget of a search, 0 unlimited
+};
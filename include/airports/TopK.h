@@ -0,0 +1,135 @@
+/*******************************************************************************
+ *   File: TopK.h
+ * Author: Ben Targan
+ *   Desc: Allocation free collector of the k closest airports of a search.
+ ******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include "common.h"
+
+/**
+ * \struct TopKEntry
+ * \brief Airport collected by a k closest search.
+ */
+struct TopKEntry {
+  double               dist;      ///< \var Rank while searching, miles once finished
+  uint32_t             seq;       ///< \var Order the airport was offered in
+  const AirportRecord *airport;   ///< \var Collected airport
+
+  /**
+   * \brief Orders entries by rank, earlier offers first on equal ranks.
+   */
+  bool operator<(const TopKEntry &other) const {
+    return dist < other.dist || (dist == other.dist && seq < other.seq);
+  }
+};
+
+/**
+ * \class TopKCollector
+ * \brief Bounded max-heap over caller provided storage keeping the k best
+ *        (lowest ranked) airports offered to it. Offers cost O(log k) and
+ *        never allocate. Ties keep the airport offered first, the same as a
+ *        sorted insertion that only replaces strictly worse entries.
+ *
+ * The search engines fill it through the non-template collector, the
+ * storage comes from TopK<K> which callers keep on the stack.
+ */
+class TopKCollector {
+  public:
+    /**
+     * \brief Collects into storage.
+     * \param storage Room for k entries, must outlive the collector
+     * \param k Number of airports to keep
+     */
+    TopKCollector(TopKEntry *storage, size_t k) :
+      heap(storage), k(k),
+      worstRank(k == 0 ? -std::numeric_limits<double>::infinity()
+                       : std::numeric_limits<double>::infinity()) { }
+
+    /**
+     * \brief Number of airports to keep.
+     */
+    size_t capacity() const { return k; }
+
+    /**
+     * \brief Number of airports collected so far.
+     */
+    size_t size() const { return n; }
+
+    /**
+     * \brief All k airports have been collected.
+     */
+    bool full() const { return n == k; }
+
+    /**
+     * \brief Rank an airport has to beat to be collected, infinite until
+     *        the collector is full.
+     */
+    double worst() const { return worstRank; }
+
+    /**
+     * \brief Offers an airport, kept when it beats worst().
+     * \param rank Rank of the airport, lower is closer
+     * \param airp Airport offered
+     */
+    void offer(double rank, const AirportRecord &airp) {
+      if (!(rank < worstRank)) return;
+      const TopKEntry entry{rank, seq++, &airp};
+      if (n < k) {
+        heap[n++] = entry;
+        std::push_heap(heap, heap + n);
+      } else {
+        std::pop_heap(heap, heap + n);
+        heap[n - 1] = entry;
+        std::push_heap(heap, heap + n);
+      }
+      if (n == k) worstRank = heap[0].dist;
+    }
+
+    /**
+     * \brief Replaces the ranks with the exact great circle distance to the
+     *        target and orders the entries closest first. Collected airports
+     *        whose distances tie keep their rank order.
+     * \param target Target of the search
+     */
+    void finish(const location &target);
+
+    /**
+     * \brief Collected entries, closest first once finished.
+     */
+    const TopKEntry *begin() const { return heap; }
+    const TopKEntry *end() const { return heap + n; }
+
+  private:
+    TopKEntry *heap;      ///< Max-heap on rank until finished
+    size_t     k;         ///< Number of airports to keep
+    size_t     n = 0;     ///< Number of airports kept
+    uint32_t   seq = 0;   ///< Number of offers kept so far, breaks ties
+    double     worstRank; ///< Rank of the k-th closest once full
+};
+
+/**
+ * \class TopK
+ * \brief TopKCollector with in place storage for up to K airports.
+ * \tparam K Largest number of airports collected
+ */
+template<size_t K>
+class TopK {
+  public:
+    /**
+     * \brief Collects the k closest airports, k is capped at K.
+     */
+    explicit TopK(size_t k = K) : collector(storage, std::min(k, K)) { }
+
+    TopK(const TopK &) = delete;
+    TopK &operator=(const TopK &) = delete;
+
+    TopKCollector &get() { return collector; }
+    const TopKCollector &get() const { return collector; }
+
+  private:
+    TopKEntry     storage[K];
+    TopKCollector collector;
+};
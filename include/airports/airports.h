@@ -8,6 +8,8 @@
 
 #include <rpc/rpc.h>
 
+#include <pthread.h>
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,14 +22,32 @@ extern "C" {
 
 #if defined(__STDC__) || defined(__cplusplus)
 #define AIRPORTS_QRY 2
-extern  airports_ret * airports_qry_1(location *, CLIENT *);
-extern  airports_ret * airports_qry_1_svc(location *, struct svc_req *);
+extern  enum clnt_stat airports_qry_1(location *, airports_ret *, CLIENT *);
+extern  bool_t airports_qry_1_svc(location *, airports_ret *, struct svc_req *);
+#define AIRPORTS_QRY_BATCH 3
+extern  enum clnt_stat airports_qry_batch_1(locations *, airports_batch_ret *, CLIENT *);
+extern  bool_t airports_qry_batch_1_svc(locations *, airports_batch_ret *, struct svc_req *);
+#define AIRPORTS_QRY_K 4
+extern  enum clnt_stat airports_qry_k_1(knn_req *, airport_list_ret *, CLIENT *);
+extern  bool_t airports_qry_k_1_svc(knn_req *, airport_list_ret *, struct svc_req *);
+#define AIRPORTS_QRY_RADIUS 5
+extern  enum clnt_stat airports_qry_radius_1(radius_req *, airport_list_ret *, CLIENT *);
+extern  bool_t airports_qry_radius_1_svc(radius_req *, airport_list_ret *, struct svc_req *);
 extern int airports_prog_1_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
 #define AIRPORTS_QRY 2
-extern  airports_ret * airports_qry_1();
-extern  airports_ret * airports_qry_1_svc();
+extern  enum clnt_stat airports_qry_1();
+extern  bool_t airports_qry_1_svc();
+#define AIRPORTS_QRY_BATCH 3
+extern  enum clnt_stat airports_qry_batch_1();
+extern  bool_t airports_qry_batch_1_svc();
+#define AIRPORTS_QRY_K 4
+extern  enum clnt_stat airports_qry_k_1();
+extern  bool_t airports_qry_k_1_svc();
+#define AIRPORTS_QRY_RADIUS 5
+extern  enum clnt_stat airports_qry_radius_1();
+extern  bool_t airports_qry_radius_1_svc();
 extern int airports_prog_1_freeresult ();
 #endif /* K&R C */
 
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ *   File: geo.h
+ * Author: Ben Targan
+ *   Desc: Great circle distance and the cheaper unit sphere chord kernel the
+ *         airport searches rank candidates with.
+ ******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "place_airport_common.h"
+
+/** Earth radius in statute miles used by every distance computation */
+constexpr double EARTH_RADIUS_MILES = 3959.0;
+
+/**
+ * \brief Converts degrees to radians.
+ */
+inline double deg2rad(double deg) {
+  return deg * (M_PI / 180.0);
+}
+
+/**
+ * \brief Computes the great circle distance between two locations. This is the
+ *        reference distance reported to users, long double precision is used
+ *        since the acos form suffers from floating point degradation.
+ * \param pt1 Location of point 1
+ * \param pt2 Location of point 2
+ * \return Circle distance in statute miles
+ */
+long double greatCircleMiles(const location &pt1, const location &pt2);
+
+/**
+ * \struct UnitVec
+ * \brief Point on the unit sphere in earth centered cartesian coordinates.
+ */
+struct UnitVec {
+  double x;   ///< \var x Towards lat 0, long 0
+  double y;   ///< \var y Towards lat 0, long 90
+  double z;   ///< \var z Towards the north pole
+};
+
+/**
+ * \brief Projects a location onto the unit sphere.
+ */
+inline UnitVec toUnitVec(const location &loc) {
+  const double lat = deg2rad(loc.latitude);
+  const double lon = deg2rad(loc.longitude);
+  return { std::cos(lat) * std::cos(lon),
+           std::cos(lat) * std::sin(lon),
+           std::sin(lat) };
+}
+
+/**
+ * \brief Squared chord length between two points on the unit sphere. It is a
+ *        monotone function of the great circle distance, so it ranks
+ *        candidates the same way for a few multiplies and no trigonometry.
+ */
+inline double chord2(const UnitVec &a, const UnitVec &b) {
+  const double dx = a.x - b.x;
+  const double dy = a.y - b.y;
+  const double dz = a.z - b.z;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * \brief Central angle in radians subtended by a squared chord.
+ */
+inline double chord2ToAngle(double c2) {
+  return 2.0 * std::asin(std::min(1.0, std::sqrt(c2) / 2.0));
+}
+
+/**
+ * \brief Squared chord subtended by a central angle in radians.
+ */
+inline double angleToChord2(double angle) {
+  const double chord = 2.0 * std::sin(std::min(angle, M_PI) / 2.0);
+  return chord * chord;
+}
+
+/**
+ * \brief Squared chord of a distance in statute miles.
+ */
+inline double milesToChord2(double miles) {
+  return angleToChord2(miles / EARTH_RADIUS_MILES);
+}
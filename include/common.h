@@ -5,16 +5,21 @@
  ******************************************************************************/
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <memory>
 #include "place_airport_common.h"
 
-#ifndef NDEBUG
-#define log_printf(fmt, ...) \
+// Logged in every build, for reports worth keeping in release such as load
+// times, whose arguments are then always used
+#define info_printf(fmt, ...) \
         do { fprintf(stderr, "[%s()]: " fmt "\n", \
                      __func__, __VA_ARGS__); } while (0)
+
+#ifndef NDEBUG
+#define log_printf(fmt, ...) info_printf(fmt, __VA_ARGS__)
 #else
 #define log_printf(X, ...)
 #endif
@@ -32,42 +37,52 @@ void exitWithMessage(const char *msg);
  * \struct CityRecord
  * \brief City record.
  *
- * City record.
+ * City record, kept compact for the tens of thousands held by the places
+ * index. The name is kept in the names arena and the state code in the state
+ * table of the index the record belongs to, so records hold no pointers and
+ * can be copied bytewise, e.g. into and out of a places snapshot file.
+ * Coordinates are fixed-point millionths of a degree, the precision of the
+ * places file, and convert back to the same doubles parsing the file gives.
  */
  struct CityRecord {
-   std::string cityName;
-   std::string state;
-   location    loc{};
+   int32_t  latitude;   ///< \var Latitude in millionths of a degree
+   int32_t  longitude;  ///< \var Longitude in millionths of a degree
+   uint32_t nameOff;    ///< \var Offset of the NUL terminated name
+   uint32_t population; ///< \var Population in the 2000 census
+   uint8_t  nameLen;    ///< \var Length of the name
+   uint8_t  stateId;    ///< \var Index of the state code in the state table
    
-   CityRecord();
-   
-   CityRecord(std::string cityName_,
-              const std::string &state_,
-              const location &loc_);
+   /**
+    * \brief Location in lat / long
+    */
+   location loc() const { return { latitude / 1e6, longitude / 1e6 }; }
  };
 
 /**
  * \struct AirportRecord
  * \brief An Airport record.
- * An Airport record.
+ * An Airport record. Strings are held in place with the sizes of the wire
+ * format, so records hold no pointers and can be copied bytewise, e.g. into
+ * and out of an airports snapshot file.
  */
  struct AirportRecord {
-   location    loc{};        ///< \var Location in lat / long
-   std::string code;    ///< \var Airport 3-digit code
-   std::string name;    ///< \var Full airport name.
-   std::string state;   ///< \var Airport state
+   location loc{};              ///< \var Location in lat / long
+   char     code[MAX_AIRCODE];  ///< \var Airport 3-digit code
+   char     name[MAX_NAME];     ///< \var Full airport name.
+   char     state[MAX_STATE];   ///< \var Airport state
    
    /**
-    * \brief Construct an airport record.
+    * \brief Construct an airport record. Strings longer than the wire format
+    *        allows are truncated.
     * \param location Location in lat / long
     * \param acode 3-digit airport code
     * \param aname Full airport name
     * \param astate State airport is located in
     */
     explicit AirportRecord(location location,
-                           std::string  acode,
-                           std::string &aname,
-                           std::string &astate);
+                           const std::string &acode,
+                           const std::string &aname,
+                           const std::string &astate);
  };
 
 /**
@@ -93,10 +108,36 @@ void exitWithMessage(const char *msg);
     bool operator<(const DistAirport &other) const;
  };
  
+// Largest XDR encoding of a string of at most maxLen bytes: a length word
+// and the bytes padded to a multiple of 4
+constexpr size_t xdrStringMaxSize(size_t maxLen) {
+  return 4 + (maxLen + 3) / 4 * 4;
+}
+
+// Largest XDR encoding of an airport: location, distance and the strings at
+// their maximum lengths
+constexpr size_t XDR_AIRPORT_MAX_SIZE = 3 * sizeof(double) +
+  xdrStringMaxSize(MAX_AIRCODE) + xdrStringMaxSize(MAX_NAME) +
+  xdrStringMaxSize(MAX_STATE);
+
+// Accepted reply header with a null verifier, then the err word and the
+// length of the result list
+constexpr size_t XDR_LIST_REPLY_OVERHEAD = 6 * 4 + 2 * 4;
+
+// Most airports a list reply carries in one UDPMSGSIZE datagram, larger
+// replies make svc_sendreply() fail and the caller time out
+constexpr size_t MAX_UDP_AIRPORTS =
+  (UDPMSGSIZE - XDR_LIST_REPLY_OVERHEAD) / XDR_AIRPORT_MAX_SIZE;
+
+// Most targets an AIRPORTS_QRY_BATCH reply carries in one datagram
+constexpr size_t MAX_UDP_BATCH = MAX_UDP_AIRPORTS / NRESULTS;
+static_assert(MAX_UDP_BATCH > 0, "UDP replies must fit one batch entry");
+
 std::ostream &operator<<(std::ostream &strm, const location &loc);
 std::ostream &operator<<(std::ostream &strm, const place &pl);
 std::ostream &operator<<(std::ostream &strm, const places_ret &plRet);
-std::ostream &operator<<(std::ostream &strm, const CityRecord &rec);
+std::ostream &operator<<(std::ostream &strm, const complete_ret &compRet);
+std::ostream &operator<<(std::ostream &strm, const fuzzy_ret &fuzzyRet);
 std::ostream &operator<<(std::ostream &strm, const DistAirport &rec);
 std::ostream &operator<<(std::ostream &strm, const airport &airp);
 std::ostream &operator<<(std::ostream &strm, const airports_ret &airRet);
@@ -0,0 +1,184 @@
+/*******************************************************************************
+ *   File: lru_cache.h
+ * Author: Ben Targan
+ *   Desc: Bounded, sharded least recently used cache of query results, keyed
+ *         on coordinates snapped to a grid.
+ ******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "common.h"
+#include "stats.h"
+
+/**
+ * \struct GridKey
+ * \brief Location snapped to a grid of 10^-decimals degree cells. Locations
+ *        in the same cell share their cached results.
+ */
+struct GridKey {
+  int64_t latitude;   ///< \var Cell row, latitude * 10^decimals rounded
+  int64_t longitude;  ///< \var Cell column, longitude * 10^decimals rounded
+
+  bool operator==(const GridKey &other) const {
+    return latitude == other.latitude && longitude == other.longitude;
+  }
+};
+
+/**
+ * \struct GridKeyHash
+ * \brief Mixes both cells so nearby keys spread over shards and buckets.
+ */
+struct GridKeyHash {
+  size_t operator()(const GridKey &key) const {
+    uint64_t h = (uint64_t)key.latitude * 0x9E3779B97F4A7C15ULL ^
+                 (uint64_t)key.longitude;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 29;
+    return (size_t)h;
+  }
+};
+
+/** Most decimals of a degree a grid resolves, beyond the double precision */
+constexpr int MAX_GRID_DECIMALS = 9;
+
+/**
+ * \brief Snaps a location to its grid cell.
+ * \param loc Location to snap
+ * \param decimals Cell size is 10^-decimals degrees, 0 to MAX_GRID_DECIMALS
+ * \param key OUT cell of the location
+ * \return False when the location is not a finite coordinate on earth and
+ *         is not to be cached
+ */
+inline bool gridKey(const location &loc, const int decimals, GridKey &key) {
+  if (!(std::fabs(loc.latitude) <= 90.0 && std::fabs(loc.longitude) <= 360.0))
+    return false;
+  const double scale = std::pow(10.0, decimals);
+  key = { std::llround(loc.latitude * scale),
+          std::llround(loc.longitude * scale) };
+  return true;
+}
+
+/**
+ * \struct CacheCounters
+ * \brief Counters a cache reports to. They are process lifetime statics of
+ *        the module owning the cache, see StatCounter.
+ */
+struct CacheCounters {
+  StatCounter *hits;        ///< \var Lookups answered from the cache
+  StatCounter *misses;      ///< \var Lookups not in the cache
+  StatCounter *evictions;   ///< \var Entries dropped to stay under the cap
+};
+
+/**
+ * \class ShardedLruCache
+ * \brief Fixed capacity map evicting its least recently used entries.
+ *
+ * Keys are spread over shards by hash, each shard is an LRU list with a hash
+ * index behind its own mutex, so threads looking up different keys rarely
+ * wait on each other. Every shard holds an equal part of the capacity, which
+ * is derived from a memory cap and a per entry cost covering the key, the
+ * value and the list and index nodes.
+ *
+ * Thread safety: all members may be called from any number of threads.
+ * \tparam TKey Key type, hashed with THash
+ * \tparam TValue Value type, copied in and out
+ */
+template<typename TKey, typename TValue, typename THash = std::hash<TKey>>
+class ShardedLruCache {
+  public:
+    /** Approximate bytes held per entry, used against the memory cap */
+    static constexpr size_t ENTRY_BYTES =
+      sizeof(TKey) + sizeof(TValue) + 8 * sizeof(void *);
+
+    /**
+     * \brief Creates an empty cache.
+     * \param maxBytes Memory cap of all entries
+     * \param counters Counters to report hits, misses and evictions to
+     * \param nShards Number of independently locked shards
+     */
+    ShardedLruCache(size_t maxBytes, const CacheCounters &counters,
+                    size_t nShards = 16) :
+      shards(new Shard[nShards]), nShards(nShards), counters(counters) {
+      const size_t perShard = maxBytes / ENTRY_BYTES / nShards;
+      for (size_t i = 0; i < nShards; ++i)
+        shards[i].capacity = std::max<size_t>(perShard, 1);
+    }
+
+    ShardedLruCache(const ShardedLruCache &) = delete;
+    ShardedLruCache &operator=(const ShardedLruCache &) = delete;
+
+    /**
+     * \brief Looks up a key, making it the most recently used.
+     * \param key Key to look up
+     * \param value OUT cached value when found
+     * \return True when found
+     */
+    bool get(const TKey &key, TValue &value) {
+      Shard &shard = shardOf(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const auto it = shard.index.find(key);
+      if (it == shard.index.end()) {
+        counters.misses->inc();
+        return false;
+      }
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      value = it->second->second;
+      counters.hits->inc();
+      return true;
+    }
+
+    /**
+     * \brief Caches a value as the most recently used, evicting the least
+     *        recently used entry of its shard when full.
+     * \param key Key of the value
+     * \param value Value to cache
+     */
+    void put(const TKey &key, const TValue &value) {
+      Shard &shard = shardOf(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const auto it = shard.index.find(key);
+      if (it != shard.index.end()) {
+        it->second->second = value;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+      }
+
+      shard.lru.emplace_front(key, value);
+      shard.index.emplace(key, shard.lru.begin());
+      if (shard.index.size() > shard.capacity) {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        counters.evictions->inc();
+      }
+    }
+
+    /**
+     * \brief Most entries the cache holds.
+     */
+    size_t capacity() const { return shards[0].capacity * nShards; }
+
+  private:
+    using TEntries = std::list<std::pair<TKey, TValue>>;
+
+    struct Shard {
+      std::mutex mutex;     // Guards the rest of the shard
+      TEntries   lru;       // Most recently used first
+      std::unordered_map<TKey, typename TEntries::iterator, THash> index;
+      size_t     capacity;  // Most entries
+    };
+
+    // Shards take the high bits, the index buckets use the low ones
+    Shard &shardOf(const TKey &key) {
+      return shards[((uint64_t)THash()(key) >> 32) % nShards];
+    }
+
+    std::unique_ptr<Shard[]> shards;      ///< Independently locked parts
+    size_t                   nShards;     ///< Number of shards
+    CacheCounters            counters;    ///< Where lookups are counted
+};
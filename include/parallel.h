@@ -0,0 +1,75 @@
+/*******************************************************************************
+ *   File: parallel.h
+ * Author: Ben Targan
+ *   Desc: Minimal fork/join helper used by batch queries and loaders.
+ ******************************************************************************/
+#pragma once
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Splits [0, n) into contiguous chunks and runs fn(begin, end) on each
+ *        chunk, one thread per chunk, returning once all are done. Runs inline
+ *        on the calling thread when n is too small to be worth splitting.
+ * \param n Number of items
+ * \param minPerThread Smallest chunk worth handing to its own thread
+ * \param fn Callable taking (size_t begin, size_t end)
+ */
+template<typename TFn>
+void parallelFor(size_t n, size_t minPerThread, TFn fn) {
+  const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+  const size_t nChunks = std::min(hw, n / std::max<size_t>(minPerThread, 1));
+  if (nChunks <= 1) {
+    fn((size_t)0, n);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(nChunks - 1);
+  const size_t chunk = (n + nChunks - 1) / nChunks;
+  for (size_t begin = chunk; begin < n; begin += chunk)
+    threads.emplace_back(fn, begin, std::min(begin + chunk, n));
+
+  // Calling thread takes the first chunk
+  fn((size_t)0, std::min(chunk, n));
+  for (auto &t : threads) t.join();
+}
+
+/**
+ * \brief Depth down to which a recursive build over n items forks one subtree
+ *        per level onto its own thread: deep enough to give every hardware
+ *        thread a subtree, shallow enough that subtrees keep minPerThread
+ *        items. 0 means build on the calling thread only.
+ * \param n Number of items
+ * \param minPerThread Smallest subtree worth handing to its own thread
+ */
+inline int parallelForkDepth(size_t n, size_t minPerThread) {
+  const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+  int depth = 0;
+  while (((size_t)1 << depth) < hw &&
+         (n >> (depth + 1)) >= std::max<size_t>(minPerThread, 1))
+    ++depth;
+  return depth;
+}
+
+/**
+ * \brief Runs fn1() on a new thread and fn2() on the calling thread when
+ *        parallel is set, both on the calling thread otherwise. Returns once
+ *        both are done.
+ * \param parallel Run the two concurrently
+ * \param fn1 Callable taking no arguments
+ * \param fn2 Callable taking no arguments
+ */
+template<typename TFn1, typename TFn2>
+void parallelInvoke(bool parallel, TFn1 fn1, TFn2 fn2) {
+  if (!parallel) {
+    fn1();
+    fn2();
+    return;
+  }
+  
+  std::thread thread(fn1);
+  fn2();
+  thread.join();
+}
@@ -78,6 +78,125 @@ struct airports_ret {
 };
 typedef struct airports_ret airports_ret;
 
+typedef struct {
+	u_int locations_len;
+	location *locations_val;
+} locations;
+
+typedef struct {
+	u_int airports_batch_len;
+	airports *airports_batch_val;
+} airports_batch;
+
+struct airports_batch_ret {
+	int err;
+	union {
+		airports_batch results;
+		char *error_msg;
+	} airports_batch_ret_u;
+};
+typedef struct airports_batch_ret airports_batch_ret;
+
+typedef struct {
+	u_int places_reqs_len;
+	places_req *places_reqs_val;
+} places_reqs;
+
+typedef struct {
+	u_int places_rets_len;
+	places_ret *places_rets_val;
+} places_rets;
+
+struct places_batch_ret {
+	int err;
+	union {
+		places_rets results;
+		char *err_msg;
+	} places_batch_ret_u;
+};
+typedef struct places_batch_ret places_batch_ret;
+
+typedef struct {
+	u_int airport_list_len;
+	airport *airport_list_val;
+} airport_list;
+
+struct knn_req {
+	location loc;
+	int k;
+};
+typedef struct knn_req knn_req;
+
+struct radius_req {
+	location loc;
+	double miles;
+	int max_results;
+};
+typedef struct radius_req radius_req;
+
+struct airport_list_ret {
+	int err;
+	union {
+		airport_list results;
+		char *error_msg;
+	} airport_list_ret_u;
+};
+typedef struct airport_list_ret airport_list_ret;
+
+struct complete_req {
+	char *prefix;
+	int max_results;
+};
+typedef struct complete_req complete_req;
+
+struct completion {
+	place pl;
+	u_int population;
+};
+typedef struct completion completion;
+
+typedef struct {
+	u_int completions_len;
+	completion *completions_val;
+} completions;
+
+struct complete_ret {
+	int err;
+	union {
+		completions results;
+		char *err_msg;
+	} complete_ret_u;
+};
+typedef struct complete_ret complete_ret;
+
+struct fuzzy_req {
+	name_state named;
+	int max_distance;
+	int max_results;
+};
+typedef struct fuzzy_req fuzzy_req;
+
+struct fuzzy_match {
+	place pl;
+	int distance;
+	u_int population;
+};
+typedef struct fuzzy_match fuzzy_match;
+
+typedef struct {
+	u_int fuzzy_matches_len;
+	fuzzy_match *fuzzy_matches_val;
+} fuzzy_matches;
+
+struct fuzzy_ret {
+	int err;
+	union {
+		fuzzy_matches results;
+		char *err_msg;
+	} fuzzy_ret_u;
+};
+typedef struct fuzzy_ret fuzzy_ret;
+
 /* the xdr functions */
 
 #if defined(__STDC__) || defined(__cplusplus)
@@ -90,6 +209,24 @@ extern  bool_t xdr_places_req (XDR *, places_req*);
 extern  bool_t xdr_place_airports (XDR *, place_airports*);
 extern  bool_t xdr_places_ret (XDR *, places_ret*);
 extern  bool_t xdr_airports_ret (XDR *, airports_ret*);
+extern  bool_t xdr_locations (XDR *, locations*);
+extern  bool_t xdr_airports_batch (XDR *, airports_batch*);
+extern  bool_t xdr_airports_batch_ret (XDR *, airports_batch_ret*);
+extern  bool_t xdr_places_reqs (XDR *, places_reqs*);
+extern  bool_t xdr_places_rets (XDR *, places_rets*);
+extern  bool_t xdr_places_batch_ret (XDR *, places_batch_ret*);
+extern  bool_t xdr_airport_list (XDR *, airport_list*);
+extern  bool_t xdr_knn_req (XDR *, knn_req*);
+extern  bool_t xdr_radius_req (XDR *, radius_req*);
+extern  bool_t xdr_airport_list_ret (XDR *, airport_list_ret*);
+extern  bool_t xdr_complete_req (XDR *, complete_req*);
+extern  bool_t xdr_completion (XDR *, completion*);
+extern  bool_t xdr_completions (XDR *, completions*);
+extern  bool_t xdr_complete_ret (XDR *, complete_ret*);
+extern  bool_t xdr_fuzzy_req (XDR *, fuzzy_req*);
+extern  bool_t xdr_fuzzy_match (XDR *, fuzzy_match*);
+extern  bool_t xdr_fuzzy_matches (XDR *, fuzzy_matches*);
+extern  bool_t xdr_fuzzy_ret (XDR *, fuzzy_ret*);
 
 #else /* K&R C */
 extern bool_t xdr_location ();
@@ -101,6 +238,24 @@ extern bool_t xdr_places_req ();
 extern bool_t xdr_place_airports ();
 extern bool_t xdr_places_ret ();
 extern bool_t xdr_airports_ret ();
+extern bool_t xdr_locations ();
+extern bool_t xdr_airports_batch ();
+extern bool_t xdr_airports_batch_ret ();
+extern bool_t xdr_places_reqs ();
+extern bool_t xdr_places_rets ();
+extern bool_t xdr_places_batch_ret ();
+extern bool_t xdr_airport_list ();
+extern bool_t xdr_knn_req ();
+extern bool_t xdr_radius_req ();
+extern bool_t xdr_airport_list_ret ();
+extern bool_t xdr_complete_req ();
+extern bool_t xdr_completion ();
+extern bool_t xdr_completions ();
+extern bool_t xdr_complete_ret ();
+extern bool_t xdr_fuzzy_req ();
+extern bool_t xdr_fuzzy_match ();
+extern bool_t xdr_fuzzy_matches ();
+extern bool_t xdr_fuzzy_ret ();
 
 #endif /* K&R C */
 
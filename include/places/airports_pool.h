@@ -0,0 +1,115 @@
+/*******************************************************************************
+ *   \file airports_pool.h
+ * \author Connor Wilding
+ *   \desc Pool of long-lived RPC client handles to the airports server.
+ ******************************************************************************/
+#pragma once
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <rpc/rpc.h>
+
+/**
+ * \class AirportsClientPool
+ * \brief Keeps idle airports server client handles around between places
+ *        queries so the portmapper lookup and socket setup are paid once.
+ *
+ * Handles idle for longer than the health check interval are pinged with the
+ * NULLPROC before being handed out again, handles that failed a call are
+ * destroyed and transparently replaced on the next acquire.
+ */
+class AirportsClientPool {
+  public:
+    /** Transport used to reach the airports server */
+    enum class Transport { UDP, TCP };
+
+    /**
+     * \class Lease
+     * \brief Scoped ownership of a pooled handle. The handle goes back to the
+     *        pool on destruction unless marked failed.
+     */
+    class Lease {
+      public:
+        Lease(Lease &&other) noexcept;
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease();
+
+        /**
+         * \brief Client handle, null when the server could not be reached.
+         */
+        CLIENT *get() const { return clnt; }
+
+        /**
+         * \brief Flags the handle as broken so it is destroyed, not reused.
+         */
+        void markFailed() { failed = true; }
+
+      private:
+        friend class AirportsClientPool;
+        Lease(AirportsClientPool *owner, Transport t, CLIENT *c);
+
+        AirportsClientPool *pool;
+        Transport           transport;
+        CLIENT             *clnt;
+        bool                failed;
+    };
+
+    /**
+     * \brief Creates an empty pool, handles are created lazily.
+     * \param host Host running the airports server
+     * \param maxIdle Max idle handles kept per transport
+     * \param healthCheckSecs Idle time after which a handle is pinged first
+     */
+    explicit AirportsClientPool(std::string host, size_t maxIdle = 16,
+                                time_t healthCheckSecs = 30);
+
+    AirportsClientPool(const AirportsClientPool &) = delete;
+    AirportsClientPool &operator=(const AirportsClientPool &) = delete;
+
+    /**
+     * \brief Destroys all idle handles. Outstanding leases must be gone.
+     */
+    ~AirportsClientPool();
+
+    /**
+     * \brief Hands out an idle healthy handle or creates a new one.
+     * \param t Transport of the handle
+     * \return Lease of the handle, check get() for null on connect failure
+     */
+    Lease acquire(Transport t);
+
+    /**
+     * \brief Creates a new handle, skipping the idle ones, e.g. to retry a
+     *        call that failed on a handle the idle ones may share the fate
+     *        of (server restarted on another port).
+     * \param t Transport of the handle
+     * \return Lease of the handle, check get() for null on connect failure
+     */
+    Lease acquireNew(Transport t);
+
+    /**
+     * \brief Host the pool connects to.
+     */
+    const std::string &host() const { return airportsHost; }
+
+  private:
+    struct IdleClient {
+      CLIENT *clnt;       // Handle ready for reuse
+      time_t  idleSince;  // When the handle was returned to the pool
+    };
+
+    void release(Transport t, CLIENT *clnt, bool failed);
+    CLIENT *create(Transport t);
+    static bool ping(CLIENT *clnt);
+
+    std::vector<IdleClient> &idleList(Transport t);
+
+    const std::string       airportsHost;
+    const size_t            maxIdlePerTransport;
+    const time_t            healthCheckInterval;
+    std::mutex              mtx;        // Guards the idle lists
+    std::vector<IdleClient> idleUdp;
+    std::vector<IdleClient> idleTcp;
+};
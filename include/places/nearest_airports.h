@@ -0,0 +1,107 @@
+/*******************************************************************************
+ *   File: nearest_airports.h
+ * Author: Ben Targan
+ *   Desc: Closest airports of every place, precomputed so named lookups need
+ *         no airports server call.
+ ******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "common.h"
+#include "snapshot.h"
+#include "airports/SpatialIndex.h"
+
+/**
+ * \struct NearestAirport
+ * \brief One of the closest airports of a place.
+ */
+struct NearestAirport {
+  double   dist;      ///< \var Great circle distance in statute miles
+  uint32_t airport;   ///< \var Index of the airport in the table
+  uint32_t reserved;  ///< \var Zero
+};
+
+/**
+ * \class NearestAirports
+ * \brief Table of the NRESULTS closest airports of every place of a trie, in
+ *        the order of its records.
+ *
+ * Built by searching a spatial index of the airports for every place, the
+ * same exact search the airports server runs, split over all cores. Only the
+ * airports some place is closest to are kept. Like the trie the table holds
+ * no pointers, so it is written into the places snapshot with it and served
+ * from the mapping later. The stamp of the airports file it was built from
+ * tells whether a mapped table is still current.
+ *
+ * Thread safety: immutable once constructed.
+ */
+class NearestAirports {
+  public:
+    /** Sections the table adds to a snapshot */
+    static constexpr size_t SNAPSHOT_SECTIONS = 3;
+
+    /**
+     * \brief Searches the closest airports of every place. Throws
+     *        std::invalid_argument when there are fewer than NRESULTS
+     *        airports.
+     * \param places Places in trie order
+     * \param nPlaces Number of places
+     * \param airRecs Airports to search
+     * \param airportsStamp Stamp of the airports file they were loaded from
+     */
+    NearestAirports(const CityRecord *places, size_t nPlaces,
+                    TAirportRecs airRecs, const FileStamp &airportsStamp);
+
+    /**
+     * \brief Serves a table stored in a snapshot, which must outlive it.
+     *        Throws std::invalid_argument when it does not hold a table of
+     *        nPlaces places of this build.
+     * \param snapshot Mapped snapshot
+     * \param firstSection Index of the first section of the table
+     * \param nPlaces Number of places of the trie in the snapshot
+     */
+    NearestAirports(const Snapshot &snapshot, size_t firstSection,
+                    size_t nPlaces);
+
+    /**
+     * \brief Appends the table to a snapshot being written.
+     */
+    void addSections(SnapshotWriter &writer) const;
+
+    /**
+     * \brief Closest airports of a place.
+     * \param placeIdx Index of the record in the trie
+     * \return NRESULTS airports, closest first
+     */
+    const NearestAirport *closest(size_t placeIdx) const {
+      return nearest + placeIdx * NRESULTS;
+    }
+
+    /**
+     * \brief Airport record of a closest airport.
+     */
+    const AirportRecord &airport(const NearestAirport &near) const {
+      return airports[near.airport];
+    }
+
+    /**
+     * \brief Stamp of the airports file the table was built from.
+     */
+    const FileStamp &airportsStamp() const { return *stamp; }
+
+    /**
+     * \brief Bytes held by the airports and closest airports.
+     */
+    size_t memory() const;
+
+  private:
+    std::vector<AirportRecord>  builtAirports;  ///< Airports when built
+    std::vector<NearestAirport> builtNearest;   ///< Closest when built
+    FileStamp                   builtStamp;     ///< Stamp when built
+
+    const AirportRecord  *airports;   ///< Airports closest to some place
+    size_t                nAirports;  ///< Number of airports
+    const NearestAirport *nearest;    ///< NRESULTS per place, in trie order
+    size_t                nPlaces;    ///< Number of places
+    const FileStamp      *stamp;      ///< Stamp of the airports file
+};
@@ -7,6 +7,8 @@
 #define _PLACES_H_RPCGEN
 
 #include <rpc/rpc.h>
+
+#include <pthread.h>
 #include "place_airport_common.h"
 
 #ifdef __cplusplus
@@ -19,14 +21,32 @@ extern "C" {
 
 #if defined(__STDC__) || defined(__cplusplus)
 #define PLACES_QRY 1
-extern  places_ret * places_qry_1(places_req *, CLIENT *);
-extern  places_ret * places_qry_1_svc(places_req *, struct svc_req *);
+extern  enum clnt_stat places_qry_1(places_req *, places_ret *, CLIENT *);
+extern  bool_t places_qry_1_svc(places_req *, places_ret *, struct svc_req *);
+#define PLACES_QRY_BATCH 2
+extern  enum clnt_stat places_qry_batch_1(places_reqs *, places_batch_ret *, CLIENT *);
+extern  bool_t places_qry_batch_1_svc(places_reqs *, places_batch_ret *, struct svc_req *);
+#define PLACES_COMPLETE 3
+extern  enum clnt_stat places_complete_1(complete_req *, complete_ret *, CLIENT *);
+extern  bool_t places_complete_1_svc(complete_req *, complete_ret *, struct svc_req *);
+#define PLACES_FUZZY 4
+extern  enum clnt_stat places_fuzzy_1(fuzzy_req *, fuzzy_ret *, CLIENT *);
+extern  bool_t places_fuzzy_1_svc(fuzzy_req *, fuzzy_ret *, struct svc_req *);
 extern int places_prog_1_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
 #define PLACES_QRY 1
-extern  places_ret * places_qry_1();
-extern  places_ret * places_qry_1_svc();
+extern  enum clnt_stat places_qry_1();
+extern  bool_t places_qry_1_svc();
+#define PLACES_QRY_BATCH 2
+extern  enum clnt_stat places_qry_batch_1();
+extern  bool_t places_qry_batch_1_svc();
+#define PLACES_COMPLETE 3
+extern  enum clnt_stat places_complete_1();
+extern  bool_t places_complete_1_svc();
+#define PLACES_FUZZY 4
+extern  enum clnt_stat places_fuzzy_1();
+extern  bool_t places_fuzzy_1_svc();
 extern int places_prog_1_freeresult ();
 #endif /* K&R C */
 
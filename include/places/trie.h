@@ -4,7 +4,12 @@
  *   \desc Declarations for public API to build and query places trie.
  ******************************************************************************/
 #pragma once
+#include <cstdint>
 #include "common.h"
+#include "snapshot.h"
+#include "places/nearest_airports.h"
+
+class Trie;
 
 // Public interface functions
 /******************************************************************************/
@@ -22,32 +27,116 @@ struct TrieQueryResult {
 };
 
 /**
- * \brief Initializes the trie lookup data structure with given data.
- *        Throws on IO/file format error.
- * \param placesPath  Path to the places file to load.
+ * \struct FuzzyMatch
+ * \brief Place found by a typo tolerant lookup.
  */
-extern "C" void initTrie(const char* placesPath);
+struct FuzzyMatch {
+  std::reference_wrapper<const CityRecord> place;   ///< \var Record matched
+  int distance;   ///< \var Edits between its name and the name looked up
+};
+
+/** Places found by a typo tolerant lookup, closest names first */
+using TFuzzyMatches = std::vector<FuzzyMatch>;
 
 /**
- * \brief Performs an efficient prefix completion lookup using a Trie data
- *        structure. Uses state to filter ambiguous entries. Returns ref to
- *        stored records and flag if lookup was not found or is ambiguous.
+ * \brief Performs an efficient lookup using a Trie data structure. Uses state
+ *        to filter ambiguous entries. Returns ref to stored records and flag
+ *        if lookup was not found or is ambiguous.
  *
- * \param cityState   City name to lookup
- * \param state       State to use when ambiguous
+ * \param t Trie to search
+ * \param city City name to lookup
+ * \param state State to use when ambiguous, empty for none
  * \return A list of references to city records, and a flag if ambiguous
+ *
+ * Safe to call from many threads at once, see Trie.
  */
-TrieQueryResult queryPlace(const name_state &cityState);
+TrieQueryResult queryPlace(const Trie &t, const std::string &city,
+                           const std::string &state);
 
 // Trie class that is used to perform an efficient lookup
 /******************************************************************************/
 
+/** Most distinct state codes, ids are one byte */
+constexpr size_t MAX_STATES = 256;
+
+/**
+ * \struct PlaceRecs
+ * \brief Cities loaded from the places file, their names packed in one arena
+ *        and their state codes interned.
+ */
+struct PlaceRecs {
+  std::vector<CityRecord> records;  ///< \var Records in file order
+  std::vector<char>       names;    ///< \var NUL terminated names of records
+  std::vector<char>       states;   ///< \var State codes, MAX_STATE chars each
+  
+  /**
+   * \brief Id of a state code, added to the table when new. Throws
+   *        std::invalid_argument past MAX_STATES codes.
+   * \param code State code, MAX_STATE - 1 chars
+   */
+  uint8_t internState(const char *code);
+};
+
+/**
+ * \struct TrieMemory
+ * \brief Bytes held by the parts of a trie.
+ */
+struct TrieMemory {
+  size_t records;   ///< \var City records
+  size_t names;     ///< \var Names arena
+  size_t states;    ///< \var State table
+  size_t nodes;     ///< \var Trie nodes
+  size_t ranked;    ///< \var Ranked completions of the nodes
+  size_t nearest;   ///< \var Closest airports table, 0 when not built
+  
+  size_t total() const {
+    return records + names + states + nodes + ranked + nearest;
+  }
+};
+
 /** Type of collection of cities loaded from the places file */
-using TPlaceRecs = std::unique_ptr<std::vector<CityRecord>>;
+using TPlaceRecs = std::unique_ptr<PlaceRecs>;
+
+/**
+ * \brief Loads place records from a places file. Throws on IO / parsing /
+ *        mem errors.
+ * \param fname Path to the places file
+ * \param approxCount Expected number of places, to reserve room up front
+ */
+TPlaceRecs loadPlacesFromFile(const char *fname, size_t approxCount);
+
+/**
+ * \brief Loads a trie from a places file or a places snapshot, logging the
+ *        time taken. Throws on IO/file format error.
+ * \param placesPath Path to the places file or snapshot
+ */
+std::shared_ptr<Trie> loadTrie(const char *placesPath);
 
 /**
  * \class Trie
  * \brief Trie data structure to hold place information
+ *
+ * Records are sorted case-insensitively by name, then state, so every trie
+ * node covers a contiguous range of them. The trie is path compressed (a
+ * radix trie): chains of nodes with a single next node and no records of
+ * their own collapse into one edge labelled with the whole run of chars, so
+ * a node is only needed where names branch or end. Labels are read from the
+ * name of a record below the edge rather than stored again.
+ *
+ * Nodes live in one flat array with the children of a node stored next to
+ * each other in record order, and refer to children, labels and records by
+ * index.
+ *
+ * For completion every node keeps the MAX_COMPLETIONS most populous records
+ * below it, ranked once at construction, so completing a prefix is a walk to
+ * its node and a copy of that list. Records, names and nodes therefore
+ * hold no pointers: a built trie can be written to a snapshot file and served
+ * from a read-only mapping of it later without parsing, sorting or building
+ * (see snapshot.h), processes serving the same snapshot share its pages.
+ *
+ * Thread safety: the trie and the records it owns are immutable once
+ * constructed, queries only read them and keep traversal state on the
+ * caller's stack, so concurrent queries need no locking.
  */
 class Trie {
   public:
@@ -57,6 +146,32 @@ class Trie {
      */
     explicit Trie(TPlaceRecs cityRecords);
     
+    /**
+     * \brief Serves the trie stored in a snapshot. Throws
+     *        std::invalid_argument when it does not hold a trie of this build.
+     * \param snapshot Mapped snapshot written by writeSnapshot()
+     */
+    explicit Trie(std::unique_ptr<Snapshot> snapshot);
+    
+    /**
+     * \brief Checks whether a file is a places snapshot.
+     */
+    static bool isSnapshot(const char *path);
+    
+    /**
+     * \brief Maps a places snapshot. Throws std::invalid_argument when it is
+     *        not a valid places snapshot.
+     */
+    static std::unique_ptr<Snapshot> openSnapshot(const char *path);
+    
+    /**
+     * \brief Writes the records, names and trie to a snapshot file, with the
+     *        closest airports when there are. Throws std::runtime_error on IO
+     *        error.
+     * \param path Path of the snapshot file, replaced atomically
+     */
+    void writeSnapshot(const char *path) const;
+    
     /**
      * \brief Performs a query on the trie, case-insensitive
      * \param cityName City name of the place
@@ -64,30 +179,112 @@ class Trie {
      */
     TrieQueryResult query(const std::string &cityName) const;
     
+    /**
+     * \brief Completes a prefix to the most populous matching records,
+     *        case-insensitive.
+     * \param prefix Start of the city name
+     * \param maxResults Most completions returned, capped at MAX_COMPLETIONS
+     * \return Records, most populous first
+     */
+    TFoundPlaces complete(const std::string &prefix, size_t maxResults) const;
+    
+    /**
+     * \brief Finds the records whose names are within maxDistance edits of a
+     *        name, case-insensitive.
+     * \param cityName Name to lookup, possibly misspelled
+     * \param state State the records must have, empty for any
+     * \param maxDistance Most edits a match is away, capped at
+     *        MAX_EDIT_DISTANCE
+     * \param maxResults Most matches returned, capped at MAX_FUZZY_MATCHES
+     * \return Matches, fewest edits first, then most populous
+     */
+    TFuzzyMatches fuzzy(const std::string &cityName, const std::string &state,
+                        size_t maxDistance, size_t maxResults) const;
+    
+    /**
+     * \brief Precomputes the closest airports of every record, replacing any
+     *        loaded from the snapshot. Throws std::invalid_argument when there
+     *        are too few airports.
+     * \param airRecs Airports to search
+     * \param airportsStamp Stamp of the airports file they were loaded from
+     */
+    void buildNearest(TAirportRecs airRecs, const FileStamp &airportsStamp);
+    
+    /**
+     * \brief Closest airports of the records, nullptr when not built.
+     */
+    const NearestAirports *nearest() const { return nearestTable.get(); }
+    
+    /**
+     * \brief Index of one of the records of the trie.
+     */
+    size_t index(const CityRecord &rec) const {
+      return (size_t)(&rec - places);
+    }
+    
     /**
      * \brief Get the size of the underlying container.
      * \return Number of records including duplicates.
      */
     size_t size() const;
+    
+    /**
+     * \brief Name of one of the records of the trie.
+     * \param rec Record of this trie
+     * \return NUL terminated name
+     */
+    const char *name(const CityRecord &rec) const {
+      return names + rec.nameOff;
+    }
+    
+    /**
+     * \brief State code of one of the records of the trie.
+     * \param rec Record of this trie
+     * \return NUL terminated state code
+     */
+    const char *state(const CityRecord &rec) const {
+      return states + rec.stateId * MAX_STATE;
+    }
+    
+    /**
+     * \brief Bytes held by the records, names, state table and nodes.
+     */
+    TrieMemory memory() const;
   
   private:
     struct TrieNode {
-      const char            c;                             // Char associated with node
-      std::pair<int, int>   idxRange{-1, -1};       // Range of entries that match
-      std::vector<TrieNode> next;                          // Sorted list of next nodes
+      int32_t  first = -1;    // Range of entries that match, -1 when none
+      int32_t  last = -1;
+      uint32_t next = 0;      // Index of the first of the next nodes
+      uint32_t label = 0;     // Offset of the edge label in the names arena
+      uint16_t nNext = 0;     // Number of next nodes, in record order
+      uint8_t  labelLen = 0;  // Number of chars on the edge into the node
+      char     c;             // First char of the label, lower case
       
       explicit TrieNode(char ch);
     };
     
     /**
-     * \brief Helper to traverse the tree for the given query
-     * \param cname City name
+     * \brief Helper to find the node of a prefix. A prefix ending inside the
+     *        label of an edge gets the node the edge leads to, the chars
+     *        skipped have no branches or records.
+     * \param prefix Start of a city name
+     * \return Node whose subtree holds every name starting with prefix,
+     *         nullptr when there is none
+     */
+    const TrieNode *find(const std::string &prefix) const;
+    
+    struct FuzzySearch;
+    
+    /**
+     * \brief Helper to collect the fuzzy matches below a node, extending the
+     *        edit distance table one row per char of every edge.
      * \param node Current node
-     * \param depth Current subtree depth
-     * \return Result of the query search
+     * \param depth Chars on the path to the node, its row in the table
+     * \param search State of the lookup
      */
-    TrieQueryResult query(const std::string &cname, const TrieNode &node,
-                          int depth) const;
+    void fuzzyWalk(const TrieNode &node, size_t depth,
+                   FuzzySearch &search) const;
     
     /**
      * \brief Attempts to traverse the remaining tree to find the first valid
@@ -102,14 +299,27 @@ class Trie {
     TrieQueryResult getAmbiguousHints(const TrieNode &node) const;
     
     /**
-     * \brief Helper to construct a trie subtree from a given sub-range of records.
+     * \brief Next nodes of a node.
+     */
+    const TrieNode *nextBegin(const TrieNode &node) const {
+      return nodes + node.next;
+    }
+    const TrieNode *nextEnd(const TrieNode &node) const {
+      return nodes + node.next + node.nNext;
+    }
+    
+    /**
+     * \brief Helper to construct a trie subtree from a given sub-range of
+     *        records. The next nodes of the root are appended next to each
+     *        other before any of their subtrees, each with the longest label
+     *        its records share.
      *
      * \param begin   First index of the sub-range constructed
      * \param end     Last exclusive index of the sub-range constructed
      * \param depth   Current depth of the subtree
-     * \param node    Current root node of the subtree
+     * \param nodeIdx Index of the current root node of the subtree
      */
-    void construct(int begin, int end, int depth, TrieNode &node) const;
+    void construct(int begin, int end, int depth, size_t nodeIdx);
     
     /**
      * \brief Helper to find the sub-range where all chars at this range are the
@@ -123,12 +333,49 @@ class Trie {
     int endOfSameLetterRange(int fm, int to, size_t depth) const;
     
     /**
-     * \brief Place records owned by the trie. Freed it dtor.
+     * \brief Helper to find how many chars from depth on all names of a
+     *        sub-range share, case-insensitively.
+     *
+     * \param fm      Beginning index of the sub-range
+     * \param to      End index of the sub-range (exclusive)
+     * \param depth   Depth the names are known to agree up to
+     * \return Number of shared chars past depth
      */
-    TPlaceRecs places;
+    int commonLength(int fm, int to, size_t depth) const;
     
     /**
-     * \brief Root node of the Trie
+     * \brief Helper to rank the most populous records below every node, once
+     *        all nodes are constructed.
      */
-    TrieNode root;
+    void rankCompletions();
+    
+    /**
+     * \brief Points the arrays queries read at the built or mapped data.
+     */
+    void bind(const CityRecord *recs, size_t n, const char *recNames,
+              size_t nNames, const char *stateCodes, size_t nStates,
+              const TrieNode *trieNodes, size_t nNodes,
+              const uint32_t *rankStart, const uint32_t *rankRecs,
+              size_t nRanked);
+    
+    std::vector<CityRecord>   builtRecs;    ///< Sorted records when built
+    std::vector<char>         builtNames;   ///< Names arena when built
+    std::vector<char>         builtStates;  ///< State table when built
+    std::vector<TrieNode>     builtNodes;   ///< Nodes when built
+    std::vector<uint32_t>     builtStarts;  ///< Ranked offsets when built
+    std::vector<uint32_t>     builtRanked;  ///< Ranked records when built
+    std::unique_ptr<Snapshot> snapshot;     ///< Mapping when loaded
+    std::unique_ptr<NearestAirports> nearestTable;  ///< Closest airports
+    
+    const CityRecord *places;     ///< Records sorted by name, then state
+    size_t            count;      ///< Number of records
+    const char       *names;      ///< NUL terminated names of the records
+    size_t            namesSize;  ///< Size of the names arena
+    const char       *states;     ///< State codes, MAX_STATE chars each
+    size_t            statesSize; ///< Size of the state table
+    const TrieNode   *nodes;      ///< Nodes, the root first
+    size_t            nodeCount;  ///< Number of nodes
+    const uint32_t   *rankStart;  ///< Start of the ranked records of each node
+    const uint32_t   *ranked;     ///< Most populous records below each node
+    size_t            nRanked;    ///< Number of ranked records of all nodes
 };
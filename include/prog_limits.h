@@ -10,6 +10,11 @@
 #define MAX_STATE 3
 #define MAX_AIRCODE 4
 #define MAX_ERRMSG 384
+#define MAX_BATCH 1024
+#define MAX_KRESULTS 256
+#define MAX_COMPLETIONS 10
+#define MAX_EDIT_DISTANCE 2
+#define MAX_FUZZY_MATCHES 10
 
 #define REQ_NAMED 0
 #define REQ_LAT_LONG 1
@@ -0,0 +1,240 @@
+/*******************************************************************************
+ *   File: rpc_async.h
+ * Author: Ben Targan
+ *   Desc: Single threaded event loop serving and making ONC RPC calls over UDP
+ *         without blocking, replies are matched to their calls by XID.
+ ******************************************************************************/
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+#include <rpc/rpc.h>
+
+/**
+ * \class EventSource
+ * \brief Socket watched by runEventLoop(), with optional timeouts.
+ */
+class EventSource {
+  public:
+    virtual ~EventSource() = default;
+
+    /**
+     * \brief Socket to poll for reading, negative when there is none yet.
+     */
+    virtual int fd() const = 0;
+
+    /**
+     * \brief Handles everything readable on the socket without blocking.
+     */
+    virtual void onReadable() = 0;
+
+    /**
+     * \brief Milliseconds until expire() has work to do, -1 for never.
+     */
+    virtual int timeoutMs() const { return -1; }
+
+    /**
+     * \brief Handles whatever timed out, called on every loop iteration.
+     */
+    virtual void expire() { }
+};
+
+/**
+ * \brief Polls the sources and calls their handlers until the process exits.
+ *        Handlers run on the calling thread and must never block, since
+ *        every other source waits for them.
+ * \param sources Sources to watch, they must outlive the loop
+ */
+void runEventLoop(const std::vector<EventSource *> &sources);
+
+/**
+ * \class AsyncUdpServer
+ * \brief UDP transport of one RPC program whose replies can be sent after the
+ *        dispatch routine returned, e.g. once a downstream call completed.
+ *
+ * Unlike svcudp, which keeps the caller of the last request in the transport
+ * and must reply before reading the next one, every call carries its own XID
+ * and caller address, so any number of calls may be waiting for their reply.
+ *
+ * Thread safety: none, use from the event loop thread only.
+ */
+class AsyncUdpServer : public EventSource {
+  public:
+    /**
+     * \struct Call
+     * \brief Call waiting for its reply.
+     */
+    struct Call {
+      uint32_t    xid;      ///< \var Transaction id chosen by the caller
+      rpcproc_t   proc;     ///< \var Procedure called
+      sockaddr_in caller;   ///< \var Where the reply goes
+    };
+
+    /**
+     * \brief Dispatch routine. Decodes the arguments from args before it
+     *        returns, and replies now or later with reply() or replyError().
+     */
+    using TDispatch = std::function<void(const Call &call, XDR *args)>;
+
+    /**
+     * \brief Opens a UDP socket on any port. Throws std::runtime_error when it
+     *        cannot.
+     * \param prog RPC program number served
+     * \param vers RPC program version served
+     * \param dispatch Routine called with every call but the NULLPROC
+     */
+    AsyncUdpServer(rpcprog_t prog, rpcvers_t vers, TDispatch dispatch);
+    ~AsyncUdpServer() override;
+
+    AsyncUdpServer(const AsyncUdpServer &) = delete;
+    AsyncUdpServer &operator=(const AsyncUdpServer &) = delete;
+
+    /**
+     * \brief Registers the port of the socket with the portmapper.
+     * \return False when the portmapper refused
+     */
+    bool registerPortmapper() const;
+
+    /**
+     * \brief Sends the successful reply of a call, or SYSTEM_ERR when the
+     *        result does not fit a datagram.
+     * \param call Call being answered
+     * \param xres XDR routine of the result
+     * \param res Result, still owned by the caller
+     */
+    void reply(const Call &call, xdrproc_t xres, const void *res);
+
+    /**
+     * \brief Sends an error reply, e.g. GARBAGE_ARGS or SYSTEM_ERR.
+     */
+    void replyError(const Call &call, accept_stat stat);
+
+    int fd() const override { return sock; }
+    void onReadable() override;
+
+  private:
+    bool send(const Call &call, rpc_msg &msg);
+
+    const rpcprog_t   prog;       ///< Program served
+    const rpcvers_t   vers;       ///< Version served
+    TDispatch         dispatch;   ///< Routine handling the calls
+    int               sock;       ///< Bound UDP socket
+    std::vector<char> recvBuf;    ///< Call being dispatched
+    std::vector<char> sendBuf;    ///< Reply being sent
+};
+
+/**
+ * \class AsyncRpcClient
+ * \brief Client of one RPC program keeping many UDP calls in flight on one
+ *        socket. Calls are sent at once and completed by the event loop when
+ *        the reply with their XID arrives, retransmitted on silence and
+ *        failed with RPC_TIMEDOUT once the timeout is reached.
+ *
+ * The server port is looked up with the portmapper before the first call and
+ * again after the server stopped answering. Lookups block the event loop, at
+ * most once per retransmit interval.
+ *
+ * Thread safety: none, use from the event loop thread only.
+ */
+class AsyncRpcClient : public EventSource {
+  public:
+    /**
+     * \brief Completion of a call. The result is decoded into zeroed memory
+     *        of the size given to call() and null unless stat is
+     *        RPC_SUCCESS. It is freed with its XDR routine once the
+     *        completion returns, which may first take over its pointers and
+     *        zero them.
+     */
+    using TDone = std::function<void(clnt_stat stat, void *res)>;
+
+    /**
+     * \brief Creates a client, the server is looked up on the first call.
+     * \param host Host running the server
+     * \param prog RPC program number called
+     * \param vers RPC program version called
+     * \param retransmit Silence after which a call is sent again
+     * \param timeout Time after which a call fails
+     */
+    AsyncRpcClient(std::string host, rpcprog_t prog, rpcvers_t vers,
+                   std::chrono::milliseconds retransmit =
+                     std::chrono::milliseconds(1000),
+                   std::chrono::milliseconds timeout =
+                     std::chrono::milliseconds(5000));
+    ~AsyncRpcClient() override;
+
+    AsyncRpcClient(const AsyncRpcClient &) = delete;
+    AsyncRpcClient &operator=(const AsyncRpcClient &) = delete;
+
+    /**
+     * \brief Calls the server on a fixed port instead of the one registered
+     *        with the portmapper.
+     * \param serverPort Port of the server, 0 to ask the portmapper again
+     */
+    void setPort(in_port_t serverPort);
+
+    /**
+     * \brief Sends a call. The completion runs later on the event loop, or
+     *        right away with RPC_SYSTEMERROR when the server cannot be found
+     *        or RPC_CANTENCODEARGS when the arguments do not fit a datagram.
+     * \param proc Procedure to call
+     * \param xargs XDR routine of the arguments
+     * \param args Arguments, only read during the call
+     * \param xres XDR routine of the result
+     * \param resSize Size of the result
+     * \param done Completion
+     */
+    void call(rpcproc_t proc, xdrproc_t xargs, const void *args,
+              xdrproc_t xres, size_t resSize, TDone done);
+
+    /**
+     * \brief Number of calls waiting for their reply.
+     */
+    size_t inFlight() const { return pending.size(); }
+
+    int fd() const override { return sock; }
+    void onReadable() override;
+    int timeoutMs() const override;
+    void expire() override;
+
+  private:
+    using TClock = std::chrono::steady_clock;
+
+    struct Pending {
+      std::vector<char> request;      // Encoded call, kept for retransmits
+      xdrproc_t         xres;         // XDR routine of the result
+      size_t            resSize;      // Size of the result
+      TDone             done;         // Completion
+      TClock::time_point sent;        // First sent
+      TClock::time_point retransmitAt;// Next retransmit or timeout check
+    };
+
+    bool connectServer();
+    void disconnect();
+    void complete(Pending &call, const char *reply, size_t len);
+    void failAll(clnt_stat stat);
+
+    const std::string               host;       ///< Host of the server
+    const rpcprog_t                 prog;       ///< Program called
+    const rpcvers_t                 vers;       ///< Version called
+    const std::chrono::milliseconds retransmit; ///< Retransmit interval
+    const std::chrono::milliseconds timeout;    ///< Call timeout
+    int                             sock;       ///< Connected UDP socket
+    in_port_t                       port;       ///< Fixed port, 0 for none
+    uint32_t                        nextXid;    ///< XID of the next call
+    TClock::time_point              lastLookup; ///< Last portmapper lookup
+    TClock::time_point              lastReply;  ///< Last reply received
+    std::unordered_map<uint32_t, Pending> pending; ///< Calls by XID
+
+    /** Retransmit times of the pending calls, soonest first, entries of
+     *  calls since completed or rescheduled are skipped */
+    std::priority_queue<std::pair<TClock::time_point, uint32_t>,
+                        std::vector<std::pair<TClock::time_point, uint32_t>>,
+                        std::greater<std::pair<TClock::time_point, uint32_t>>>
+      timers;
+};
@@ -0,0 +1,145 @@
+/*******************************************************************************
+ *   File: single_flight.h
+ * Author: Ben Targan
+ *   Desc: Coalescing of concurrent identical lookups into one computation
+ *         whose result they all share.
+ ******************************************************************************/
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "stats.h"
+
+/**
+ * \struct FlightCounters
+ * \brief Counters a single flight group reports to, requests / computed is
+ *        the collapse ratio. They are process lifetime statics of the module
+ *        owning the group, see StatCounter.
+ */
+struct FlightCounters {
+  StatCounter *requests;    ///< \var Lookups of any key
+  StatCounter *computed;    ///< \var Lookups that ran the computation
+};
+
+/**
+ * \class SingleFlight
+ * \brief Lets threads looking up the same key at the same time share one
+ *        computation. The first thread computes the value, threads asking
+ *        for the key while it runs wait and get a copy of it. Values are not
+ *        kept, the next lookup after it finished computes the key again.
+ *
+ * Thread safety: run() may be called from any number of threads.
+ * \tparam TKey Key type, hashed with THash
+ * \tparam TValue Value type, copied to every waiting thread
+ */
+template<typename TKey, typename TValue, typename THash = std::hash<TKey>>
+class SingleFlight {
+  public:
+    explicit SingleFlight(const FlightCounters &counters) :
+      counters(counters) { }
+
+    SingleFlight(const SingleFlight &) = delete;
+    SingleFlight &operator=(const SingleFlight &) = delete;
+
+    /**
+     * \brief Computes the value of a key, or waits for the computation of
+     *        another thread already running for it.
+     * \param key Key to look up
+     * \param compute Computes the value, must not throw
+     * \return Value computed here or by the other thread
+     */
+    template<typename TCompute>
+    TValue run(const TKey &key, TCompute compute) {
+      counters.requests->inc();
+      std::shared_ptr<Flight> flight;
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        const auto it = flights.find(key);
+        if (it != flights.end()) {
+          flight = it->second;
+          flight->finished.wait(lock, [&]() { return flight->done; });
+          return flight->value;
+        }
+        flight = std::make_shared<Flight>();
+        flights.emplace(key, flight);
+      }
+
+      counters.computed->inc();
+      TValue value = compute();
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        flight->value = value;
+        flight->done = true;
+        flights.erase(key);
+      }
+      flight->finished.notify_all();
+      return value;
+    }
+
+  private:
+    struct Flight {
+      std::condition_variable finished;   // Signalled once done is set
+      bool                    done = false;
+      TValue                  value;      // Valid once done
+    };
+
+    std::mutex      mtx;        ///< Guards the flights and their state
+    std::unordered_map<TKey, std::shared_ptr<Flight>, THash> flights;
+    FlightCounters  counters;   ///< Where lookups are counted
+};
+
+/**
+ * \class AsyncSingleFlight
+ * \brief SingleFlight for an event loop: instead of blocking, lookups leave
+ *        a callback that gets the value once the computation of the first
+ *        lookup finished.
+ *
+ * Thread safety: none, use from the event loop thread only.
+ */
+template<typename TKey, typename TValue, typename THash = std::hash<TKey>>
+class AsyncSingleFlight {
+  public:
+    /** Receives the value of a key */
+    using TWaiter = std::function<void(const TValue &value)>;
+
+    explicit AsyncSingleFlight(const FlightCounters &counters) :
+      counters(counters) { }
+
+    AsyncSingleFlight(const AsyncSingleFlight &) = delete;
+    AsyncSingleFlight &operator=(const AsyncSingleFlight &) = delete;
+
+    /**
+     * \brief Waits for the value of a key.
+     * \param key Key to look up
+     * \param waiter Callback run by finish()
+     * \return True when no computation of the key was in flight, the caller
+     *         must then start one and finish() it
+     */
+    bool join(const TKey &key, TWaiter waiter) {
+      counters.requests->inc();
+      const auto ins = flights.emplace(key, std::vector<TWaiter>());
+      ins.first->second.push_back(std::move(waiter));
+      if (ins.second) counters.computed->inc();
+      return ins.second;
+    }
+
+    /**
+     * \brief Hands the value of a key to everyone waiting for it. Lookups of
+     *        the key made by the waiters start a new computation.
+     */
+    void finish(const TKey &key, const TValue &value) {
+      const auto it = flights.find(key);
+      if (it == flights.end()) return;
+      const std::vector<TWaiter> waiters = std::move(it->second);
+      flights.erase(it);
+      for (const auto &waiter : waiters) waiter(value);
+    }
+
+  private:
+    std::unordered_map<TKey, std::vector<TWaiter>, THash> flights;
+    FlightCounters counters;    ///< Where lookups are counted
+};
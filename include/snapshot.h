@@ -0,0 +1,200 @@
+/*******************************************************************************
+ *   File: snapshot.h
+ * Author: Ben Targan
+ *   Desc: Versioned, checksummed binary snapshot files of prebuilt data
+ *         structures, mapped read-only into memory.
+ ******************************************************************************/
+#pragma once
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/** Format version written to and required from snapshot files */
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+/** Most sections a snapshot holds */
+constexpr size_t SNAPSHOT_MAX_SECTIONS = 16;
+
+/**
+ * \struct SnapshotSection
+ * \brief Location of one array in a snapshot file.
+ */
+struct SnapshotSection {
+  uint64_t offset;    ///< \var Byte offset from the start of the file
+  uint64_t size;      ///< \var Size in bytes
+  uint64_t elemSize;  ///< \var Size of one element as written
+};
+
+/**
+ * \struct SnapshotHeader
+ * \brief Start of every snapshot file. Sections follow 8 byte aligned, the
+ *        checksum covers every byte after the header.
+ */
+struct SnapshotHeader {
+  char            magic[8];     ///< \var Kind of snapshot, NUL padded
+  uint32_t        version;      ///< \var SNAPSHOT_VERSION
+  uint32_t        byteOrder;    ///< \var 0x01020304 in the writer's order
+  uint64_t        count;        ///< \var Number of records
+  uint64_t        checksum;     ///< \var snapshotChecksum() of the payload
+  uint32_t        nSections;    ///< \var Sections in use
+  uint32_t        reserved;     ///< \var Zero
+  SnapshotSection sections[SNAPSHOT_MAX_SECTIONS];
+};
+
+/**
+ * \struct FileStamp
+ * \brief Size and modification time of a source file, telling whether it
+ *        changed since a structure was built from it.
+ */
+struct FileStamp {
+  uint64_t size = 0;      ///< \var Size in bytes, 0 when missing
+  int64_t  mtimeNs = 0;   ///< \var Last modification in ns since the epoch
+  
+  bool operator==(const FileStamp &other) const {
+    return size == other.size && mtimeNs == other.mtimeNs;
+  }
+  bool operator!=(const FileStamp &other) const { return !(*this == other); }
+};
+
+/**
+ * \brief Stamps a file as it is now, the zero stamp when it cannot be read.
+ * \param path Path of the file
+ */
+FileStamp fileStamp(const char *path);
+
+/**
+ * \brief Checksum of a snapshot payload, 64 bit FNV-1a over 8 byte words.
+ * \param data Start of the payload, 8 byte aligned
+ * \param size Size of the payload, a multiple of 8
+ */
+uint64_t snapshotChecksum(const void *data, size_t size);
+
+/**
+ * \class MappedFile
+ * \brief Read-only shared memory mapping of a whole file. Processes mapping
+ *        the same file share its pages in the page cache.
+ */
+class MappedFile {
+  public:
+    /**
+     * \brief Maps the file. Throws std::runtime_error when it cannot.
+     * \param path Path of the file to map
+     */
+    explicit MappedFile(const char *path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return addr; }
+    size_t size() const { return len; }
+
+  private:
+    const char *addr;   ///< Start of the mapping
+    size_t      len;    ///< Length of the mapping
+};
+
+/**
+ * \class SnapshotWriter
+ * \brief Collects the sections of a snapshot and writes the file.
+ */
+class SnapshotWriter {
+  public:
+    /**
+     * \param magic Kind of snapshot, at most 7 characters
+     */
+    explicit SnapshotWriter(const char *magic);
+
+    /**
+     * \brief Appends an array as the next section. Elements are copied
+     *        bytewise so they must not hold pointers.
+     * \param data Start of the array
+     * \param n Number of elements
+     */
+    template<typename T>
+    void addSection(const T *data, size_t n) {
+      static_assert(std::is_trivially_copyable<T>::value,
+                    "snapshot sections are copied bytewise");
+      addBytes(data, n * sizeof(T), sizeof(T));
+    }
+
+    /**
+     * \brief Writes the snapshot, replacing path atomically. Throws
+     *        std::runtime_error on IO error.
+     * \param path Path of the file to write
+     * \param count Number of records, stored in the header
+     */
+    void write(const char *path, uint64_t count) const;
+
+  private:
+    void addBytes(const void *data, size_t size, size_t elemSize);
+
+    SnapshotHeader    header;     ///< Header being filled in
+    std::vector<char> payload;    ///< Sections, 8 byte aligned
+};
+
+/**
+ * \class Snapshot
+ * \brief Snapshot file mapped read-only. The header and checksum are
+ *        validated once, sections are then served straight from the mapping
+ *        without copying.
+ */
+class Snapshot {
+  public:
+    /**
+     * \brief Maps and validates a snapshot. Throws std::invalid_argument when
+     *        the file is not a snapshot of this kind and version, was written
+     *        on an incompatible platform or is corrupt.
+     * \param path Path of the snapshot file
+     * \param magic Expected kind of snapshot
+     */
+    Snapshot(const char *path, const char *magic);
+
+    /**
+     * \brief Checks whether a file starts with the given snapshot magic.
+     */
+    static bool isSnapshot(const char *path, const char *magic);
+
+    /**
+     * \brief Number of records stored in the header.
+     */
+    uint64_t count() const { return header().count; }
+    
+    /**
+     * \brief Number of sections written.
+     */
+    size_t sections() const { return header().nSections; }
+
+    /**
+     * \brief Gets a section as an array. Throws std::invalid_argument when it
+     *        does not hold n elements of type T.
+     * \param idx Index of the section, in the order they were added
+     * \param n Expected number of elements
+     */
+    template<typename T>
+    const T *section(size_t idx, size_t n) const {
+      return static_cast<const T *>(sectionBytes(idx, n, sizeof(T)));
+    }
+
+    /**
+     * \brief Number of elements in a section, for arrays whose length is not
+     *        the record count. Throws std::invalid_argument when it does not
+     *        hold elements of type T.
+     * \param idx Index of the section, in the order they were added
+     */
+    template<typename T>
+    size_t sectionLength(size_t idx) const {
+      return sectionElems(idx, sizeof(T));
+    }
+
+  private:
+    const SnapshotHeader &header() const {
+      return *reinterpret_cast<const SnapshotHeader *>(file.data());
+    }
+
+    const void *sectionBytes(size_t idx, size_t n, size_t elemSize) const;
+    size_t sectionElems(size_t idx, size_t elemSize) const;
+
+    MappedFile file;    ///< Mapping of the whole file
+};
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *   File: stats.h
+ * Author: Connor Wilding
+ *   Desc: Process wide runtime counters, dumped to stderr on request.
+ ******************************************************************************/
+#pragma once
+#include <atomic>
+#include <csignal>
+
+/**
+ * \class StatCounter
+ * \brief Named monotonic counter registered with the process stats table.
+ *
+ * Counters are meant to be declared as statics in the module that owns them,
+ * they register themselves on construction and are never unregistered.
+ */
+class StatCounter {
+  public:
+    /**
+     * \brief Creates and registers a counter.
+     * \param name Dotted name printed in the dump, must outlive the counter.
+     */
+    explicit StatCounter(const char *name);
+
+    StatCounter(const StatCounter &) = delete;
+    StatCounter &operator=(const StatCounter &) = delete;
+
+    /**
+     * \brief Adds to the counter.
+     * \param n Amount to add
+     */
+    void inc(unsigned long n = 1) {
+      val.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Current value of the counter.
+     */
+    unsigned long value() const {
+      return val.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Name of the counter.
+     */
+    const char *name() const { return cname; }
+
+  private:
+    const char                *cname;   ///< Name shown in the dump
+    std::atomic<unsigned long> val;     ///< Current value
+};
+
+/**
+ * \class StatRatio
+ * \brief Named ratio of two counters registered with the process stats
+ *        table, e.g. requests per downstream call. Declared as a static next
+ *        to the counters it divides and never unregistered.
+ */
+class StatRatio {
+  public:
+    /**
+     * \brief Creates and registers a ratio.
+     * \param name Dotted name printed in the dump, must outlive the ratio.
+     * \param numerator Counter divided
+     * \param denominator Counter divided by
+     */
+    StatRatio(const char *name, const StatCounter &numerator,
+              const StatCounter &denominator);
+
+    StatRatio(const StatRatio &) = delete;
+    StatRatio &operator=(const StatRatio &) = delete;
+
+    /**
+     * \brief Current ratio in thousandths, 0 while the denominator is 0.
+     */
+    unsigned long thousandths() const {
+      const unsigned long den = denominator.value();
+      return den ? numerator.value() * 1000 / den : 0;
+    }
+
+    /**
+     * \brief Name of the ratio.
+     */
+    const char *name() const { return rname; }
+
+  private:
+    const char        *rname;         ///< Name shown in the dump
+    const StatCounter &numerator;     ///< Counter divided
+    const StatCounter &denominator;   ///< Counter divided by
+};
+
+/**
+ * \brief Writes every registered counter as a `name value` line to fd, then
+ *        every ratio with three decimals. Only uses write(2), so it may be
+ *        called from a signal handler.
+ * \param fd File descriptor to write to
+ */
+void dumpStats(int fd);
+
+/**
+ * \brief Installs a signal handler that dumps the stats table to stderr.
+ * \param signo Signal that triggers the dump
+ */
+void installStatsDumpHandler(int signo = SIGUSR1);
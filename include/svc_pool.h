@@ -0,0 +1,53 @@
+/*******************************************************************************
+ *   File: svc_pool.h
+ * Author: Ben Targan
+ *   Desc: Multi-threaded replacement for svc_run().
+ ******************************************************************************/
+#pragma once
+#include <rpc/rpc.h>
+
+/** RPC program dispatch routine as registered with svc_register() */
+using TSvcDispatch = void (*)(struct svc_req *, SVCXPRT *);
+
+/**
+ * \brief Creates a UDP transport on a socket bound with SO_REUSEPORT, so that
+ *        more transports can later share its port.
+ * \return Transport, or null on failure
+ */
+SVCXPRT *svcUdpCreateShared();
+
+/**
+ * \brief Adds transports sharing the port of a transport made with
+ *        svcUdpCreateShared(). The kernel spreads datagrams over them, which
+ *        lets the worker pool serve several UDP requests at once. Only the
+ *        original transport is registered with the portmapper.
+ * \param transp Transport created with svcUdpCreateShared()
+ * \param prog RPC program number
+ * \param vers RPC program version
+ * \param dispatch Program dispatch routine
+ * \param count Number of transports to add
+ * \return False when a transport could not be created or registered
+ */
+bool svcAddUdpReplicas(SVCXPRT *transp, rpcprog_t prog, rpcvers_t vers,
+                       TSvcDispatch dispatch, unsigned count);
+
+/**
+ * \brief Serves requests on all registered transports until the process
+ *        exits. One thread polls the transports and accepts TCP connections,
+ *        ready transports are handed to a pool of worker threads. A transport
+ *        is never served by two threads at once, so every dispatch routine
+ *        must keep its results per call (rpcgen -M style) and only touch
+ *        shared state that is safe for concurrent use.
+ *
+ *        With nThreads of 1 this is simply svc_run().
+ * \param nThreads Number of worker threads
+ */
+void svcRunPool(unsigned nThreads);
+
+/**
+ * \brief Parses the worker thread count given on the command line. Zero
+ *        selects the number of hardware threads.
+ * \param arg Command line argument
+ * \return Number of worker threads, exits on invalid input
+ */
+unsigned parseThreadCount(const char *arg);
@@ -0,0 +1,156 @@
+/*******************************************************************************
+ *   File: BruteForce.cpp
+ * Author: Ben Targan
+ *   Desc: Vectorized linear scan over all airports.
+ ******************************************************************************/
+#include <algorithm>
+#include <limits>
+#include "airports/BruteForce.h"
+#include "airports/geo.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AIRPORTS_X86_KERNELS 1
+#endif
+
+// Number of squared chords computed per kernel call, kept on the stack
+static constexpr size_t BLOCK_SIZE = 256;
+
+/**
+ * Type of kernel writing the squared chords from the target to points
+ * [0, n) of the coordinate arrays into out.
+ */
+using TChordKernel = void (*)(const double *xs, const double *ys,
+                              const double *zs, size_t n, const UnitVec &t,
+                              double *out);
+
+static void chord2Scalar(const double *xs, const double *ys, const double *zs,
+                         const size_t n, const UnitVec &t, double *out) {
+  for (size_t i = 0; i < n; ++i)
+    out[i] = chord2({xs[i], ys[i], zs[i]}, t);
+}
+
+#ifdef AIRPORTS_X86_KERNELS
+// Vector kernels use separate multiplies and adds (no FMA) so every chord is
+// bit-identical to chord2() and the engines rank ties the same way.
+
+static void chord2Sse2(const double *xs, const double *ys, const double *zs,
+                       const size_t n, const UnitVec &t, double *out) {
+  const __m128d tx = _mm_set1_pd(t.x);
+  const __m128d ty = _mm_set1_pd(t.y);
+  const __m128d tz = _mm_set1_pd(t.z);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    const __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + i), tx);
+    const __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i), ty);
+    const __m128d dz = _mm_sub_pd(_mm_loadu_pd(zs + i), tz);
+    const __m128d d2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx),
+                                             _mm_mul_pd(dy, dy)),
+                                  _mm_mul_pd(dz, dz));
+    _mm_storeu_pd(out + i, d2);
+  }
+  chord2Scalar(xs + i, ys + i, zs + i, n - i, t, out + i);
+}
+
+__attribute__((target("avx2")))
+static void chord2Avx2(const double *xs, const double *ys, const double *zs,
+                       const size_t n, const UnitVec &t, double *out) {
+  const __m256d tx = _mm256_set1_pd(t.x);
+  const __m256d ty = _mm256_set1_pd(t.y);
+  const __m256d tz = _mm256_set1_pd(t.z);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), tx);
+    const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), ty);
+    const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(zs + i), tz);
+    const __m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx),
+                                                   _mm256_mul_pd(dy, dy)),
+                                     _mm256_mul_pd(dz, dz));
+    _mm256_storeu_pd(out + i, d2);
+  }
+  chord2Scalar(xs + i, ys + i, zs + i, n - i, t, out + i);
+}
+#endif
+
+// Picks the widest kernel the CPU running us supports
+static TChordKernel pickKernel(const char **name) {
+#ifdef AIRPORTS_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    *name = "avx2";
+    return chord2Avx2;
+  }
+  *name = "sse2";
+  return chord2Sse2;
+#else
+  *name = "scalar";
+  return chord2Scalar;
+#endif
+}
+
+static const char *chordKernelName = nullptr;
+static const TChordKernel chordKernel = pickKernel(&chordKernelName);
+
+const char *BruteForceIndex::kernelName() {
+  return chordKernelName;
+}
+
+BruteForceIndex::BruteForceIndex(TAirportRecs airRecs) :
+                                 airports(std::move(airRecs)) {
+  const size_t n = airports->size();
+  xs.reserve(n);
+  ys.reserve(n);
+  zs.reserve(n);
+  for (const auto &airp : *airports) {
+    const UnitVec v = toUnitVec(airp.loc);
+    xs.push_back(v.x);
+    ys.push_back(v.y);
+    zs.push_back(v.z);
+  }
+}
+
+void BruteForceIndex::kClosest(const location target,
+                               TopKCollector &closest) const {
+  const UnitVec t = toUnitVec(target);
+  double block[BLOCK_SIZE];
+  for (size_t base = 0; base < size(); base += BLOCK_SIZE) {
+    const size_t n = std::min(BLOCK_SIZE, size() - base);
+    chordKernel(&xs[base], &ys[base], &zs[base], n, t, block);
+
+    // Nearly every chord loses against the k-th closest once it is known,
+    // so the collector is rarely reached
+    for (size_t i = 0; i < n; ++i) {
+      if (block[i] < closest.worst())
+        closest.offer(block[i], (*airports)[base + i]);
+    }
+  }
+}
+
+std::vector<DistAirport>
+BruteForceIndex::locationsWithinRadius(const location target,
+                                       const double miles) const {
+  std::vector<DistAirport> inRange;
+
+  // Chord bound is padded, the exact distance has the final say
+  const UnitVec t = toUnitVec(target);
+  const double maxChord2 = milesToChord2(miles) * (1.0 + 1e-9) + 1e-15;
+  double block[BLOCK_SIZE];
+  for (size_t base = 0; base < size(); base += BLOCK_SIZE) {
+    const size_t n = std::min(BLOCK_SIZE, size() - base);
+    chordKernel(&xs[base], &ys[base], &zs[base], n, t, block);
+
+    for (size_t i = 0; i < n; ++i) {
+      if (block[i] > maxChord2) continue;
+      const auto &airp = (*airports)[base + i];
+      const auto dist = (double)greatCircleMiles(airp.loc, target);
+      if (dist <= miles)
+        inRange.emplace_back(airp, dist);
+    }
+  }
+  std::sort(inRange.begin(), inRange.end());
+  return inRange;
+}
+
+size_t BruteForceIndex::size() const {
+  return airports->size();
+}
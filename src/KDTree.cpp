@@ -1,59 +1,18 @@
 /*******************************************************************************
  *   File: KDTree.cpp
  * Author: Ben Targan
- *   Desc: Public API to build and lookup KD-Tree.
+ *   Desc: Airports file loader and latitude / longitude KD-Tree.
  ******************************************************************************/
 #include <algorithm>
 #include <sstream>
 #include <fstream>
 #include <cmath>
 #include <cstring>
+#include <limits>
 #include "airports/KDTree.h"
+#include "airports/geo.h"
 #include "common.h"
-
-static std::unique_ptr<KDTree> kdTree;
-static constexpr long double PI() { return std::atan(1) * 4; }
-
-// Helper to load airports from file. Throws IO/parse error.
-TAirportRecs load_Airports(const char* path);
-
-void initKD(const char *airportsPath) {
-  try {
-    kdTree = std::unique_ptr<KDTree>(
-      new KDTree(load_Airports(airportsPath)));
-  } catch (const std::exception& e) {
-    exitWithMessage(e.what());
-  }
-  
-  log_printf("Loaded %d airports.", (int)kdTree->size());
-}
-
-/**
- * Find 5 closest airports in the KDTree.
- * @param target location {latitude, longitude} of the target
- * @return list of airports
- */
-airport* kd5Closest(const location target) {
-  static airports result;
-  constexpr size_t resultArrSize = sizeof(result) / sizeof(result[0]);
-  
-  // Clear out any previous values
-  std::memset(&result, 0, sizeof(airports));
-  
-  // Query KD-Tree and copy values and string pointers to static data
-  auto closest = kdTree->kClosestLocations(target);
-  const size_t nResults = std::min(closest.size(), resultArrSize);
-  for (size_t i = 0; i < nResults; ++i) {
-    result[i].dist = closest[i].dist;
-    const auto &airp = *closest[i].airport;
-    result[i].code = (char*)airp.code.c_str();
-    result[i].name = (char*)airp.name.c_str();
-    result[i].state = (char*)airp.state.c_str();
-    result[i].loc = airp.loc;
-  }
-  
-  return &result[0];
-}
+#include "parallel.h"
 
 /**
  * Constructs an AirportRecord from a data file line.
@@ -120,40 +79,108 @@ TAirportRecs load_Airports(const char* path) {
 using It = std::vector<AirportRecord>::iterator;
 
 /**
- * Constructs a KD subtree from the given range of records.
+ * Orders the given range of records into an implicit KD subtree: the median
+ * of the range is its root, the halves before and after it are its subtrees.
+ * Subtrees above forkDepth are ordered concurrently, they share no records.
  * @param fm Start of records sequence
  * @param to End of records sequence
  * @param depth Current depth of the subtree
- * @return Constructed subtree from the given range
+ * @param forkDepth Depth down to which the left subtree gets its own thread
  */
-static std::unique_ptr<KDNode> construct(It fm, It to, int depth = 0);
+static void construct(It fm, It to, int depth, int forkDepth);
 
 /**
- * Traverses the KD-Tree and collects k-closest points to the target.
- * @param node Current subtree node
- * @param target Target location to collect closest points to
- * @param k K number of closest points to collect
- * @param isEvenNodeLevel Current depth of the subtree rooted at node is even.
- * @param closest OUT of the collected closest points, ordered by dist
+ * State of one k closest search. Candidates are ranked by squared chord on the
+ * unit sphere while searching, the bound of the current k-th closest is kept
+ * as an angle and its sine, which the splitting plane tests compare against.
  */
-void kClosestPimpl(const std::unique_ptr<KDNode> &node,
-                   const location &target,
-                   size_t k, bool isEvenNodeLevel,
-                   std::vector<DistAirport> &closest);
+struct KDTree::KnnQuery {
+  location                  target;       // Target in degrees
+  UnitVec                   targetVec;    // Target on the unit sphere
+  double                    cosLat;       // Cosine of target latitude
+  double                    poleAngle;    // Central angle to the closer pole
+  double                    antiAngle;    // Central angle to the antimeridian
+  TopKCollector            &closest;      // Collected, ranked by squared chord
+  double                    worstAngle;   // Central angle of k-th closest
+  double                    worstSin;     // Its sine, infinite past 90 degrees
+};
 
-KDNode::KDNode(AirportRecord pt,
-               std::unique_ptr<KDNode> lft,
-               std::unique_ptr<KDNode> rgt) :
-               airport(std::move(pt)), left(std::move(lft)), right(std::move(rgt)) { }
+/**
+ * State of one radius search.
+ */
+struct KDTree::RadiusQuery {
+  location                  target;       // Target in degrees
+  UnitVec                   targetVec;    // Target on the unit sphere
+  double                    miles;        // Range in statute miles
+  double                    maxChord2;    // Squared chord just beyond range
+  std::vector<DistAirport> &inRange;      // Collected, dist in miles
+};
+
+/**
+ * Central angle from a point to the closest point of a half meridian.
+ * @param lat Point latitude
+ * @param dLon Longitude difference between the point and the meridian
+ * @return Angle in radians
+ */
+static double halfMeridianAngle(double lat, double dLon) {
+  dLon = std::fabs(std::remainder(dLon, 360.0));
+  // Meridian is on the far side of the globe, closest point is a pole
+  if (dLon >= 90.0) return deg2rad(90.0 - std::fabs(lat));
+  return std::asin(std::cos(deg2rad(lat)) * std::sin(deg2rad(dLon)));
+}
 
 KDTree::KDTree(TAirportRecs airRecs) : airports(std::move(airRecs)) {
-  root = construct(airports->begin(), airports->end());
+  // Below this many records per thread, spawning costs more than it saves
+  constexpr size_t minRecordsPerThread = 16384;
+  
+  construct(airports->begin(), airports->end(), 0,
+            parallelForkDepth(airports->size(), minRecordsPerThread));
+  
+  // Split the coordinates out so traversal only touches the hot data
+  const size_t n = airports->size();
+  lats.resize(n);
+  lons.resize(n);
+  xs.resize(n);
+  ys.resize(n);
+  zs.resize(n);
+  parallelFor(n, minRecordsPerThread, [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const auto &airp = (*airports)[i];
+      lats[i] = airp.loc.latitude;
+      lons[i] = airp.loc.longitude;
+      const UnitVec v = toUnitVec(airp.loc);
+      xs[i] = v.x;
+      ys[i] = v.y;
+      zs[i] = v.z;
+    }
+  });
+}
+
+void KDTree::kClosest(location target, TopKCollector &closest) const {
+  if (closest.capacity() == 0) return;
+  
+  // Splits are on longitudes in [-180, 180], compare the target in that range
+  target.longitude = std::remainder(target.longitude, 360.0);
+  
+  const double inf = std::numeric_limits<double>::infinity();
+  KnnQuery query{target, toUnitVec(target), std::cos(deg2rad(target.latitude)),
+                 deg2rad(90.0 - std::fabs(target.latitude)),
+                 halfMeridianAngle(target.latitude, target.longitude - 180.0),
+                 closest, inf, inf};
+  kClosestPimpl(0, size(), query, true);
 }
 
 std::vector<DistAirport>
-KDTree::kClosestLocations(const location target, const size_t k) const {
+KDTree::locationsWithinRadius(location target, const double miles) const {
   std::vector<DistAirport> results;
-  kClosestPimpl(root, target, k, true, results);
+  
+  target.longitude = std::remainder(target.longitude, 360.0);
+  
+  // Chord bound is padded, the exact distance has the final say
+  RadiusQuery query{target, toUnitVec(target), miles,
+                    milesToChord2(miles) * (1.0 + 1e-9) + 1e-15, results};
+  withinRadiusPimpl(0, size(), query, true);
+  std::sort(results.begin(), results.end());
   return results;
 }
 
@@ -161,45 +188,30 @@ size_t KDTree::size() const {
   return airports->size();
 }
 
-
-static long double deg2rad(long double deg) {
-  return deg * PI() / 180.0L;
-}
-
-/**
- * Computes circle distance between two points. Note that long double
- * precision is here since this computation suffers from floating point
- * degradation.
- * @param lat1 Point 1 latitude
- * @param lon1 Point 1 longitude
- * @param lat2 Point 2 latitude
- * @param lon2 Point 2 longitude
- * @return Circle distance in statute miles
- */
-static long double distance(long double lat1, long double lon1,
-                            long double lat2, long double lon2) {
-  lat1 = deg2rad(lat1);
-  lon1 = deg2rad(lon1);
-  lat2 = deg2rad(lat2);
-  lon2 = deg2rad(lon2);
-  const long double a = std::sin(lat1) * std::sin(lat2);
-  const long double b = std::cos(lat1) * std::cos(lat2) * std::cos(lon2 - lon1);
-  return 3959.0L * std::acos(a + b);
-}
-
 /**
- * Computes greatest circle distance between two locations
- * @param pt1 Location of point 1
- * @param pt2 Location of point 2
- * @return Circle distance in statue miles
+ * Lower bound of the distance from the target to any point on the other side
+ * of a splitting plane. Latitude planes are exact, longitude planes take the
+ * closest of the split meridian and the antimeridian since raw longitudes wrap
+ * around there.
+ * @param target Target location
+ * @param split Location of the splitting node
+ * @param isLatSplit Plane splits by latitude
+ * @return Lower bound in statute miles
  */
-static long double distance(const location& pt1, const location& pt2) {
-  return distance(pt1.latitude, pt1.longitude, pt2.latitude, pt2.longitude);
+static double planeLowerBound(const location &target,
+                              const location &split,
+                              const bool isLatSplit) {
+  if (isLatSplit)
+    return EARTH_RADIUS_MILES * deg2rad(std::fabs(target.latitude - split.latitude));
+  
+  return EARTH_RADIUS_MILES * std::min(
+    halfMeridianAngle(target.latitude, target.longitude - split.longitude),
+    halfMeridianAngle(target.latitude, target.longitude - 180.0));
 }
 
-static std::unique_ptr<KDNode> construct(It fm, It to, int depth) {
+static void construct(It fm, It to, int depth, int forkDepth) {
   // Base case
-  if (fm >= to) return nullptr;
+  if (fm >= to) return;
   
   // Comparator used on even depth of the tree. Splits plane by latitude.
   static const auto latComparator =
@@ -220,46 +232,94 @@ static std::unique_ptr<KDNode> construct(It fm, It to, int depth) {
   else
     std::nth_element(fm, fm + mid, to, longComparator);
   
-  // Create a subtree with the value of median and children of partitions
-  return std::unique_ptr<KDNode>(
-    new KDNode(*(fm + mid),
-               construct(fm, fm + mid, depth + 1),
-               construct(fm + mid + 1, to, depth + 1)));
+  // Order the partitions around the median into its subtrees
+  parallelInvoke(depth < forkDepth,
+                 [=]() { construct(fm, fm + mid, depth + 1, forkDepth); },
+                 [=]() { construct(fm + mid + 1, to, depth + 1, forkDepth); });
 }
 
-void kClosestPimpl(const std::unique_ptr<KDNode> &node,
-                   const location &target,
-                   const size_t k, const bool isEvenNodeLevel,
-                   std::vector<DistAirport> &closest) {
-  if (!node) return;
+void KDTree::kClosestPimpl(const size_t lo, const size_t hi,
+                           KnnQuery &query,
+                           const bool isEvenNodeLevel) const {
+  if (lo >= hi) return;
   
-  location nloc = node->airport.loc;              // Alias for readability
-  auto dist = (double) distance(nloc, target);    // Greatest circ dist in miles
+  const size_t mid = lo + (hi - lo) / 2;          // Root of the subtree
+  const double dist = chord2({xs[mid], ys[mid], zs[mid]}, query.targetVec);
+  auto &closest = query.closest;
   
   // Collect the current node when it belongs in k closest set
-  // Note: Linear insertion here since objs are small
-  if (closest.size() < k || dist < closest.back().dist) {
-    closest.emplace(
-      std::find_if(closest.begin(), closest.end(),
-                   [dist](const DistAirport &rec) { return dist < rec.dist; }),
-      node->airport, dist);
-    if (closest.size() > k)
-      closest.pop_back();
+  if (dist < closest.worst()) {
+    closest.offer(dist, (*airports)[mid]);
+    if (closest.full()) {
+      query.worstAngle = chord2ToAngle(closest.worst());
+      query.worstSin = query.worstAngle < M_PI / 2.0 ?
+        std::sin(query.worstAngle) : std::numeric_limits<double>::infinity();
+    }
   }
   
+  const location &target = query.target;
   const bool leftSubtreeCloser = isEvenNodeLevel ?
-    target.latitude < nloc.latitude : target.longitude < nloc.longitude;
+    target.latitude < lats[mid] : target.longitude < lons[mid];
+  
+  if (leftSubtreeCloser)
+    kClosestPimpl(lo, mid, query, !isEvenNodeLevel);
+  else
+    kClosestPimpl(mid + 1, hi, query, !isEvenNodeLevel);
   
-  kClosestPimpl(leftSubtreeCloser ? node->left : node->right,
-               target, k, !isEvenNodeLevel, closest);
+  // Lower bound of the angle to any point on the other side of the splitting
+  // plane, the same bound as planeLowerBound(). Along a parallel it is the
+  // latitude difference itself. Across a meridian it is the angle to the
+  // closer of the split meridian and the antimeridian, where raw longitudes
+  // wrap; sin(angle) = cos(lat) sin(dLong) up to 90 degrees of longitude,
+  // beyond that the closest point is a pole.
+  bool planeIntersects;
+  if (isEvenNodeLevel) {
+    planeIntersects =
+      deg2rad(std::fabs(target.latitude - lats[mid])) < query.worstAngle;
+  } else {
+    const double dLon =
+      std::fabs(std::remainder(target.longitude - lons[mid], 360.0));
+    planeIntersects = query.antiAngle < query.worstAngle || (dLon >= 90.0 ?
+      query.poleAngle < query.worstAngle :
+      query.cosLat * std::sin(deg2rad(dLon)) < query.worstSin);
+  }
+  
+  if (!closest.full() || planeIntersects) {
+    if (leftSubtreeCloser)
+      kClosestPimpl(mid + 1, hi, query, !isEvenNodeLevel);
+    else
+      kClosestPimpl(lo, mid, query, !isEvenNodeLevel);
+  }
+}
+
+void KDTree::withinRadiusPimpl(const size_t lo, const size_t hi,
+                               RadiusQuery &query,
+                               const bool isEvenNodeLevel) const {
+  if (lo >= hi) return;
+  
+  const size_t mid = lo + (hi - lo) / 2;          // Root of the subtree
+  const location nloc{lats[mid], lons[mid]};      // Alias for readability
+  const location &target = query.target;
   
-  if (isEvenNodeLevel) nloc.longitude = target.longitude;
-  else                 nloc.latitude = target.latitude;
+  // Cheap chord test first, exact distance only for likely hits
+  if (chord2({xs[mid], ys[mid], zs[mid]}, query.targetVec) <= query.maxChord2) {
+    const auto dist = (double)greatCircleMiles(nloc, target);
+    if (dist <= query.miles)
+      query.inRange.emplace_back((*airports)[mid], dist);
+  }
+  
+  const bool leftSubtreeCloser = isEvenNodeLevel ?
+    target.latitude < nloc.latitude : target.longitude < nloc.longitude;
   
-  const auto planeMinDist = (double)distance(nloc, target);
-  const bool planeIntersects = planeMinDist < closest.back().dist;
+  if (leftSubtreeCloser)
+    withinRadiusPimpl(lo, mid, query, !isEvenNodeLevel);
+  else
+    withinRadiusPimpl(mid + 1, hi, query, !isEvenNodeLevel);
   
-  if (closest.size() < k || planeIntersects)
-    kClosestPimpl(leftSubtreeCloser ? node->right : node->left,
-                  target, k, !isEvenNodeLevel, closest);
+  if (planeLowerBound(target, nloc, isEvenNodeLevel) <= query.miles) {
+    if (leftSubtreeCloser)
+      withinRadiusPimpl(mid + 1, hi, query, !isEvenNodeLevel);
+    else
+      withinRadiusPimpl(lo, mid, query, !isEvenNodeLevel);
+  }
 }
@@ -0,0 +1,60 @@
+/*******************************************************************************
+ *   File: SpatialIndex.cpp
+ * Author: Ben Targan
+ *   Desc: Selection of the airport search engine.
+ ******************************************************************************/
+#include <cstring>
+#include "airports/SpatialIndex.h"
+#include "airports/BruteForce.h"
+#include "airports/KDTree.h"
+#include "airports/SphereKDTree.h"
+
+std::vector<DistAirport>
+SpatialIndex::kClosestLocations(const location target, const size_t k) const {
+  std::vector<TopKEntry> storage(k);
+  TopKCollector closest(storage.data(), k);
+  kClosest(target, closest);
+  closest.finish(target);
+  
+  std::vector<DistAirport> results;
+  results.reserve(closest.size());
+  for (const auto &entry : closest)
+    results.emplace_back(*entry.airport, entry.dist);
+  return results;
+}
+
+bool parseSearchEngine(const char *name, SearchEngine &engine) {
+  if (std::strcmp(name, "latlong") == 0) {
+    engine = SearchEngine::LatLong;
+  } else if (std::strcmp(name, "sphere") == 0) {
+    engine = SearchEngine::Sphere;
+  } else if (std::strcmp(name, "brute") == 0) {
+    engine = SearchEngine::BruteForce;
+  } else if (std::strcmp(name, "auto") == 0) {
+    engine = SearchEngine::Auto;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<SpatialIndex> makeSpatialIndex(SearchEngine engine,
+                                               TAirportRecs airRecs,
+                                               const size_t maxNodes) {
+  if (engine == SearchEngine::Auto) {
+    engine = airRecs->size() <= BRUTE_FORCE_MAX_AIRPORTS ?
+             SearchEngine::BruteForce : SearchEngine::Sphere;
+  }
+  
+  switch (engine) {
+    case SearchEngine::BruteForce:
+      return std::unique_ptr<SpatialIndex>(
+        new BruteForceIndex(std::move(airRecs)));
+    case SearchEngine::Sphere:
+      return std::unique_ptr<SpatialIndex>(
+        new SphereKDTree(std::move(airRecs), maxNodes));
+    case SearchEngine::LatLong:
+    default:
+      return std::unique_ptr<SpatialIndex>(new KDTree(std::move(airRecs)));
+  }
+}
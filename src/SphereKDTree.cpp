@@ -0,0 +1,318 @@
+/*******************************************************************************
+ *   File: SphereKDTree.cpp
+ * Author: Ben Targan
+ *   Desc: KD-tree over airports projected onto the unit sphere.
+ ******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "airports/SphereKDTree.h"
+#include "parallel.h"
+
+/**
+ * Record being ordered into the tree along with its unit vector.
+ */
+struct SphereItem {
+  UnitVec vec;
+  size_t  recIdx;     // Index of the record in file order
+};
+
+// Type of random-access iterator used to construct tree
+using It = std::vector<SphereItem>::iterator;
+
+static double axisOf(const UnitVec &v, int axis) {
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+/**
+ * Orders the given range into an implicit KD subtree: the median of the range
+ * along its axis of widest spread is the root, the halves before and after it
+ * are its subtrees. Subtrees above forkDepth are ordered concurrently.
+ * @param base Start of the whole sequence, node indices are relative to it
+ * @param fm Start of the subtree sequence
+ * @param to End of the subtree sequence
+ * @param depth Current depth of the subtree
+ * @param forkDepth Depth down to which the left subtree gets its own thread
+ * @param axes OUT split axis of each node
+ */
+static void construct(It base, It fm, It to, int depth, int forkDepth,
+                      std::vector<uint8_t> &axes) {
+  // Base case
+  if (fm >= to) return;
+
+  // Pick the axis the points are spread over the most
+  UnitVec lo = fm->vec, hi = fm->vec;
+  for (It it = fm + 1; it < to; ++it) {
+    lo = { std::min(lo.x, it->vec.x), std::min(lo.y, it->vec.y),
+           std::min(lo.z, it->vec.z) };
+    hi = { std::max(hi.x, it->vec.x), std::max(hi.y, it->vec.y),
+           std::max(hi.z, it->vec.z) };
+  }
+  int axis = 0;
+  double widest = hi.x - lo.x;
+  if (hi.y - lo.y > widest) { axis = 1; widest = hi.y - lo.y; }
+  if (hi.z - lo.z > widest) { axis = 2; }
+
+  const auto mid = std::distance(fm, to) / 2;   // Offset to the med node
+
+  // Partition around median node
+  std::nth_element(fm, fm + mid, to,
+                   [axis](const SphereItem &p1, const SphereItem &p2) {
+    return axisOf(p1.vec, axis) < axisOf(p2.vec, axis);
+  });
+  axes[std::distance(base, fm + mid)] = (uint8_t)axis;
+
+  // Order the partitions around the median into its subtrees, they write
+  // disjoint ranges of axes
+  parallelInvoke(depth < forkDepth,
+    [=, &axes]() { construct(base, fm, fm + mid, depth + 1, forkDepth, axes); },
+    [=, &axes]() { construct(base, fm + mid + 1, to, depth + 1, forkDepth,
+                             axes); });
+}
+
+// Deepest an implicit tree over 32 bit indices gets, bounds the walk stacks
+static constexpr size_t MAX_DEPTH = 64;
+
+// Far subtrees waiting in the frontier, more are searched depth first
+static constexpr size_t FRONTIER_SIZE = 64;
+
+/**
+ * Subtree [lo, hi) waiting to be searched with the lower bound of the squared
+ * chord from the target to any of its points.
+ */
+struct SphereKDTree::Frame {
+  double   bound;
+  uint32_t lo;
+  uint32_t hi;
+};
+
+/**
+ * Fixed size min-heap of subtrees on their lower bound. Without room every
+ * subtree is searched depth first.
+ */
+struct SphereKDTree::Frontier {
+  struct Farther {
+    bool operator()(const Frame &f1, const Frame &f2) const {
+      return f1.bound > f2.bound;
+    }
+  };
+
+  explicit Frontier(size_t capacity) : capacity(capacity) { }
+
+  bool empty() const { return n == 0; }
+  bool full() const { return n == capacity; }
+
+  void push(const Frame &frame) {
+    frames[n++] = frame;
+    std::push_heap(frames, frames + n, Farther());
+  }
+
+  Frame pop() {
+    std::pop_heap(frames, frames + n, Farther());
+    return frames[--n];
+  }
+
+  const size_t capacity;
+  Frame        frames[FRONTIER_SIZE];
+  size_t       n = 0;
+};
+
+/**
+ * State of one k closest search, distances are squared chords while
+ * searching.
+ */
+struct SphereKDTree::KnnQuery {
+  double         target[3];   // Target on the unit sphere
+  TopKCollector &closest;     // Collected, ranked by squared chord
+  size_t         nodesLeft;   // Nodes left to visit within the budget
+};
+
+// Kind of snapshot holding a tree
+static const char *SNAPSHOT_MAGIC = "SPHKD";
+
+// Sections of a tree snapshot, in the order they are written
+enum SnapshotSections { SECT_RECORDS, SECT_COORDS, SECT_AXES };
+
+SphereKDTree::SphereKDTree(TAirportRecs airRecs, const size_t maxNodes) :
+                           maxNodes(maxNodes) {
+  const size_t n = airRecs->size();
+
+  // Below this many airports per thread, spawning costs more than it saves
+  constexpr size_t minItemsPerThread = 16384;
+
+  std::vector<SphereItem> items(n);
+  parallelFor(n, minItemsPerThread, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      items[i] = { toUnitVec((*airRecs)[i].loc), i };
+  });
+
+  builtAxes.resize(n);
+  construct(items.begin(), items.begin(), items.end(), 0,
+            parallelForkDepth(n, minItemsPerThread), builtAxes);
+
+  // Lay the records and their coordinates out in tree order
+  builtRecs.reserve(n);
+  builtCoords.resize(3 * n);
+  for (size_t i = 0; i < n; ++i) {
+    builtRecs.push_back((*airRecs)[items[i].recIdx]);
+    builtCoords[i] = items[i].vec.x;
+    builtCoords[n + i] = items[i].vec.y;
+    builtCoords[2 * n + i] = items[i].vec.z;
+  }
+  bind(builtRecs.data(), builtCoords.data(), builtAxes.data(), n);
+}
+
+SphereKDTree::SphereKDTree(std::unique_ptr<Snapshot> snap,
+                           const size_t maxNodes) :
+                           snapshot(std::move(snap)), maxNodes(maxNodes) {
+  const size_t n = snapshot->count();
+  bind(snapshot->section<AirportRecord>(SECT_RECORDS, n),
+       snapshot->section<double>(SECT_COORDS, 3 * n),
+       snapshot->section<uint8_t>(SECT_AXES, n), n);
+}
+
+void SphereKDTree::bind(const AirportRecord *recs, const double *coords,
+                        const uint8_t *splitAxes, const size_t n) {
+  airports = recs;
+  xs = coords;
+  ys = coords + n;
+  zs = coords + 2 * n;
+  axes = splitAxes;
+  count = n;
+}
+
+bool SphereKDTree::isSnapshot(const char *path) {
+  return Snapshot::isSnapshot(path, SNAPSHOT_MAGIC);
+}
+
+std::unique_ptr<Snapshot> SphereKDTree::openSnapshot(const char *path) {
+  return std::unique_ptr<Snapshot>(new Snapshot(path, SNAPSHOT_MAGIC));
+}
+
+void SphereKDTree::writeSnapshot(const char *path) const {
+  SnapshotWriter writer(SNAPSHOT_MAGIC);
+  writer.addSection(airports, count);
+  writer.addSection(xs, 3 * count);
+  writer.addSection(axes, count);
+  writer.write(path, count);
+}
+
+void SphereKDTree::kClosest(const location target,
+                            TopKCollector &closest) const {
+  if (closest.capacity() == 0 || size() == 0) return;
+
+  const UnitVec v = toUnitVec(target);
+  KnnQuery query{{v.x, v.y, v.z}, closest,
+                 maxNodes ? maxNodes : std::numeric_limits<size_t>::max()};
+
+  // An exact search visits every subtree that can beat the k-th closest
+  // whatever the order, so it goes depth first without the heap upkeep.
+  // Under a node budget the subtree with the lowest bound is resumed first
+  // so the budget goes to the most promising ones, and once one cannot beat
+  // the k-th closest none of the rest can.
+  Frontier frontier(maxNodes ? FRONTIER_SIZE : 0);
+  descend({0.0, 0, (uint32_t)size()}, query, frontier);
+  while (!frontier.empty() && query.nodesLeft > 0) {
+    const Frame frame = frontier.pop();
+    if (!(frame.bound < closest.worst())) break;
+    descend(frame, query, frontier);
+  }
+}
+
+std::vector<DistAirport>
+SphereKDTree::locationsWithinRadius(const location target,
+                                    const double miles) const {
+  std::vector<DistAirport> inRange;
+
+  // Chord bound is padded, the exact distance has the final say
+  const UnitVec v = toUnitVec(target);
+  const double t[3] = {v.x, v.y, v.z};
+  const double maxChord2 = milesToChord2(miles) * (1.0 + 1e-9) + 1e-15;
+
+  // Depth first walk, far subtrees within range wait on the stack
+  Frame stack[MAX_DEPTH];
+  size_t nStack = 0;
+  stack[nStack++] = {0.0, 0, (uint32_t)size()};
+  while (nStack > 0) {
+    Frame frame = stack[--nStack];
+    while (frame.lo < frame.hi) {
+      const size_t mid = frame.lo + (frame.hi - frame.lo) / 2;
+      const double dx = xs[mid] - t[0];
+      const double dy = ys[mid] - t[1];
+      const double dz = zs[mid] - t[2];
+
+      // Cheap chord test first, exact distance only for likely hits
+      if (dx * dx + dy * dy + dz * dz <= maxChord2) {
+        const auto &airp = airports[mid];
+        const auto dist = (double)greatCircleMiles(airp.loc, target);
+        if (dist <= miles)
+          inRange.emplace_back(airp, dist);
+      }
+
+      const int axis = axes[mid];
+      const double planeDist = t[axis] - coord(mid, axis);
+      const Frame left{0.0, frame.lo, (uint32_t)mid};
+      const Frame right{0.0, (uint32_t)mid + 1, frame.hi};
+
+      if (planeDist * planeDist <= maxChord2)
+        stack[nStack++] = planeDist < 0 ? right : left;
+      frame = planeDist < 0 ? left : right;
+    }
+  }
+
+  std::sort(inRange.begin(), inRange.end());
+  return inRange;
+}
+
+size_t SphereKDTree::size() const {
+  return count;
+}
+
+void SphereKDTree::descend(Frame frame, KnnQuery &query,
+                           Frontier &frontier) const {
+  const double *t = query.target;
+  auto &closest = query.closest;
+
+  // Far subtrees the frontier has no room for, searched depth first. Never
+  // holds more than one subtree per level of the tree.
+  Frame overflow[MAX_DEPTH];
+  size_t nOverflow = 0;
+
+  for (;;) {
+    while (frame.lo < frame.hi) {
+      if (query.nodesLeft == 0) return;
+      --query.nodesLeft;
+
+      const size_t mid = frame.lo + (frame.hi - frame.lo) / 2;
+      const double dx = xs[mid] - t[0];
+      const double dy = ys[mid] - t[1];
+      const double dz = zs[mid] - t[2];
+
+      // Collect the current node when it belongs in k closest set
+      closest.offer(dx * dx + dy * dy + dz * dz, airports[mid]);
+
+      // Signed distance from the target to the splitting plane. Every point
+      // past the plane is at least this far in a straight line, so its
+      // square bounds the chord of the whole far subtree from below.
+      const int axis = axes[mid];
+      const double planeDist = t[axis] - coord(mid, axis);
+      const double farBound = std::max(frame.bound, planeDist * planeDist);
+      const Frame left{frame.bound, frame.lo, (uint32_t)mid};
+      const Frame right{frame.bound, (uint32_t)mid + 1, frame.hi};
+
+      if (farBound < closest.worst()) {
+        Frame far = planeDist < 0 ? right : left;
+        far.bound = farBound;
+        if (!frontier.full()) frontier.push(far);
+        else                  overflow[nOverflow++] = far;
+      }
+      frame = planeDist < 0 ? left : right;
+    }
+
+    // Skip overflowed subtrees the closest found since then rules out
+    do {
+      if (nOverflow == 0) return;
+      frame = overflow[--nOverflow];
+    } while (!(frame.bound < closest.worst()));
+  }
+}
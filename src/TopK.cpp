@@ -0,0 +1,24 @@
+/*******************************************************************************
+ *   File: TopK.cpp
+ * Author: Ben Targan
+ *   Desc: Allocation free collector of the k closest airports of a search.
+ ******************************************************************************/
+#include "airports/TopK.h"
+#include "airports/geo.h"
+
+void TopKCollector::finish(const location &target) {
+  std::sort_heap(heap, heap + n);
+  
+  for (size_t i = 0; i < n; ++i)
+    heap[i].dist = (double)greatCircleMiles(heap[i].airport->loc, target);
+  
+  // Stable insertion sort by miles. Ranks are a monotone function of the
+  // distance, so entries only move past near ties.
+  for (size_t i = 1; i < n; ++i) {
+    const TopKEntry entry = heap[i];
+    size_t j = i;
+    for (; j > 0 && entry.dist < heap[j - 1].dist; --j)
+      heap[j] = heap[j - 1];
+    heap[j] = entry;
+  }
+}
@@ -0,0 +1,178 @@
+/*******************************************************************************
+ *   File: airport_lookup.cpp
+ * Author: Ben Targan
+ *   Desc: In process places and airports lookups.
+ ******************************************************************************/
+#include <chrono>
+#include <stdexcept>
+#include "airport_lookup.h"
+#include "airports/KDTree.h"
+#include "airports/SphereKDTree.h"
+#include "parallel.h"
+
+// Milliseconds elapsed since start
+static double msSince(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+void AirportLookup::loadAirports(const char *path, const SearchEngine engine,
+                                 const size_t maxNodes) {
+  // Snapshots hold a prebuilt sphere tree and are served straight from disk
+  if (SphereKDTree::isSnapshot(path)) {
+    const auto start = std::chrono::steady_clock::now();
+    airports = std::unique_ptr<SpatialIndex>(new SphereKDTree(
+      SphereKDTree::openSnapshot(path), maxNodes));
+    info_printf("Mapped %d airports into %s index from snapshot (%.1f ms).",
+                (int)airports->size(), airports->name(), msSince(start));
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto airRecs = load_Airports(path);
+  const double parseMs = msSince(start);
+
+  start = std::chrono::steady_clock::now();
+  airports = makeSpatialIndex(engine, std::move(airRecs), maxNodes);
+  const double buildMs = msSince(start);
+
+  info_printf("Loaded %d airports into %s index (parse %.1f ms,"
+              " build %.1f ms).",
+              (int)airports->size(), airports->name(), parseMs, buildMs);
+}
+
+// Gives a trie the closest airports of its places, unless those of its
+// snapshot were built from the airports file as it is. Throws on IO/file
+// format error.
+static void attachNearest(Trie &t, const char *airportsPath,
+                          const FileStamp &stamp) {
+  if (t.nearest() && t.nearest()->airportsStamp() == stamp) {
+    info_printf("Closest airports of %d places are current in the snapshot.",
+                (int)t.size());
+    return;
+  }
+  
+  const auto start = std::chrono::steady_clock::now();
+  t.buildNearest(load_Airports(airportsPath), stamp);
+  info_printf("Precomputed closest airports of %d places (%.1f ms).",
+              (int)t.size(), msSince(start));
+}
+
+void AirportLookup::loadPlaces(const char *path, const char *airportsPath) {
+  // Stamped before reading, so a write while loading is picked up by the
+  // next refresh
+  const FileStamp newPlaces = fileStamp(path);
+  const FileStamp newAirports =
+    airportsPath ? fileStamp(airportsPath) : FileStamp();
+  
+  std::shared_ptr<Trie> loaded = loadTrie(path);
+  if (airportsPath) attachNearest(*loaded, airportsPath, newAirports);
+  std::atomic_store(&places, std::shared_ptr<const Trie>(std::move(loaded)));
+  
+  placesPath = path;
+  this->airportsPath = airportsPath ? airportsPath : "";
+  placesStamp = newPlaces;
+  airportsStamp = newAirports;
+}
+
+bool AirportLookup::refreshPlaces() {
+  if (placesPath.empty()) return false;
+  
+  const FileStamp newPlaces = fileStamp(placesPath.c_str());
+  const FileStamp newAirports = airportsPath.empty() ?
+    FileStamp() : fileStamp(airportsPath.c_str());
+  if (newPlaces == placesStamp && newAirports == airportsStamp) return false;
+  
+  // Stamped before reading, so a failed reload is only retried once the
+  // files change again
+  placesStamp = newPlaces;
+  airportsStamp = newAirports;
+  std::shared_ptr<Trie> next = loadTrie(placesPath.c_str());
+  if (!airportsPath.empty())
+    attachNearest(*next, airportsPath.c_str(), newAirports);
+  std::atomic_store(&places, std::shared_ptr<const Trie>(std::move(next)));
+  return true;
+}
+
+std::shared_ptr<const Trie> AirportLookup::servedPlaces() const {
+  return std::atomic_load(&places);
+}
+
+size_t AirportLookup::airportCount() const {
+  return airports ? airports->size() : 0;
+}
+
+size_t AirportLookup::placeCount() const {
+  const auto served = servedPlaces();
+  return served ? served->size() : 0;
+}
+
+PlaceMatch AirportLookup::findPlace(const PlaceQuery &query) const {
+  return matchPlace(*placesTrie(), query);
+}
+
+PlaceMatch AirportLookup::matchPlace(const Trie &t, const PlaceQuery &query) {
+  const auto found = queryPlace(t, query.name, query.state);
+
+  PlaceMatch match;
+  match.isAmbiguous = found.isAmbiguous;
+  match.places.reserve(found.places.size());
+  for (const CityRecord &rec : found.places)
+    match.places.push_back({ t.name(rec), t.state(rec), rec.loc(),
+                             rec.population });
+  return match;
+}
+
+std::vector<PlaceMatch>
+AirportLookup::findPlaces(const std::vector<PlaceQuery> &queries) const {
+  // Below this many queries per thread, spawning costs more than it saves
+  constexpr size_t minQueriesPerThread = 256;
+
+  // One trie answers the whole batch, whatever a refresh does meanwhile
+  const auto served = placesTrie();
+  std::vector<PlaceMatch> matches(queries.size());
+  parallelFor(queries.size(), minQueriesPerThread,
+              [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      matches[i] = matchPlace(*served, queries[i]);
+  });
+  return matches;
+}
+
+std::vector<DistAirport> AirportLookup::nearestAirports(const location target,
+                                                        const size_t k) const {
+  return airportIndex().kClosestLocations(target, k);
+}
+
+std::vector<std::vector<DistAirport>>
+AirportLookup::nearestAirportsBatch(const std::vector<location> &targets,
+                                    const size_t k) const {
+  // Below this many targets per thread, spawning costs more than it saves
+  constexpr size_t minTargetsPerThread = 128;
+
+  const SpatialIndex &index = airportIndex();
+  std::vector<std::vector<DistAirport>> results(targets.size());
+  parallelFor(targets.size(), minTargetsPerThread,
+              [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      results[i] = index.kClosestLocations(targets[i], k);
+  });
+  return results;
+}
+
+std::vector<DistAirport> AirportLookup::airportsWithin(const location target,
+                                                       const double miles)
+                                                       const {
+  return airportIndex().locationsWithinRadius(target, miles);
+}
+
+const SpatialIndex &AirportLookup::airportIndex() const {
+  if (!airports) throw std::logic_error("Airports are not loaded.");
+  return *airports;
+}
+
+std::shared_ptr<const Trie> AirportLookup::placesTrie() const {
+  auto served = servedPlaces();
+  if (!served) throw std::logic_error("Places are not loaded.");
+  return served;
+}
@@ -0,0 +1,121 @@
+/*******************************************************************************
+ *   \file airports_pool.cpp
+ * \author Connor Wilding
+ *   \desc Pool of long-lived RPC client handles to the airports server.
+ ******************************************************************************/
+#include <utility>
+#include "airports/airports.h"
+#include "places/airports_pool.h"
+#include "common.h"
+#include "stats.h"
+
+// Counters exported through the stats dump
+static StatCounter handlesCreated("airports_pool.created");
+static StatCounter handlesReused("airports_pool.reused");
+static StatCounter handlesDiscarded("airports_pool.discarded");
+static StatCounter connectFailures("airports_pool.connect_failures");
+static StatCounter healthChecks("airports_pool.health_checks");
+static StatCounter healthCheckFailures("airports_pool.health_check_failures");
+
+// Timeout of the NULLPROC ping used to health check idle handles
+static struct timeval PING_TIMEOUT = { 1, 0 };
+
+AirportsClientPool::Lease::Lease(AirportsClientPool *owner, const Transport t,
+                                 CLIENT *c) :
+  pool(owner), transport(t), clnt(c), failed(false) { }
+
+AirportsClientPool::Lease::Lease(Lease &&other) noexcept :
+  pool(other.pool), transport(other.transport), clnt(other.clnt),
+  failed(other.failed) {
+  other.clnt = nullptr;
+}
+
+AirportsClientPool::Lease::~Lease() {
+  if (clnt) pool->release(transport, clnt, failed);
+}
+
+AirportsClientPool::AirportsClientPool(std::string host, const size_t maxIdle,
+                                       const time_t healthCheckSecs) :
+  airportsHost(std::move(host)),
+  maxIdlePerTransport(maxIdle),
+  healthCheckInterval(healthCheckSecs) { }
+
+AirportsClientPool::~AirportsClientPool() {
+  for (auto &idle : idleUdp) clnt_destroy(idle.clnt);
+  for (auto &idle : idleTcp) clnt_destroy(idle.clnt);
+}
+
+AirportsClientPool::Lease AirportsClientPool::acquire(const Transport t) {
+  for (;;) {
+    IdleClient idle{};
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      auto &idles = idleList(t);
+      if (idles.empty()) break;
+      idle = idles.back();
+      idles.pop_back();
+    }
+
+    // Handle sat around long enough that the server may have gone away
+    if (time(nullptr) - idle.idleSince >= healthCheckInterval) {
+      healthChecks.inc();
+      if (!ping(idle.clnt)) {
+        healthCheckFailures.inc();
+        handlesDiscarded.inc();
+        clnt_destroy(idle.clnt);
+        continue;
+      }
+    }
+
+    handlesReused.inc();
+    return Lease(this, t, idle.clnt);
+  }
+
+  return Lease(this, t, create(t));
+}
+
+AirportsClientPool::Lease AirportsClientPool::acquireNew(const Transport t) {
+  return Lease(this, t, create(t));
+}
+
+void AirportsClientPool::release(const Transport t, CLIENT *clnt,
+                                 const bool failed) {
+  if (!failed) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto &idles = idleList(t);
+    if (idles.size() < maxIdlePerTransport) {
+      idles.push_back({clnt, time(nullptr)});
+      return;
+    }
+  }
+
+  handlesDiscarded.inc();
+  clnt_destroy(clnt);
+}
+
+CLIENT *AirportsClientPool::create(const Transport t) {
+  const char *proto = t == Transport::TCP ? "tcp" : "udp";
+  CLIENT *clnt = clnt_create(airportsHost.c_str(), AIRPORTS_PROG,
+                             AIRPORTS_VERS, proto);
+  if (clnt == nullptr) {
+    connectFailures.inc();
+    clnt_pcreateerror(airportsHost.c_str());
+    return nullptr;
+  }
+
+  handlesCreated.inc();
+  log_printf("Created %s handle to %s.", proto, airportsHost.c_str());
+  return clnt;
+}
+
+bool AirportsClientPool::ping(CLIENT *clnt) {
+  return clnt_call(clnt, NULLPROC,
+                   (xdrproc_t)xdr_void, nullptr,
+                   (xdrproc_t)xdr_void, nullptr,
+                   PING_TIMEOUT) == RPC_SUCCESS;
+}
+
+std::vector<AirportsClientPool::IdleClient> &
+AirportsClientPool::idleList(const Transport t) {
+  return t == Transport::TCP ? idleTcp : idleUdp;
+}
@@ -6,12 +6,20 @@
 #include <cstdio>
 #include <cstdlib>
 #include <rpc/pmap_clnt.h>
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "airports/airports.h"
-#include "airports/KDTree.h"
+#include "airport_lookup.h"
+#include "lru_cache.h"
 #include "place_airport_common.h"
+#include "stats.h"
+#include "parallel.h"
+#include "svc_pool.h"
 
 #ifndef SIG_PF
 #define SIG_PF void(*)(int)
@@ -21,10 +29,19 @@ static void airports_prog_1(struct svc_req *rqstp,  register SVCXPRT *transp)
 {
 	union {
 		location airports_qry_1_arg;
+		locations airports_qry_batch_1_arg;
+		knn_req airports_qry_k_1_arg;
+		radius_req airports_qry_radius_1_arg;
 	} argument{};
-	char *result;
+	union {
+		airports_ret airports_qry_1_res;
+		airports_batch_ret airports_qry_batch_1_res;
+		airport_list_ret airports_qry_k_1_res;
+		airport_list_ret airports_qry_radius_1_res;
+	} result{};
+	bool_t retval;
 	xdrproc_t _xdr_argument, _xdr_result;
-	char *(*local)(char *, struct svc_req *);
+	bool_t (*local)(char *, void *, struct svc_req *);
 
 	switch (rqstp->rq_proc) {
     case NULLPROC:
@@ -33,7 +50,22 @@ static void airports_prog_1(struct svc_req *rqstp,  register SVCXPRT *transp)
     case AIRPORTS_QRY:
       _xdr_argument = (xdrproc_t) xdr_location;
       _xdr_result = (xdrproc_t) xdr_airports_ret;
-      local = (char *(*)(char *, struct svc_req *)) airports_qry_1_svc;
+      local = (bool_t (*)(char *, void *, struct svc_req *)) airports_qry_1_svc;
+      break;
+    case AIRPORTS_QRY_BATCH:
+      _xdr_argument = (xdrproc_t) xdr_locations;
+      _xdr_result = (xdrproc_t) xdr_airports_batch_ret;
+      local = (bool_t (*)(char *, void *, struct svc_req *)) airports_qry_batch_1_svc;
+      break;
+    case AIRPORTS_QRY_K:
+      _xdr_argument = (xdrproc_t) xdr_knn_req;
+      _xdr_result = (xdrproc_t) xdr_airport_list_ret;
+      local = (bool_t (*)(char *, void *, struct svc_req *)) airports_qry_k_1_svc;
+      break;
+    case AIRPORTS_QRY_RADIUS:
+      _xdr_argument = (xdrproc_t) xdr_radius_req;
+      _xdr_result = (xdrproc_t) xdr_airport_list_ret;
+      local = (bool_t (*)(char *, void *, struct svc_req *)) airports_qry_radius_1_svc;
       break;
     default:
       svcerr_noproc (transp);
@@ -44,8 +76,8 @@ static void airports_prog_1(struct svc_req *rqstp,  register SVCXPRT *transp)
 		svcerr_decode (transp);
 		return;
 	}
-	result = (*local)((char *)&argument, rqstp);
-	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+	retval = (*local)((char *)&argument, (void *)&result, rqstp);
+	if (retval > 0 && !svc_sendreply(transp, (xdrproc_t) _xdr_result, (char *)&result)) {
 		svcerr_systemerr (transp);
 	}
 	
@@ -53,36 +85,265 @@ static void airports_prog_1(struct svc_req *rqstp,  register SVCXPRT *transp)
 		fprintf (stderr, "%s", "unable to free arguments");
 		exit (1);
 	}
+	if (!airports_prog_1_freeresult (transp, _xdr_result, (caddr_t) &result))
+		fprintf (stderr, "%s", "unable to free results");
+}
+
+// Airports being served, loaded before any worker thread starts
+static AirportLookup lookup;
+
+// Closest airports of a grid cell, strings point into the index
+using TCachedAirports = std::array<airport, NRESULTS>;
+
+// Cache in front of closest5(), none unless initCache() was called
+static std::unique_ptr<ShardedLruCache<GridKey, TCachedAirports, GridKeyHash>>
+  resultCache;
+static int cacheDecimals = 0;
+
+// Counters exported through the stats dump
+static StatCounter cacheHits("airports_cache.hits");
+static StatCounter cacheMisses("airports_cache.misses");
+static StatCounter cacheEvictions("airports_cache.evictions");
+
+// Puts a sharded LRU cache in front of closest5(). Targets in the same grid
+// cell share the closest airports of the first of them looked up, so answers
+// are off by up to the cell size.
+static void initCache(const size_t maxBytes, const int gridDecimals) {
+  resultCache.reset(new ShardedLruCache<GridKey, TCachedAirports, GridKeyHash>(
+    maxBytes, CacheCounters{&cacheHits, &cacheMisses, &cacheEvictions}));
+  cacheDecimals = gridDecimals;
+  log_printf("Caching up to %zu grid cells of 1e-%d degrees.",
+             resultCache->capacity(), gridDecimals);
+}
+
+// Copies a query result to its XDR form. Strings point into the index.
+static void fillAirport(const AirportRecord &airp, const double dist,
+                        airport &result) {
+  result.dist = dist;
+  result.code = (char*)airp.code;
+  result.name = (char*)airp.name;
+  result.state = (char*)airp.state;
+  result.loc = airp.loc;
+}
+
+// Collects up to k closest airports into results. Returns the number written.
+static size_t closestK(const location target, const size_t k,
+                       airport *results) {
+  return lookup.forNearestAirports(target, k,
+    [&](const AirportRecord &airp, const double dist) {
+      fillAirport(airp, dist, *results++);
+    });
+}
+
+// Fills in the 5 closest airports, from the cache when it has the cell
+static void closest5(const location target, airport *result) {
+  // Hot coordinates are answered from the cache of their grid cell
+  GridKey key{};
+  TCachedAirports cached;
+  const bool cacheable = resultCache && gridKey(target, cacheDecimals, key);
+  if (cacheable && resultCache->get(key, cached)) {
+    std::memcpy(result, cached.data(), sizeof(airports));
+    return;
+  }
+  
+  // Clear out any previous values
+  std::memset(result, 0, sizeof(airports));
+  closestK(target, NRESULTS, result);
+  
+  if (cacheable) {
+    std::memcpy(cached.data(), result, sizeof(airports));
+    resultCache->put(key, cached);
+  }
+}
+
+/**
+ * Query. Result is filled in per call so concurrent workers never share it.
+*/
+bool_t airports_qry_1_svc(location *argp, airports_ret *result,
+                          struct svc_req *rqstp) {
+  *result = { };
+  closest5(*argp, &result->airports_ret_u.results[0]);
+  
+  return TRUE;
 }
 
 /**
- * Query.
+ * Batch query. Every point of the batch is answered in request order.
 */
-airports_ret *airports_qry_1_svc(location *argp, struct svc_req *rqstp) {
-  static airports_ret result;
+bool_t airports_qry_batch_1_svc(locations *argp, airports_batch_ret *result,
+                                struct svc_req *rqstp) {
+  *result = { };
+  const u_int n = argp->locations_len;
+  auto &batch = result->airports_batch_ret_u.results;
   
-  result = { };
-  airport* const closest = kd5Closest(*argp);
+  batch.airports_batch_val = (airports *)malloc(n * sizeof(airports));
+  if (n > 0 && batch.airports_batch_val == nullptr) {
+    result->err = 1;
+    result->airports_batch_ret_u.error_msg = (char *)"Out of memory.";
+    return TRUE;
+  }
+  batch.airports_batch_len = n;
   
-  memcpy(&result.airports_ret_u.results[0], closest, sizeof(airports));
+  // Below this many targets per thread, spawning costs more than it saves
+  constexpr size_t minTargetsPerThread = 128;
   
-  return &result;
+  const location *targets = argp->locations_val;
+  airports *results = batch.airports_batch_val;
+  parallelFor(n, minTargetsPerThread, [=](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      closest5(targets[i], &results[i][0]);
+  });
+  
+  return TRUE;
+}
+
+// Helper to allocate a variable length result. False when out of memory.
+static bool allocAirportList(airport_list_ret *result, size_t n) {
+  auto &list = result->airport_list_ret_u.results;
+  list.airport_list_val = (airport *)calloc(std::max<size_t>(n, 1),
+                                            sizeof(airport));
+  if (list.airport_list_val == nullptr) {
+    result->err = 1;
+    result->airport_list_ret_u.error_msg = (char *)"Out of memory.";
+    return false;
+  }
+  return true;
+}
+
+// Most airports a list reply carries over the transport of a request
+static size_t maxResultsFor(const struct svc_req *rqstp) {
+  int type = 0;
+  socklen_t len = sizeof(type);
+  if (getsockopt(rqstp->rq_xprt->xp_fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0
+      && type == SOCK_DGRAM)
+    return std::min<size_t>(MAX_UDP_AIRPORTS, MAX_KRESULTS);
+  return MAX_KRESULTS;
+}
+
+/**
+ * K closest query. k is capped at MAX_KRESULTS over TCP, and at what fits in
+ * a datagram over UDP.
+*/
+bool_t airports_qry_k_1_svc(knn_req *argp, airport_list_ret *result,
+                            struct svc_req *rqstp) {
+  *result = { };
+  if (argp->k <= 0) {
+    result->err = 1;
+    result->airport_list_ret_u.error_msg = (char *)"k must be positive.";
+    return TRUE;
+  }
+  
+  const size_t k = std::min((size_t)argp->k, maxResultsFor(rqstp));
+  if (!allocAirportList(result, k)) return TRUE;
+  
+  auto &list = result->airport_list_ret_u.results;
+  list.airport_list_len = (u_int)closestK(argp->loc, k, list.airport_list_val);
+  return TRUE;
+}
+
+/**
+ * Radius query. Returns at most max_results, capped like k in the k closest
+ * query.
+*/
+bool_t airports_qry_radius_1_svc(radius_req *argp, airport_list_ret *result,
+                                 struct svc_req *rqstp) {
+  *result = { };
+  if (argp->max_results <= 0 || !(argp->miles >= 0)) {
+    result->err = 1;
+    result->airport_list_ret_u.error_msg =
+      (char *)"Radius must be non-negative and max_results positive.";
+    return TRUE;
+  }
+  
+  const size_t maxResults = std::min((size_t)argp->max_results,
+                                     maxResultsFor(rqstp));
+  if (!allocAirportList(result, maxResults)) return TRUE;
+  
+  auto &list = result->airport_list_ret_u.results;
+  const auto inRange = lookup.airportsWithin(argp->loc, argp->miles);
+  const size_t n = std::min(inRange.size(), maxResults);
+  for (size_t i = 0; i < n; ++i)
+    fillAirport(*inRange[i].airport, inRange[i].dist, list.airport_list_val[i]);
+  list.airport_list_len = (u_int)n;
+  return TRUE;
+}
+
+/**
+ * Result strings point into the index records and error messages are
+ * literals, so only the result arrays themselves are freed.
+*/
+int airports_prog_1_freeresult(SVCXPRT *transp, xdrproc_t xdr_result,
+                               caddr_t result) {
+  if (xdr_result == (xdrproc_t)xdr_airports_batch_ret) {
+    auto *batchRes = (airports_batch_ret *)result;
+    if (batchRes->err == 0)
+      free(batchRes->airports_batch_ret_u.results.airports_batch_val);
+  }
+  else if (xdr_result == (xdrproc_t)xdr_airport_list_ret) {
+    auto *listRes = (airport_list_ret *)result;
+    if (listRes->err == 0)
+      free(listRes->airport_list_ret_u.results.airport_list_val);
+  }
+  return 1;
 }
 
 int main (int argc, char **argv) {
+  unsigned nThreads = 1;
+  SearchEngine engine = SearchEngine::Auto;
+  size_t maxNodes = 0;
+  size_t cacheMB = 0;
+  int gridDecimals = 4;
+  int c;
+  while ((c = getopt(argc, argv, "c:e:g:n:t:")) != -1) {
+    switch (c) {
+      case 'e':
+        if (parseSearchEngine(optarg, engine)) break;
+        printf("Unknown search engine `%s`\n", optarg);
+        // fall through
+      default:
+        printf("usage: %s [-c cacheMB] [-e auto|brute|sphere|latlong] "
+               "[-g gridDecimals] [-n maxNodes] [-t threads] [airportsFile]\n",
+               argv[0]);
+        exit(1);
+      case 'c':
+        cacheMB = std::strtoul(optarg, nullptr, 10);
+        break;
+      case 'g':
+        gridDecimals = std::atoi(optarg);
+        if (gridDecimals < 0 || gridDecimals > MAX_GRID_DECIMALS) {
+          printf("Grid decimals must be 0 to %d\n", MAX_GRID_DECIMALS);
+          exit(1);
+        }
+        break;
+      case 'n':
+        maxNodes = std::strtoul(optarg, nullptr, 10);
+        break;
+      case 't':
+        nThreads = parseThreadCount(optarg);
+        break;
+    }
+  }
+  
   const char* airportsPath = "airport-locations.txt";
-  if (argc < 2)
+  if (optind >= argc)
     printf("Note: airports path not specified, using `airports-locations.txt`\n");
   else
-    airportsPath = argv[1];
+    airportsPath = argv[optind];
   
-  initKD(airportsPath);
+  // Index is fully built before any worker thread starts reading it
+  try {
+    lookup.loadAirports(airportsPath, engine, maxNodes);
+  } catch (const std::exception& e) {
+    exitWithMessage(e.what());
+  }
+  if (cacheMB > 0) initCache(cacheMB << 20, gridDecimals);
+  installStatsDumpHandler();
   
   register SVCXPRT *transp;
 
   pmap_unset (AIRPORTS_PROG, AIRPORTS_VERS);
 
-  transp = svcudp_create(RPC_ANYSOCK);
+  transp = nThreads > 1 ? svcUdpCreateShared() : svcudp_create(RPC_ANYSOCK);
   if (transp == NULL) {
     fprintf (stderr, "%s", "cannot create udp service.");
     exit(1);
@@ -92,6 +353,11 @@ int main (int argc, char **argv) {
     fprintf (stderr, "%s", "unable to register (AIRPORTS_PROG, AIRPORTS_VERS, udp).");
     exit(1);
   }
+  if (!svcAddUdpReplicas(transp, AIRPORTS_PROG, AIRPORTS_VERS,
+                         airports_prog_1, nThreads - 1)) {
+    fprintf (stderr, "%s", "unable to create udp worker transports.");
+    exit(1);
+  }
 
   transp = svctcp_create(RPC_ANYSOCK, 0, 0);
   if (transp == NULL) {
@@ -104,7 +370,7 @@ int main (int argc, char **argv) {
     exit(1);
   }
 
-  svc_run ();
+  svcRunPool(nThreads);
   fprintf (stderr, "%s", "svc_run returned");
   exit (1);
 }
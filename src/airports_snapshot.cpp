@@ -0,0 +1,32 @@
+/*******************************************************************************
+ *   File: airports_snapshot.cpp
+ * Author: Ben Targan
+ *   Desc: Compiles an airports file into a KD-tree snapshot airport_server
+ *         maps at startup instead of parsing and building.
+ *
+ *         usage: airports_snapshot <airportsFile> <snapshotFile>
+ ******************************************************************************/
+#include <cstdio>
+#include <stdexcept>
+#include "airports/KDTree.h"
+#include "airports/SphereKDTree.h"
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    printf("usage: %s <airportsFile> <snapshotFile>\n", argv[0]);
+    return 1;
+  }
+  
+  try {
+    const SphereKDTree tree(load_Airports(argv[1]));
+    tree.writeSnapshot(argv[2]);
+    
+    // Read it back so a bad snapshot fails here rather than at server start
+    const SphereKDTree mapped(SphereKDTree::openSnapshot(argv[2]));
+    printf("Wrote %zu airports to %s.\n", mapped.size(), argv[2]);
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
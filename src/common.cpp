@@ -2,6 +2,7 @@
  *   File: common.cpp
  * Author: Connor Wilding
  ******************************************************************************/
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <utility>
@@ -15,17 +16,21 @@ void exitWithMessage(const char *msg) {
   exit(-1);
 }
 
-CityRecord::CityRecord() = default;
-
-CityRecord::CityRecord(std::string cityName_, const std::string &state_,
-                       const location &loc_) :
-                       cityName(std::move(cityName_)), state(std::move(state_)),
-                       loc(loc_) { }
+// Copies src into a fixed size field, truncating and always terminating it
+template<size_t N>
+static void copyField(char (&field)[N], const std::string &src) {
+  const size_t len = std::min(src.size(), N - 1);
+  src.copy(field, len);
+  std::fill(field + len, field + N, '\0');
+}
 
-AirportRecord::AirportRecord(location location, std::string acode,
-                             std::string &aname, std::string &astate) :
-                             loc(location), code(std::move(acode)),
-                             name(std::move(aname)), state(std::move(astate)) { }
+AirportRecord::AirportRecord(location location, const std::string &acode,
+                             const std::string &aname,
+                             const std::string &astate) : loc(location) {
+  copyField(code, acode);
+  copyField(name, aname);
+  copyField(state, astate);
+}
   
 DistAirport::DistAirport(const AirportRecord &airRef, const double adist) :
   airport(&airRef) , dist(adist) {}
@@ -88,6 +93,42 @@ std::ostream &operator<<(std::ostream &stream, const place &p1) {
   return stream << p1.name << ", " << p1.state << " " << p1.loc;
 }
 
+/**
+ * Stream Operator for complete_ret, one place per line most populous first.
+*/
+std::ostream &operator<<(std::ostream &stream, const complete_ret &compRet) {
+  if (compRet.err)
+    return stream << "Error: " << compRet.complete_ret_u.err_msg;
+  
+  const auto &comps = compRet.complete_ret_u.results;
+  if (comps.completions_len == 0)
+    return stream << "No places found.";
+  for (u_int i = 0; i < comps.completions_len; ++i) {
+    if (i > 0) stream << std::endl;
+    stream << comps.completions_val[i].pl << " population "
+           << comps.completions_val[i].population;
+  }
+  return stream;
+}
+
+/**
+ * Stream Operator for fuzzy_ret, one place per line closest name first.
+*/
+std::ostream &operator<<(std::ostream &stream, const fuzzy_ret &fuzzyRet) {
+  if (fuzzyRet.err)
+    return stream << "Error: " << fuzzyRet.fuzzy_ret_u.err_msg;
+  
+  const auto &matches = fuzzyRet.fuzzy_ret_u.results;
+  if (matches.fuzzy_matches_len == 0)
+    return stream << "No places found.";
+  for (u_int i = 0; i < matches.fuzzy_matches_len; ++i) {
+    if (i > 0) stream << std::endl;
+    stream << matches.fuzzy_matches_val[i].pl << " edits "
+           << matches.fuzzy_matches_val[i].distance;
+  }
+  return stream;
+}
+
 /**
  * Stream Operator for places_ret.sends to listAirports()
 */
@@ -101,13 +142,3 @@ std::ostream &operator<<(std::ostream &stream, const places_ret &p1Ret) {
   
   return stream;
 }
-
-/**
- * Stream Operator for CityRecord.
-*/
-std::ostream &operator<<(std::ostream &stream, const CityRecord &rec) {
-  stream << std::setw(25) << std::left << rec.cityName;
-  stream << std::setw(0) << ", " << rec.state << " " << rec.loc;
-  
-  return stream;
-}
@@ -0,0 +1,22 @@
+/*******************************************************************************
+ *   File: geo.cpp
+ * Author: Ben Targan
+ *   Desc: Great circle distance.
+ ******************************************************************************/
+#include "airports/geo.h"
+
+static constexpr long double PI() { return std::atan(1) * 4; }
+
+static long double deg2radL(long double deg) {
+  return deg * PI() / 180.0L;
+}
+
+long double greatCircleMiles(const location &pt1, const location &pt2) {
+  const long double lat1 = deg2radL(pt1.latitude);
+  const long double lon1 = deg2radL(pt1.longitude);
+  const long double lat2 = deg2radL(pt2.latitude);
+  const long double lon2 = deg2radL(pt2.longitude);
+  const long double a = std::sin(lat1) * std::sin(lat2);
+  const long double b = std::cos(lat1) * std::cos(lat2) * std::cos(lon2 - lon1);
+  return (long double)EARTH_RADIUS_MILES * std::acos(a + b);
+}
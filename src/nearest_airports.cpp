@@ -0,0 +1,89 @@
+/*******************************************************************************
+ *   File: nearest_airports.cpp
+ * Author: Ben Targan
+ *   Desc: Closest airports of every place, precomputed so named lookups need
+ *         no airports server call.
+ ******************************************************************************/
+#include <stdexcept>
+#include <unordered_map>
+#include "places/nearest_airports.h"
+#include "parallel.h"
+
+// Sections of the table, in the order they are written
+enum SnapshotSections { SECT_AIRPORTS, SECT_NEAREST, SECT_STAMP };
+
+NearestAirports::NearestAirports(const CityRecord *places, const size_t n,
+                                 TAirportRecs airRecs,
+                                 const FileStamp &airportsStamp) :
+                                 builtStamp(airportsStamp) {
+  if (airRecs->size() < NRESULTS)
+    throw std::invalid_argument("Airports file has too few airports.");
+
+  // Below this many places per thread, spawning costs more than it saves
+  constexpr size_t minPlacesPerThread = 512;
+
+  // Searches write disjoint rows, airports are referred to by address until
+  // the index is dropped
+  const auto index = makeSpatialIndex(SearchEngine::Auto, std::move(airRecs));
+  std::vector<const AirportRecord *> found(n * NRESULTS);
+  builtNearest.resize(n * NRESULTS);
+  parallelFor(n, minPlacesPerThread, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const location target = places[i].loc();
+      TopK<NRESULTS> top;
+      auto &closest = top.get();
+      index->kClosest(target, closest);
+      closest.finish(target);
+
+      size_t j = i * NRESULTS;
+      for (const auto &entry : closest) {
+        found[j] = entry.airport;
+        builtNearest[j++].dist = entry.dist;
+      }
+    }
+  });
+
+  // Keep only the airports some place is closest to, in order of first use
+  std::unordered_map<const AirportRecord *, uint32_t> tableIdx;
+  for (size_t j = 0; j < found.size(); ++j) {
+    const auto ins = tableIdx.emplace(found[j], (uint32_t)builtAirports.size());
+    if (ins.second) builtAirports.push_back(*found[j]);
+    builtNearest[j].airport = ins.first->second;
+  }
+  builtAirports.shrink_to_fit();
+
+  airports = builtAirports.data();
+  nAirports = builtAirports.size();
+  nearest = builtNearest.data();
+  nPlaces = n;
+  stamp = &builtStamp;
+}
+
+NearestAirports::NearestAirports(const Snapshot &snapshot,
+                                 const size_t firstSection, const size_t n) {
+  nAirports = snapshot.sectionLength<AirportRecord>(
+    firstSection + SECT_AIRPORTS);
+  airports = snapshot.section<AirportRecord>(firstSection + SECT_AIRPORTS,
+                                             nAirports);
+  nearest = snapshot.section<NearestAirport>(firstSection + SECT_NEAREST,
+                                             n * NRESULTS);
+  stamp = snapshot.section<FileStamp>(firstSection + SECT_STAMP, 1);
+  nPlaces = n;
+
+  for (size_t j = 0; j < n * NRESULTS; ++j) {
+    if (nearest[j].airport >= nAirports)
+      throw std::invalid_argument("Places snapshot has a corrupt airports "
+                                  "table.");
+  }
+}
+
+void NearestAirports::addSections(SnapshotWriter &writer) const {
+  writer.addSection(airports, nAirports);
+  writer.addSection(nearest, nPlaces * NRESULTS);
+  writer.addSection(stamp, 1);
+}
+
+size_t NearestAirports::memory() const {
+  return nAirports * sizeof(AirportRecord) +
+         nPlaces * NRESULTS * sizeof(NearestAirport);
+}
@@ -146,3 +146,258 @@ xdr_airports_ret (XDR *xdrs, airports_ret *objp)
 	}
 	return TRUE;
 }
+
+bool_t
+xdr_locations (XDR *xdrs, locations *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->locations_val, (u_int *) &objp->locations_len, MAX_BATCH,
+		sizeof (location), (xdrproc_t) xdr_location))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_airports_batch (XDR *xdrs, airports_batch *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->airports_batch_val, (u_int *) &objp->airports_batch_len, MAX_BATCH,
+		sizeof (airports), (xdrproc_t) xdr_airports))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_airports_batch_ret (XDR *xdrs, airports_batch_ret *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_int (xdrs, &objp->err))
+		 return FALSE;
+	switch (objp->err) {
+	case 0:
+		 if (!xdr_airports_batch (xdrs, &objp->airports_batch_ret_u.results))
+			 return FALSE;
+		break;
+	default:
+		 if (!xdr_string (xdrs, &objp->airports_batch_ret_u.error_msg, MAX_ERRMSG))
+			 return FALSE;
+		break;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_places_reqs (XDR *xdrs, places_reqs *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->places_reqs_val, (u_int *) &objp->places_reqs_len, MAX_BATCH,
+		sizeof (places_req), (xdrproc_t) xdr_places_req))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_places_rets (XDR *xdrs, places_rets *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->places_rets_val, (u_int *) &objp->places_rets_len, MAX_BATCH,
+		sizeof (places_ret), (xdrproc_t) xdr_places_ret))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_places_batch_ret (XDR *xdrs, places_batch_ret *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_int (xdrs, &objp->err))
+		 return FALSE;
+	switch (objp->err) {
+	case 0:
+		 if (!xdr_places_rets (xdrs, &objp->places_batch_ret_u.results))
+			 return FALSE;
+		break;
+	default:
+		 if (!xdr_string (xdrs, &objp->places_batch_ret_u.err_msg, MAX_ERRMSG))
+			 return FALSE;
+		break;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_airport_list (XDR *xdrs, airport_list *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->airport_list_val, (u_int *) &objp->airport_list_len, MAX_KRESULTS,
+		sizeof (airport), (xdrproc_t) xdr_airport))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_knn_req (XDR *xdrs, knn_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_location (xdrs, &objp->loc))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->k))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_radius_req (XDR *xdrs, radius_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_location (xdrs, &objp->loc))
+		 return FALSE;
+	 if (!xdr_double (xdrs, &objp->miles))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->max_results))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_airport_list_ret (XDR *xdrs, airport_list_ret *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_int (xdrs, &objp->err))
+		 return FALSE;
+	switch (objp->err) {
+	case 0:
+		 if (!xdr_airport_list (xdrs, &objp->airport_list_ret_u.results))
+			 return FALSE;
+		break;
+	default:
+		 if (!xdr_string (xdrs, &objp->airport_list_ret_u.error_msg, MAX_ERRMSG))
+			 return FALSE;
+		break;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_complete_req (XDR *xdrs, complete_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_string (xdrs, &objp->prefix, MAX_NAME))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->max_results))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_completion (XDR *xdrs, completion *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_place (xdrs, &objp->pl))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->population))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_completions (XDR *xdrs, completions *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->completions_val, (u_int *) &objp->completions_len, MAX_COMPLETIONS,
+		sizeof (completion), (xdrproc_t) xdr_completion))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_complete_ret (XDR *xdrs, complete_ret *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_int (xdrs, &objp->err))
+		 return FALSE;
+	switch (objp->err) {
+	case 0:
+		 if (!xdr_completions (xdrs, &objp->complete_ret_u.results))
+			 return FALSE;
+		break;
+	default:
+		 if (!xdr_string (xdrs, &objp->complete_ret_u.err_msg, MAX_ERRMSG))
+			 return FALSE;
+		break;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_fuzzy_req (XDR *xdrs, fuzzy_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_name_state (xdrs, &objp->named))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->max_distance))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->max_results))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_fuzzy_match (XDR *xdrs, fuzzy_match *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_place (xdrs, &objp->pl))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->distance))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->population))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_fuzzy_matches (XDR *xdrs, fuzzy_matches *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->fuzzy_matches_val, (u_int *) &objp->fuzzy_matches_len, MAX_FUZZY_MATCHES,
+		sizeof (fuzzy_match), (xdrproc_t) xdr_fuzzy_match))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_fuzzy_ret (XDR *xdrs, fuzzy_ret *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_int (xdrs, &objp->err))
+		 return FALSE;
+	switch (objp->err) {
+	case 0:
+		 if (!xdr_fuzzy_matches (xdrs, &objp->fuzzy_ret_u.results))
+			 return FALSE;
+		break;
+	default:
+		 if (!xdr_string (xdrs, &objp->fuzzy_ret_u.err_msg, MAX_ERRMSG))
+			 return FALSE;
+		break;
+	}
+	return TRUE;
+}
@@ -11,32 +11,74 @@
 /* Default timeout can be changed using clnt_control() */
 static struct timeval TIMEOUT = { 5, 0 };
 
-places_ret *
-places_qry_1(places_req *argp, CLIENT *clnt)
-{
-  static places_ret clnt_res;
-  
-  memset((char *)&clnt_res, 0, sizeof(clnt_res));
-  if (clnt_call (clnt, PLACES_QRY,
-                 (xdrproc_t) xdr_places_req, (caddr_t) argp,
-                 (xdrproc_t) xdr_places_ret, (caddr_t) &clnt_res,
-                 TIMEOUT) != RPC_SUCCESS) {
-    return (NULL);
-  }
-  return (&clnt_res);
-}
-
-airports_ret *
-airports_qry_1(location *argp, CLIENT *clnt)
-{
-  static airports_ret clnt_res;
-  
-  memset((char *)&clnt_res, 0, sizeof(clnt_res));
-  if (clnt_call (clnt, AIRPORTS_QRY,
-                 (xdrproc_t) xdr_location, (caddr_t) argp,
-                 (xdrproc_t) xdr_airports_ret, (caddr_t) &clnt_res,
-                 TIMEOUT) != RPC_SUCCESS) {
-    return (NULL);
-  }
-  return (&clnt_res);
-}
\ No newline at end of file
+enum clnt_stat
+places_qry_1(places_req *argp, places_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, PLACES_QRY,
+                     (xdrproc_t) xdr_places_req, (caddr_t) argp,
+                     (xdrproc_t) xdr_places_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
+
+enum clnt_stat
+places_qry_batch_1(places_reqs *argp, places_batch_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, PLACES_QRY_BATCH,
+                     (xdrproc_t) xdr_places_reqs, (caddr_t) argp,
+                     (xdrproc_t) xdr_places_batch_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
+
+enum clnt_stat
+places_complete_1(complete_req *argp, complete_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, PLACES_COMPLETE,
+                     (xdrproc_t) xdr_complete_req, (caddr_t) argp,
+                     (xdrproc_t) xdr_complete_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
+
+enum clnt_stat
+places_fuzzy_1(fuzzy_req *argp, fuzzy_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, PLACES_FUZZY,
+                     (xdrproc_t) xdr_fuzzy_req, (caddr_t) argp,
+                     (xdrproc_t) xdr_fuzzy_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
+
+enum clnt_stat
+airports_qry_1(location *argp, airports_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, AIRPORTS_QRY,
+                     (xdrproc_t) xdr_location, (caddr_t) argp,
+                     (xdrproc_t) xdr_airports_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
+
+enum clnt_stat
+airports_qry_batch_1(locations *argp, airports_batch_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, AIRPORTS_QRY_BATCH,
+                     (xdrproc_t) xdr_locations, (caddr_t) argp,
+                     (xdrproc_t) xdr_airports_batch_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
+
+enum clnt_stat
+airports_qry_k_1(knn_req *argp, airport_list_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, AIRPORTS_QRY_K,
+                     (xdrproc_t) xdr_knn_req, (caddr_t) argp,
+                     (xdrproc_t) xdr_airport_list_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
+
+enum clnt_stat
+airports_qry_radius_1(radius_req *argp, airport_list_ret *clnt_res, CLIENT *clnt)
+{
+  return (clnt_call (clnt, AIRPORTS_QRY_RADIUS,
+                     (xdrproc_t) xdr_radius_req, (caddr_t) argp,
+                     (xdrproc_t) xdr_airport_list_ret, (caddr_t) clnt_res,
+                     TIMEOUT));
+}
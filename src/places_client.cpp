@@ -4,7 +4,10 @@
  *   Desc: Places server client
  *
  ******************************************************************************/
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <unistd.h>
 #include "common.h"
 #include "airports/airports.h"
@@ -16,13 +19,34 @@ const char *programUsage[] = {
   "",
   "       Use -p flag to search by latitude / longitude:",
   R"(     client -p <places-host> "<latitude>" "<longitude>")",
+  "",
+  "       Use -b flag to send one request per stdin line in batches:",
+  "       client -b <places-host>     lines are <city>[,<state>]",
+  "       client -b -p <places-host>  lines are <latitude> <longitude>",
+  "",
+  "       Use -c flag to list the most populous places starting with prefix:",
+  "       client -c <places-host> <prefix> [count]",
+  "",
+  "       Use -f flag to list the places whose names are within two edits:",
+  "       client -f <places-host> <city> [state]",
 };
 
 // Exit the program, showing usage.
 void showUsageAndExit();
 
 // Helper to parse user's arguments into host and request object given.
-void parseArgs(int argc, char **argv, char **host, places_req &req);
+// Returns true when requests are to be read from stdin in batch mode.
+bool parseArgs(int argc, char **argv, char **host, places_req &req);
+
+// Sends every stdin line as a request, batched. Returns the exit status.
+int runBatch(const char *host, bool isLatLongQuery);
+
+// Requests the completions of a prefix. Returns the exit status.
+int runComplete(const char *host, char *prefix, int maxResults);
+
+// Requests the places matching a possibly misspelled name. Returns the exit
+// status.
+int runFuzzy(const char *host, const name_state &named);
 
 int main(int argc, char *argv[])
 {
@@ -30,7 +54,8 @@ int main(int argc, char *argv[])
   places_req req{};       // Request to the places server
   
   // Parse arguments and build a request to send
-  parseArgs(argc, argv, &host, req);
+  if (parseArgs(argc, argv, &host, req))
+    return runBatch(host, req.req_type == REQ_LAT_LONG);
   
   // Create a clinet handle
   CLIENT *clnt = clnt_create(host, PLACES_PROG, PLACES_VERS, "udp");
@@ -40,21 +65,22 @@ int main(int argc, char *argv[])
   }
   
   // Query the places server
-  places_ret *placesResult = places_qry_1(&req, clnt);
-  if (placesResult == nullptr) {
+  places_ret placesResult{};
+  if (places_qry_1(&req, &placesResult, clnt) != RPC_SUCCESS) {
     clnt_perror(clnt, "call failed");
     clnt_destroy(clnt);
     exit(1);
   }
   
   // Display result
-  std::cout << *placesResult << std::endl;
+  std::cout << placesResult << std::endl;
+  const int status = placesResult.err ? 1 : 0;
   
   // Free resouces
-  clnt_freeres(clnt, (xdrproc_t)xdr_places_ret, (caddr_t)(placesResult));
+  clnt_freeres(clnt, (xdrproc_t)xdr_places_ret, (caddr_t)(&placesResult));
   clnt_destroy(clnt);
   
-  exit(1);
+  return status;
 }
 
 void showUsageAndExit() {
@@ -63,16 +89,28 @@ void showUsageAndExit() {
   exit(1);
 }
 
-void parseArgs(int argc, char **argv, char **host, places_req &req) {
+bool parseArgs(int argc, char **argv, char **host, places_req &req) {
   bool isLatLongQuery = false;
+  bool isBatch = false;
+  bool isComplete = false;
+  bool isFuzzy = false;
   
   int c;
   
-  while((c = getopt(argc, argv, "p")) != -1) {
+  while((c = getopt(argc, argv, "pbcf")) != -1) {
     switch (c) {
       case 'p':
         isLatLongQuery = true;
         break;
+      case 'b':
+        isBatch = true;
+        break;
+      case 'c':
+        isComplete = true;
+        break;
+      case 'f':
+        isFuzzy = true;
+        break;
       case '?':
         if (isprint(optopt))
           std::cerr << "Unknown option '-" << (char)optopt << "'.\n";
@@ -88,6 +126,35 @@ void parseArgs(int argc, char **argv, char **host, places_req &req) {
   argc -= optind;
   argv += optind;
   
+  if (isFuzzy) {
+    if (argc < 2 || 3 < argc || isLatLongQuery || isBatch || isComplete)
+      showUsageAndExit();
+    const name_state named{ argv[1], (argc == 3) ? argv[2] : (char*)"" };
+    exit(runFuzzy(argv[0], named));
+  }
+  
+  if (isComplete) {
+    if (argc < 2 || 3 < argc || isLatLongQuery || isBatch) showUsageAndExit();
+    int maxResults = MAX_COMPLETIONS;
+    if (argc == 3) {
+      try {
+        maxResults = std::stoi(argv[2]);
+      }
+      catch (...) {
+        std::cerr << "Invalid count argument." << std::endl;
+        exit(1);
+      }
+    }
+    exit(runComplete(argv[0], argv[1], maxResults));
+  }
+  
+  if (isBatch) {
+    if (argc != 1) showUsageAndExit();
+    *host = argv[0];
+    req.req_type = isLatLongQuery ? REQ_LAT_LONG : REQ_NAMED;
+    return true;
+  }
+  
   if (argc < 2 || 3 < argc ||
     (isLatLongQuery && argc !=3)) {
     showUsageAndExit();
@@ -114,4 +181,122 @@ void parseArgs(int argc, char **argv, char **host, places_req &req) {
     req.places_req_u.loc.latitude = latitude;
     req.places_req_u.loc.longitude = longitude;
   }
-}
\ No newline at end of file
+  
+  return false;
+}
+
+// Sends one batch and prints every reply. Returns false on RPC failure.
+static bool sendBatch(CLIENT *clnt, std::vector<places_req> &reqs) {
+  places_reqs args{ (u_int)reqs.size(), reqs.data() };
+  places_batch_ret batchResult{};
+  
+  if (places_qry_batch_1(&args, &batchResult, clnt) != RPC_SUCCESS) {
+    clnt_perror(clnt, "call failed");
+    return false;
+  }
+  
+  if (batchResult.err) {
+    std::cout << "Error: " << batchResult.places_batch_ret_u.err_msg << std::endl;
+  } else {
+    const auto &rets = batchResult.places_batch_ret_u.results;
+    for (u_int i = 0; i < rets.places_rets_len; ++i)
+      std::cout << rets.places_rets_val[i] << std::endl;
+  }
+  
+  clnt_freeres(clnt, (xdrproc_t)xdr_places_batch_ret, (caddr_t)&batchResult);
+  return true;
+}
+
+int runBatch(const char *host, const bool isLatLongQuery) {
+  // Batch replies outgrow a UDP datagram
+  CLIENT *clnt = clnt_create(host, PLACES_PROG, PLACES_VERS, "tcp");
+  if (clnt == NULL) {
+    clnt_pcreateerror(host);
+    return 1;
+  }
+  
+  std::vector<places_req> reqs;
+  std::vector<std::string> names;   // Backing storage of named requests
+  names.reserve(2 * MAX_BATCH);
+  
+  bool ok = true;
+  std::string line;
+  while (ok && std::getline(std::cin, line)) {
+    if (line.empty()) continue;
+    
+    places_req req{};
+    req.req_type = isLatLongQuery ? REQ_LAT_LONG : REQ_NAMED;
+    if (isLatLongQuery) {
+      std::istringstream strm(line);
+      if (!(strm >> req.places_req_u.loc.latitude
+                 >> req.places_req_u.loc.longitude)) {
+        std::cerr << "Skipping invalid latitude / longitude: " << line << "\n";
+        continue;
+      }
+    } else {
+      const auto comma = line.rfind(',');
+      names.push_back(line.substr(0, comma));
+      req.places_req_u.named.name = (char *)names.back().c_str();
+      names.push_back(comma == std::string::npos ? "" : line.substr(comma + 1));
+      req.places_req_u.named.state = (char *)names.back().c_str();
+    }
+    reqs.push_back(req);
+    
+    if (reqs.size() == MAX_BATCH) {
+      ok = sendBatch(clnt, reqs);
+      reqs.clear();
+      names.clear();
+    }
+  }
+  
+  if (ok && !reqs.empty()) ok = sendBatch(clnt, reqs);
+  
+  clnt_destroy(clnt);
+  return ok ? 0 : 1;
+}
+
+int runComplete(const char *host, char *prefix, const int maxResults) {
+  CLIENT *clnt = clnt_create(host, PLACES_PROG, PLACES_VERS, "udp");
+  if (clnt == NULL) {
+    clnt_pcreateerror(host);
+    return 1;
+  }
+  
+  complete_req req{ prefix, maxResults };
+  complete_ret compResult{};
+  if (places_complete_1(&req, &compResult, clnt) != RPC_SUCCESS) {
+    clnt_perror(clnt, "call failed");
+    clnt_destroy(clnt);
+    return 1;
+  }
+  
+  std::cout << compResult << std::endl;
+  const int status = compResult.err ? 1 : 0;
+  
+  clnt_freeres(clnt, (xdrproc_t)xdr_complete_ret, (caddr_t)&compResult);
+  clnt_destroy(clnt);
+  return status;
+}
+
+int runFuzzy(const char *host, const name_state &named) {
+  CLIENT *clnt = clnt_create(host, PLACES_PROG, PLACES_VERS, "udp");
+  if (clnt == NULL) {
+    clnt_pcreateerror(host);
+    return 1;
+  }
+  
+  fuzzy_req req{ named, MAX_EDIT_DISTANCE, MAX_FUZZY_MATCHES };
+  fuzzy_ret fuzzyResult{};
+  if (places_fuzzy_1(&req, &fuzzyResult, clnt) != RPC_SUCCESS) {
+    clnt_perror(clnt, "call failed");
+    clnt_destroy(clnt);
+    return 1;
+  }
+  
+  std::cout << fuzzyResult << std::endl;
+  const int status = fuzzyResult.err ? 1 : 0;
+  
+  clnt_freeres(clnt, (xdrproc_t)xdr_fuzzy_ret, (caddr_t)&fuzzyResult);
+  clnt_destroy(clnt);
+  return status;
+}
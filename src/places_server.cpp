@@ -3,6 +3,9 @@
  * Author: Ben Targan
  *   Desc: Places Server
  ******************************************************************************/
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <rpc/pmap_clnt.h>
@@ -10,29 +13,122 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
+#include "airport_lookup.h"
 #include "airports/airports.h"
+#include "lru_cache.h"
+#include "places/airports_pool.h"
 #include "places/places.h"
 #include "places/trie.h"
+#include "rpc_async.h"
+#include "single_flight.h"
+#include "stats.h"
+#include "svc_pool.h"
 
 #ifndef SIG_PF
 #define SIG_PF void(*)(int)
 #endif
 
-// Result of the places server call used in this module
-static places_ret placesResult = { };
+// Long-lived client handles to the airports server provided by the user
+static std::unique_ptr<AirportsClientPool> airportsPool;
 
-// Host of the airports server provided by the user
-static char* airportsHost;
+// Event loop transport serving UDP requests when started with -A, and its
+// client keeping many airports server calls in flight on one socket
+static std::unique_ptr<AsyncUdpServer> asyncServer;
+static std::unique_ptr<AsyncRpcClient> asyncAirports;
+
+// Places being served, loaded before any worker thread starts and reloaded
+// by the refresh thread when their files change
+static AirportLookup lookup;
+
+// Places the requests of this thread read, pinned by a PlacesPin
+static thread_local std::shared_ptr<const Trie> pinned;
+
+// Keeps the places the calling thread reads from being released by a refresh
+// while in scope. Requests hold one from start to end so the records they
+// found stay valid.
+struct PlacesPin {
+  PlacesPin() { pinned = lookup.servedPlaces(); }
+  ~PlacesPin() { pinned.reset(); }
+};
+
+// Places of the request being served
+static const Trie &places() {
+  return *pinned;
+}
+
+// Named lookups answered from the precomputed closest airports
+static StatCounter nearestHits("places.nearest_table_hits");
+
+// Counters of the reloads of the places
+static StatCounter refreshes("places.refreshes");
+static StatCounter refreshFailures("places.refresh_failures");
+
+// Airport of a cached result, strings copied in so entries own their memory
+struct CachedAirport {
+  location loc;
+  double   dist;
+  char     code[MAX_AIRCODE];
+  char     name[MAX_NAME];
+  char     state[MAX_STATE];
+};
+using TCachedAirports = std::array<CachedAirport, NRESULTS>;
+
+// Airports server results of recently queried grid cells, none unless the
+// cache was sized on the command line
+static std::unique_ptr<ShardedLruCache<GridKey, TCachedAirports, GridKeyHash>>
+  resultCache;
+static int cacheDecimals = 4;
+
+static StatCounter cacheHits("places_cache.hits");
+static StatCounter cacheMisses("places_cache.misses");
+static StatCounter cacheEvictions("places_cache.evictions");
+
+// Outcome of an airports server lookup, shared by coalesced requests
+struct AirportsOutcome {
+  bool            ok = false;
+  TCachedAirports airports;   // Closest airports when ok
+  std::string     error;      // Error message otherwise
+};
+
+// Concurrent lookups of one location share a single airports server call, on
+// the worker threads and on the event loop alike
+static StatCounter coalesceRequests("places_coalesce.requests");
+static StatCounter coalesceCalls("places_coalesce.calls");
+static StatRatio collapseRatio("places_coalesce.collapse_ratio",
+                               coalesceRequests, coalesceCalls);
+static SingleFlight<GridKey, AirportsOutcome, GridKeyHash> inFlight(
+  FlightCounters{&coalesceRequests, &coalesceCalls});
+static AsyncSingleFlight<GridKey, AirportsOutcome, GridKeyHash> asyncInFlight(
+  FlightCounters{&coalesceRequests, &coalesceCalls});
+
+// Transport used to reach the airports server
+static AirportsClientPool::Transport airportsTransport =
+  AirportsClientPool::Transport::UDP;
 
 // Places server RPC program handle registered with rpcbind (auto-generated)
 static void places_prog_1(struct svc_req *rqstp, register SVCXPRT *transp) {
 	union {
 		places_req places_qry_1_arg;
+		places_reqs places_qry_batch_1_arg;
+		complete_req places_complete_1_arg;
+		fuzzy_req places_fuzzy_1_arg;
 	} argument{};
-	char *result;
+	union {
+		places_ret places_qry_1_res;
+		places_batch_ret places_qry_batch_1_res;
+		complete_ret places_complete_1_res;
+		fuzzy_ret places_fuzzy_1_res;
+	} result{};
+	bool_t retval;
 	xdrproc_t _xdr_argument, _xdr_result;
-	char *(*local)(char *, struct svc_req *);
+	bool_t (*local)(char *, void *, struct svc_req *);
+
+	// Records found stay valid until the reply is sent, whatever a refresh does
+	PlacesPin pin;
 
 	switch (rqstp->rq_proc) {
 	case NULLPROC:
@@ -42,7 +138,25 @@ static void places_prog_1(struct svc_req *rqstp, register SVCXPRT *transp) {
 	case PLACES_QRY:
 		_xdr_argument = (xdrproc_t) xdr_places_req;
 		_xdr_result = (xdrproc_t) xdr_places_ret;
-		local = (char *(*)(char *, struct svc_req *)) places_qry_1_svc;
+		local = (bool_t (*)(char *, void *, struct svc_req *)) places_qry_1_svc;
+		break;
+
+	case PLACES_QRY_BATCH:
+		_xdr_argument = (xdrproc_t) xdr_places_reqs;
+		_xdr_result = (xdrproc_t) xdr_places_batch_ret;
+		local = (bool_t (*)(char *, void *, struct svc_req *)) places_qry_batch_1_svc;
+		break;
+
+	case PLACES_COMPLETE:
+		_xdr_argument = (xdrproc_t) xdr_complete_req;
+		_xdr_result = (xdrproc_t) xdr_complete_ret;
+		local = (bool_t (*)(char *, void *, struct svc_req *)) places_complete_1_svc;
+		break;
+
+	case PLACES_FUZZY:
+		_xdr_argument = (xdrproc_t) xdr_fuzzy_req;
+		_xdr_result = (xdrproc_t) xdr_fuzzy_ret;
+		local = (bool_t (*)(char *, void *, struct svc_req *)) places_fuzzy_1_svc;
 		break;
 
 	default:
@@ -54,23 +168,94 @@ static void places_prog_1(struct svc_req *rqstp, register SVCXPRT *transp) {
 		svcerr_decode (transp);
 		return;
 	}
-	result = (*local)((char *)&argument, rqstp);
-	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+	retval = (*local)((char *)&argument, (void *)&result, rqstp);
+	if (retval > 0 && !svc_sendreply(transp, (xdrproc_t) _xdr_result, (char *)&result)) {
 		svcerr_systemerr (transp);
 	}
 	if (!svc_freeargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
 		fprintf (stderr, "%s", "unable to free arguments");
 		exit (1);
 	}
+	if (!places_prog_1_freeresult (transp, _xdr_result, (caddr_t) &result))
+		fprintf (stderr, "%s", "unable to free results");
 }
 
+// Places server dispatch routine of the event loop transport, replies to
+// calls needing the airports server once it answered
+static void placesAsyncDispatch(const AsyncUdpServer::Call &call, XDR *args);
+
+// Seconds between checks of the places and airports files for changes
+static constexpr unsigned REFRESH_PERIOD_SECONDS = 5;
+
+// Starts a thread checking the places and airports files every
+// REFRESH_PERIOD_SECONDS and swapping in places rebuilt from them when either
+// changed. A failed rebuild keeps serving the previous ones.
+static void startPlacesRefresh() {
+  std::thread([]() {
+    for (;;) {
+      std::this_thread::sleep_for(std::chrono::seconds(REFRESH_PERIOD_SECONDS));
+      try {
+        if (lookup.refreshPlaces()) refreshes.inc();
+      }
+      catch (const std::exception &e) {
+        refreshFailures.inc();
+        fprintf(stderr, "Places refresh failed, serving the previous ones: "
+                "%s\n", e.what());
+      }
+    }
+  }).detach();
+}
+
+// Usage of the server
+static const char *USAGE =
+  "usage: %s [-A] [-T] [-t threads] [-a airportsFile] [-c cacheMB] "
+  "[-g gridDecimals] <airports-host> [placesFile]\n";
+
 int main (int argc, char **argv) {
+  unsigned nThreads = 1;
+  const char *airportsPath = nullptr;
+  size_t cacheMB = 0;
+  bool asyncUdp = false;
+  int c;
+  while ((c = getopt(argc, argv, "ATa:c:g:t:")) != -1) {
+    switch (c) {
+      case 'A':
+        asyncUdp = true;
+        break;
+      case 'T':
+        airportsTransport = AirportsClientPool::Transport::TCP;
+        break;
+      case 'a':
+        airportsPath = optarg;
+        break;
+      case 'c':
+        cacheMB = std::strtoul(optarg, nullptr, 10);
+        break;
+      case 'g':
+        cacheDecimals = std::atoi(optarg);
+        if (cacheDecimals < 0 || cacheDecimals > MAX_GRID_DECIMALS) {
+          printf("Grid decimals must be 0 to %d\n", MAX_GRID_DECIMALS);
+          exit(1);
+        }
+        break;
+      case 't':
+        nThreads = parseThreadCount(optarg);
+        break;
+      default:
+        printf(USAGE, argv[0]);
+        exit(1);
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  
   if (argc < 2 || 3 < argc) {
-    printf("usage: %s <airports-host> [airportsFile]\n", argv[0]);
+    printf(USAGE, argv[0]);
     exit(1);
   }
   
-  airportsHost = argv[1];
+  airportsPool = std::unique_ptr<AirportsClientPool>(
+    new AirportsClientPool(argv[1]));
   const char* placesPath = "places2k.txt";
   
   if (argc == 3) {
@@ -79,20 +264,60 @@ int main (int argc, char **argv) {
     printf("Note: places file path not specified, using `places2k.txt`\n");
   }
   
-  initTrie(placesPath);
+  // Trie is fully built before any worker thread starts reading it. With the
+  // airports file named places are answered from their precomputed closest
+  // airports, rebuilt whenever either file changes.
+  try {
+    lookup.loadPlaces(placesPath, airportsPath);
+  }
+  catch (const std::exception &e) {
+    exitWithMessage(e.what());
+  }
+  if (airportsPath != nullptr) startPlacesRefresh();
+  
+  // Locations in one grid cell share the airports of the first one queried
+  if (cacheMB > 0) {
+    resultCache.reset(new ShardedLruCache<GridKey, TCachedAirports,
+                                          GridKeyHash>(
+      cacheMB << 20, CacheCounters{&cacheHits, &cacheMisses, &cacheEvictions}));
+  }
+  installStatsDumpHandler();
   
 	register SVCXPRT *transp;
 
 	pmap_unset (PLACES_PROG, PLACES_VERS);
 
-	transp = svcudp_create(RPC_ANYSOCK);
-	if (transp == NULL) {
-		fprintf (stderr, "%s", "cannot create udp service.");
-		exit(1);
+	if (asyncUdp) {
+		// One thread serves every UDP request, none waits on the airports server
+		try {
+			asyncServer.reset(new AsyncUdpServer(PLACES_PROG, PLACES_VERS,
+			                                     placesAsyncDispatch));
+		} catch (const std::runtime_error &e) {
+			fprintf (stderr, "%s", e.what());
+			exit(1);
+		}
+		asyncAirports.reset(new AsyncRpcClient(argv[1], AIRPORTS_PROG,
+		                                       AIRPORTS_VERS));
+		if (!asyncServer->registerPortmapper()) {
+			fprintf (stderr, "%s", "unable to register (PLACES_PROG, PLACES_VERS, udp).");
+			exit(1);
+		}
 	}
-	if (!svc_register(transp, PLACES_PROG, PLACES_VERS, places_prog_1, IPPROTO_UDP)) {
-		fprintf (stderr, "%s", "unable to register (PLACES_PROG, PLACES_VERS, udp).");
-		exit(1);
+	else {
+		transp = nThreads > 1 ? svcUdpCreateShared() : svcudp_create(RPC_ANYSOCK);
+		if (transp == NULL) {
+			fprintf (stderr, "%s", "cannot create udp service.");
+			exit(1);
+		}
+		if (!svc_register(transp, PLACES_PROG, PLACES_VERS, places_prog_1, IPPROTO_UDP)) {
+			fprintf (stderr, "%s", "unable to register (PLACES_PROG, PLACES_VERS, udp).");
+			exit(1);
+		}
+		if (!svcAddUdpReplicas(transp, PLACES_PROG, PLACES_VERS, places_prog_1,
+		                       nThreads - 1)) {
+			fprintf (stderr, "%s", "unable to create udp worker transports.");
+			exit(1);
+		}
 	}
 
 	transp = svctcp_create(RPC_ANYSOCK, 0, 0);
@@ -105,7 +330,19 @@ int main (int argc, char **argv) {
 		exit(1);
 	}
 
-	svc_run ();
+	if (asyncUdp) {
+		// TCP stays on the svc transports, served by the pool on its own thread
+		std::thread([nThreads]() {
+			svcRunPool(nThreads);
+			fprintf (stderr, "%s", "svc_run returned");
+			exit (1);
+		}).detach();
+		runEventLoop({ asyncServer.get(), asyncAirports.get() });
+		fprintf (stderr, "%s", "event loop returned");
+		exit (1);
+	}
+
+	svcRunPool(nThreads);
 	fprintf (stderr, "%s", "svc_run returned");
 	exit (1);
 	/* NOTREACHED */
@@ -114,65 +351,415 @@ int main (int argc, char **argv) {
 // RPC server program logic and service routine below
 
 // Helper to return the error result
-places_ret *errorResult(const std::string& msg);
+places_ret *errorResult(places_ret *res, const std::string& msg);
 
 // Helper to construct an ambiguous result error message
 std::string buildAmbiguousErrorMsg(const TrieQueryResult &found);
 
 // Helper to set the place in result to be from a trie
-void setPlaceCityRecord(const CityRecord &cityRec);
+void setPlaceCityRecord(places_ret *res, const CityRecord &cityRec);
+
+// Helper to copy a city record from the trie into a place
+void copyPlace(place &pl, const CityRecord &cityRec);
 
 // Helper to set the place in result to be a lat/long point user wanted
-void setPlaceLatLong(const location &loc);
+void setPlaceLatLong(places_ret *res, const location &loc);
+
+// Helper to set the airports in result to the precomputed closest airports of
+// a place. Returns false when they are not precomputed.
+bool setPlaceNearestAirports(places_ret *res, const CityRecord &cityRec);
+
+// Helper to set the airports in result to the cached airports server results
+// of its grid cell. Returns false when they are not cached.
+bool setCachedAirports(places_ret *res, const location &loc);
+
+// Helper to cache the airports server results in result for its grid cell.
+void cacheAirports(const places_ret *res, const location &loc);
+
+// Helper to copy the airports in result into a cache entry
+void copyAirports(const places_ret *res, TCachedAirports &airports);
+
+// Helper to set the airports in result from a cache entry
+void setAirports(places_ret *res, const TCachedAirports &airports);
+
+// Helper to copy the airports or error of a result so coalesced requests can
+// share it
+AirportsOutcome outcomeOf(const places_ret *res);
+
+// Helper to set the airports or error of a shared outcome in result
+void setOutcome(places_ret *res, const AirportsOutcome &outcome);
+
+// Key coalesced lookups of a location share, the cache grid cell when
+// caching so a cell is called once, else the location itself
+static int flightDecimals() {
+  return resultCache ? cacheDecimals : MAX_GRID_DECIMALS;
+}
+
+// Helper to resolve the place of a request. Returns true when the result
+// still needs the closest airports of its place, false when it is an error or
+// they were precomputed or cached.
+bool resolvePlace(const places_req *req, places_ret *res);
+
+// Helper to resolve every place of a batch into result. Returns the indices
+// of the results still needing the closest airports of their place.
+std::vector<u_int> resolveBatch(const places_reqs *reqs,
+                                places_batch_ret *result);
+
+// Helper to move the airports of an airports server result into result, or
+// its error. Successful results are cached for the location.
+void takeAirportsResult(places_ret *res, airports_ret *airportsResult,
+                        const location &loc);
+
+// Helper to move the airports of an airports server batch result into the
+// results at the given indices, or its error. Successful results are cached
+// for their location.
+void takeAirportsBatchResult(places_ret *rets, const u_int *indices, size_t n,
+                             airports_batch_ret *batchResult);
+
+// Helper to set the error result of a failed airports server call
+places_ret *airportsCallError(places_ret *res, clnt_stat stat);
 
 // Helper to connect and query the airports server. Results forwarded to user.
-places_ret *airportsQueryResult(location *ploc);
+places_ret *callAirportsServer(places_ret *res, location *ploc);
+
+// Helper to query the airports server, sharing the call of any concurrent
+// query of the same location. Results forwarded to user.
+places_ret *airportsQueryResult(places_ret *res, location *ploc);
+
+// Helper to query the airports server for the results at the given indices
+// in one batch call. Results forwarded to user.
+void airportsBatchQueryResults(places_ret *rets,
+                               const std::vector<u_int> &pending);
+
+bool_t places_qry_1_svc(places_req *req, places_ret *result,
+                        struct svc_req *rqstp) {
+  // Result is owned by the calling dispatcher and freed once sent
+  *result = { };
+  
+  // places server will return the results of the call to airports server
+  if (resolvePlace(req, result)) {
+    location *loc = &result->places_ret_u.results.request.loc;
+    airportsQueryResult(result, loc);
+  }
+  return TRUE;
+}
+
+bool_t places_qry_batch_1_svc(places_reqs *reqs, places_batch_ret *result,
+                              struct svc_req *rqstp) {
+  // Resolve every place locally first, then fetch all airports in one call
+  const auto pending = resolveBatch(reqs, result);
+  if (!pending.empty()) {
+    airportsBatchQueryResults(result->places_batch_ret_u.results.places_rets_val,
+                              pending);
+  }
+  return TRUE;
+}
 
-places_ret *places_qry_1_svc(places_req *req, struct svc_req *rqstp) {
-  static std::string errorMessage;
+bool_t places_complete_1_svc(complete_req *req, complete_ret *result,
+                              struct svc_req *rqstp) {
+  *result = { };
+  if (req->max_results <= 0) {
+    result->err = 1;
+    result->complete_ret_u.err_msg = strdup("max_results must be positive.");
+    return TRUE;
+  }
   
-  // Free previously allocated memory
-  xdr_free((xdrproc_t)xdr_places_ret, (char*)&placesResult);
+  // Served straight from the ranked lists of the trie, no airports call
+  const auto found = places().complete(req->prefix,
+                                       (size_t)req->max_results);
+  auto &comps = result->complete_ret_u.results;
+  comps.completions_val =
+    (completion *)calloc(std::max<size_t>(found.size(), 1), sizeof(completion));
+  if (comps.completions_val == nullptr) {
+    result->err = 1;
+    result->complete_ret_u.err_msg = strdup("Out of memory.");
+    return TRUE;
+  }
+  comps.completions_len = (u_int)found.size();
+  
+  for (size_t i = 0; i < found.size(); ++i) {
+    const CityRecord &rec = found[i].get();
+    copyPlace(comps.completions_val[i].pl, rec);
+    comps.completions_val[i].population = rec.population;
+  }
+  return TRUE;
+}
+
+bool_t places_fuzzy_1_svc(fuzzy_req *req, fuzzy_ret *result,
+                          struct svc_req *rqstp) {
+  *result = { };
+  if (req->max_distance < 0 || req->max_results <= 0) {
+    result->err = 1;
+    result->fuzzy_ret_u.err_msg =
+      strdup("max_distance must not be negative, max_results positive.");
+    return TRUE;
+  }
+  
+  // Edits beyond MAX_EDIT_DISTANCE are capped by the trie
+  const auto found = places().fuzzy(req->named.name, req->named.state,
+                                    (size_t)req->max_distance,
+                                    (size_t)req->max_results);
+  auto &matches = result->fuzzy_ret_u.results;
+  matches.fuzzy_matches_val =
+    (fuzzy_match *)calloc(std::max<size_t>(found.size(), 1),
+                          sizeof(fuzzy_match));
+  if (matches.fuzzy_matches_val == nullptr) {
+    result->err = 1;
+    result->fuzzy_ret_u.err_msg = strdup("Out of memory.");
+    return TRUE;
+  }
+  matches.fuzzy_matches_len = (u_int)found.size();
   
-  // Clear previous state
-  placesResult = { };
-  errorMessage.clear();
+  for (size_t i = 0; i < found.size(); ++i) {
+    const CityRecord &rec = found[i].place.get();
+    auto &match = matches.fuzzy_matches_val[i];
+    copyPlace(match.pl, rec);
+    match.distance = found[i].distance;
+    match.population = rec.population;
+  }
+  return TRUE;
+}
+
+// Asynchronous frontend
+/******************************************************************************/
+
+// Serves a procedure that needs no airports server call right away, with the
+// same service routine as the svc transports
+template<typename TArgs, typename TRes>
+static void serveNow(const AsyncUdpServer::Call &call, XDR *xdrs,
+                     const xdrproc_t xargs, const xdrproc_t xres,
+                     bool_t (*local)(TArgs *, TRes *, struct svc_req *)) {
+  TArgs args{};
+  if (!xargs(xdrs, &args)) {
+    xdr_free(xargs, (char *)&args);
+    asyncServer->replyError(call, GARBAGE_ARGS);
+    return;
+  }
+  
+  TRes res{};
+  local(&args, &res, nullptr);
+  asyncServer->reply(call, xres, &res);
+  xdr_free(xargs, (char *)&args);
+  xdr_free(xres, (char *)&res);
+}
+
+// Calls the airports server for the closest airports of a location without
+// waiting for the reply, done gets the outcome on the event loop
+static void callAirportsAsync(
+  const location &loc, std::function<void(const AirportsOutcome &)> done) {
+  asyncAirports->call(AIRPORTS_QRY, (xdrproc_t)xdr_location, &loc,
+                      (xdrproc_t)xdr_airports_ret, sizeof(airports_ret),
+                      [=](clnt_stat stat, void *airportsResult) {
+    places_ret res{};
+    if (stat == RPC_SUCCESS)
+      takeAirportsResult(&res, (airports_ret *)airportsResult, loc);
+    else
+      airportsCallError(&res, stat);
+    const AirportsOutcome outcome = outcomeOf(&res);
+    xdr_free((xdrproc_t)xdr_places_ret, (char *)&res);
+    done(outcome);
+  });
+}
+
+// Queries the airports server for the closest airports of a result without
+// waiting for the reply, done runs on the event loop once they are set.
+// Queries of a location already being called wait for that call instead.
+static void airportsQueryAsync(places_ret *res, std::function<void()> done) {
+  const location loc = res->places_ret_u.results.request.loc;
+  const auto setResult = [res, done](const AirportsOutcome &outcome) {
+    setOutcome(res, outcome);
+    done();
+  };
   
+  GridKey key;
+  if (!gridKey(loc, flightDecimals(), key)) {
+    callAirportsAsync(loc, setResult);
+  }
+  else if (asyncInFlight.join(key, setResult)) {
+    callAirportsAsync(loc, [key](const AirportsOutcome &outcome) {
+      asyncInFlight.finish(key, outcome);
+    });
+  }
+}
+
+// Resolves a place and replies, after the airports server answered when the
+// closest airports are neither precomputed nor cached
+static void serveQueryAsync(const AsyncUdpServer::Call &call, XDR *xdrs) {
+  places_req req{};
+  if (!xdr_places_req(xdrs, &req)) {
+    xdr_free((xdrproc_t)xdr_places_req, (char *)&req);
+    asyncServer->replyError(call, GARBAGE_ARGS);
+    return;
+  }
+  
+  // Result lives until the reply is sent, whenever that is
+  auto res = std::make_shared<places_ret>();
+  const bool needsAirports = resolvePlace(&req, res.get());
+  xdr_free((xdrproc_t)xdr_places_req, (char *)&req);
+  
+  const auto reply = [call, res]() {
+    asyncServer->reply(call, (xdrproc_t)xdr_places_ret, res.get());
+    xdr_free((xdrproc_t)xdr_places_ret, (char *)res.get());
+  };
+  if (needsAirports)
+    airportsQueryAsync(res.get(), reply);
+  else
+    reply();
+}
+
+// Resolves the places of a batch and replies once the airports server
+// answered for all of them, in one batch call. Batches whose airports could
+// outgrow a datagram are split into several calls, all in flight at once.
+static void serveBatchAsync(const AsyncUdpServer::Call &call, XDR *xdrs) {
+  places_reqs reqs{};
+  if (!xdr_places_reqs(xdrs, &reqs)) {
+    xdr_free((xdrproc_t)xdr_places_reqs, (char *)&reqs);
+    asyncServer->replyError(call, GARBAGE_ARGS);
+    return;
+  }
+  
+  auto result = std::make_shared<places_batch_ret>();
+  const auto pending = resolveBatch(&reqs, result.get());
+  xdr_free((xdrproc_t)xdr_places_reqs, (char *)&reqs);
+  
+  const auto reply = [call, result]() {
+    asyncServer->reply(call, (xdrproc_t)xdr_places_batch_ret, result.get());
+    xdr_free((xdrproc_t)xdr_places_batch_ret, (char *)result.get());
+  };
+  if (pending.empty()) {
+    reply();
+    return;
+  }
+  
+  places_ret *rets = result->places_batch_ret_u.results.places_rets_val;
+  auto remaining = std::make_shared<size_t>(
+    (pending.size() + MAX_UDP_BATCH - 1) / MAX_UDP_BATCH);
+  for (size_t begin = 0; begin < pending.size(); begin += MAX_UDP_BATCH) {
+    const std::vector<u_int> chunk(
+      pending.begin() + begin,
+      pending.begin() + std::min(begin + MAX_UDP_BATCH, pending.size()));
+    std::vector<location> locs;
+    locs.reserve(chunk.size());
+    for (const u_int i : chunk)
+      locs.push_back(rets[i].places_ret_u.results.request.loc);
+    
+    locations args{ (u_int)locs.size(), locs.data() };
+    asyncAirports->call(AIRPORTS_QRY_BATCH, (xdrproc_t)xdr_locations, &args,
+                        (xdrproc_t)xdr_airports_batch_ret,
+                        sizeof(airports_batch_ret),
+                        [=](clnt_stat stat, void *batchResult) {
+      if (stat == RPC_SUCCESS) {
+        takeAirportsBatchResult(rets, chunk.data(), chunk.size(),
+                                (airports_batch_ret *)batchResult);
+      }
+      else {
+        for (const u_int i : chunk) airportsCallError(&rets[i], stat);
+      }
+      if (--*remaining == 0) reply();
+    });
+  }
+}
+
+static void placesAsyncDispatch(const AsyncUdpServer::Call &call, XDR *args) {
+  // Records found stay valid while the places are resolved
+  PlacesPin pin;
+  
+  switch (call.proc) {
+    case PLACES_QRY:
+      serveQueryAsync(call, args);
+      break;
+    case PLACES_QRY_BATCH:
+      serveBatchAsync(call, args);
+      break;
+    case PLACES_COMPLETE:
+      serveNow(call, args, (xdrproc_t)xdr_complete_req,
+               (xdrproc_t)xdr_complete_ret, places_complete_1_svc);
+      break;
+    case PLACES_FUZZY:
+      serveNow(call, args, (xdrproc_t)xdr_fuzzy_req,
+               (xdrproc_t)xdr_fuzzy_ret, places_fuzzy_1_svc);
+      break;
+    default:
+      asyncServer->replyError(call, PROC_UNAVAIL);
+  }
+}
+
+// Helpers
+/******************************************************************************/
+
+std::vector<u_int> resolveBatch(const places_reqs *reqs,
+                                places_batch_ret *result) {
+  *result = { };
+  const u_int n = reqs->places_reqs_len;
+  auto &rets = result->places_batch_ret_u.results;
+  
+  rets.places_rets_val = (places_ret *)calloc(n, sizeof(places_ret));
+  if (n > 0 && rets.places_rets_val == nullptr) {
+    result->err = 1;
+    result->places_batch_ret_u.err_msg = strdup("Out of memory.");
+    return { };
+  }
+  rets.places_rets_len = n;
+  
+  std::vector<u_int> pending;
+  pending.reserve(n);
+  for (u_int i = 0; i < n; ++i) {
+    if (resolvePlace(&reqs->places_reqs_val[i], &rets.places_rets_val[i]))
+      pending.push_back(i);
+  }
+  return pending;
+}
+
+bool resolvePlace(const places_req *req, places_ret *res) {
   if (req->req_type == REQ_NAMED) {
     // Perform a query on the trie and resolve ambiguity if can
-    const auto found = queryPlace(req->places_req_u.named);
+    const auto &named = req->places_req_u.named;
+    const auto found = queryPlace(places(), named.name, named.state);
     
     // Trie could not find any matches
     if (found.places.empty()) {
-      return errorResult("Place not found.");
+      errorResult(res, "Place not found.");
+      return false;
     }
     // Trie search is ambiguous and returned the first and last in range
     else if (found.isAmbiguous) {
-      return errorResult(buildAmbiguousErrorMsg(found));
+      errorResult(res, buildAmbiguousErrorMsg(found));
+      return false;
     }
     else {
       const auto &foundRec = found.places.front().get();
-      setPlaceCityRecord(foundRec);
+      setPlaceCityRecord(res, foundRec);
+      
+      // Named places may not need the airports server at all
+      if (setPlaceNearestAirports(res, foundRec)) return false;
     }
   }
   
   // Lat / long request from client bypasses trie search
   else if (req->req_type == REQ_LAT_LONG) {
-    setPlaceLatLong(req->places_req_u.loc);
+    setPlaceLatLong(res, req->places_req_u.loc);
   }
   else {
-    return errorResult("Unrecognized request type.");
+    errorResult(res, "Unrecognized request type.");
+    return false;
   }
   
-  // places server will return the results of the call to airports server
-  location *loc = &placesResult.places_ret_u.results.request.loc;
-  return airportsQueryResult(loc);
+  return !setCachedAirports(res, res->places_ret_u.results.request.loc);
+}
+
+int places_prog_1_freeresult(SVCXPRT *transp, xdrproc_t xdr_result,
+                             caddr_t result) {
+  xdr_free(xdr_result, result);
+  return 1;
 }
 
-places_ret *errorResult(const std::string& msg) {
-  placesResult.err = 1;
-  placesResult.places_ret_u.err_msg = strdup(msg.c_str());
-  return &placesResult;
+places_ret *errorResult(places_ret *res, const std::string& msg) {
+  // Drop anything already filled in for a successful result
+  xdr_free((xdrproc_t)xdr_places_ret, (char*)res);
+  *res = { };
+  res->err = 1;
+  res->places_ret_u.err_msg = strdup(msg.c_str());
+  return res;
 }
 
 std::string buildAmbiguousErrorMsg(const TrieQueryResult &found) {
@@ -180,22 +767,102 @@ std::string buildAmbiguousErrorMsg(const TrieQueryResult &found) {
   const auto &lst = found.places.back().get();
   
   std::stringstream strm;
-  strm << "Ambiguous result: " << fst.cityName << "," << fst.state << " .. "
-       << lst.cityName << "," << lst.state;
+  strm << "Ambiguous result: " << places().name(fst) << ","
+       << places().state(fst) << " .. " << places().name(lst) << ","
+       << places().state(lst);
   return strm.str();
 }
 
-void setPlaceCityRecord(const CityRecord &cityRec) {
-  auto& p1 = placesResult.places_ret_u.results.request;
+void setPlaceCityRecord(places_ret *res, const CityRecord &cityRec) {
+  copyPlace(res->places_ret_u.results.request, cityRec);
+}
+
+bool setPlaceNearestAirports(places_ret *res, const CityRecord &cityRec) {
+  const NearestAirports *table = places().nearest();
+  if (table == nullptr) return false;
+  
+  const NearestAirport *near = table->closest(places().index(cityRec));
+  for (size_t i = 0; i < NRESULTS; ++i) {
+    const AirportRecord &airp = table->airport(near[i]);
+    auto &result = res->places_ret_u.results.results[i];
+    result.loc = airp.loc;
+    result.dist = near[i].dist;
+    result.code = strdup(airp.code);
+    result.name = strdup(airp.name);
+    result.state = strdup(airp.state);
+  }
+  nearestHits.inc();
+  return true;
+}
+
+bool setCachedAirports(places_ret *res, const location &loc) {
+  GridKey key;
+  TCachedAirports cached;
+  if (!resultCache || !gridKey(loc, cacheDecimals, key) ||
+      !resultCache->get(key, cached))
+    return false;
   
-  p1.name = strdup(cityRec.cityName.c_str());
-  p1.state = strdup(cityRec.state.c_str());
-  p1.loc.latitude = cityRec.loc.latitude;
-  p1.loc.longitude = cityRec.loc.longitude;
+  setAirports(res, cached);
+  return true;
 }
 
-void setPlaceLatLong(const location &loc) {
-  auto& p1 = placesResult.places_ret_u.results.request;
+void cacheAirports(const places_ret *res, const location &loc) {
+  GridKey key;
+  if (!resultCache || res->err || !gridKey(loc, cacheDecimals, key)) return;
+  
+  TCachedAirports cached;
+  copyAirports(res, cached);
+  resultCache->put(key, cached);
+}
+
+void copyAirports(const places_ret *res, TCachedAirports &airports) {
+  airports = { };
+  for (size_t i = 0; i < NRESULTS; ++i) {
+    const auto &result = res->places_ret_u.results.results[i];
+    airports[i].loc = result.loc;
+    airports[i].dist = result.dist;
+    strncpy(airports[i].code, result.code, MAX_AIRCODE - 1);
+    strncpy(airports[i].name, result.name, MAX_NAME - 1);
+    strncpy(airports[i].state, result.state, MAX_STATE - 1);
+  }
+}
+
+void setAirports(places_ret *res, const TCachedAirports &airports) {
+  for (size_t i = 0; i < NRESULTS; ++i) {
+    auto &result = res->places_ret_u.results.results[i];
+    result.loc = airports[i].loc;
+    result.dist = airports[i].dist;
+    result.code = strdup(airports[i].code);
+    result.name = strdup(airports[i].name);
+    result.state = strdup(airports[i].state);
+  }
+}
+
+AirportsOutcome outcomeOf(const places_ret *res) {
+  AirportsOutcome outcome;
+  outcome.ok = !res->err;
+  if (outcome.ok)
+    copyAirports(res, outcome.airports);
+  else
+    outcome.error = res->places_ret_u.err_msg;
+  return outcome;
+}
+
+void setOutcome(places_ret *res, const AirportsOutcome &outcome) {
+  if (outcome.ok)
+    setAirports(res, outcome.airports);
+  else
+    errorResult(res, outcome.error);
+}
+
+void copyPlace(place &pl, const CityRecord &cityRec) {
+  pl.name = strdup(places().name(cityRec));
+  pl.state = strdup(places().state(cityRec));
+  pl.loc = cityRec.loc();
+}
+
+void setPlaceLatLong(places_ret *res, const location &loc) {
+  auto& p1 = res->places_ret_u.results.request;
   
   p1.name = strdup("Latitude / longitude coordinate");
   p1.state = strdup("  ");
@@ -203,36 +870,140 @@ void setPlaceLatLong(const location &loc) {
   p1.loc.longitude = loc.longitude;
 }
 
-places_ret *airportsQueryResult(location *ploc) {
-  CLIENT *clnt = clnt_create(airportsHost, AIRPORTS_PROG, AIRPORTS_VERS, "udp");
-  
-  if (clnt == nullptr) {
-    clnt_pcreateerror(airportsHost);
-    return errorResult("Unable to connect to airports server.");
-  }
-  
-  airports_ret *airportsResult = airports_qry_1(ploc, clnt);
-  if (airportsResult == nullptr) {
+// Failures of a call that a stale pooled handle gives: the connection broke,
+// or the server restarted on another port so UDP calls go unanswered (or
+// reach whatever took the port)
+static bool isStaleHandle(const clnt_stat stat) {
+  return stat == RPC_CANTSEND || stat == RPC_CANTRECV ||
+         stat == RPC_TIMEDOUT || stat == RPC_PROGUNAVAIL;
+}
+
+/**
+ * Runs an airports server call on a pooled handle. A pooled handle may have
+ * gone stale (e.g. airports server restarted), so a failure a stale handle
+ * gives gets one retry on a freshly created handle, which looks the server
+ * up again. The failed handle is always dropped.
+ * @param transport Transport of the handle to use
+ * @param call Callable doing the RPC on the given handle, returns its status
+ * @return Status of the last attempt, RPC_SYSTEMERROR when unable to connect
+ */
+template<typename TCall>
+static clnt_stat withAirportsClient(const AirportsClientPool::Transport transport,
+                                    TCall call) {
+  clnt_stat stat = RPC_SYSTEMERROR;
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    auto lease = attempt == 0 ? airportsPool->acquire(transport)
+                              : airportsPool->acquireNew(transport);
+    CLIENT *clnt = lease.get();
+    if (clnt == nullptr) return RPC_SYSTEMERROR;
+    
+    stat = call(clnt);
+    if (stat == RPC_SUCCESS) return stat;
+    
     clnt_perror (clnt, "call failed");
-    clnt_destroy(clnt);
-    return errorResult("Remote call to airports server failed.");
+    lease.markFailed();
+    if (!isStaleHandle(stat)) return stat;
   }
-  
+  return stat;
+}
+
+void takeAirportsResult(places_ret *res, airports_ret *airportsResult,
+                        const location &loc) {
   if (airportsResult->err) {
-    errorResult(airportsResult->airports_ret_u.error_msg);
+    errorResult(res, airportsResult->airports_ret_u.error_msg);
+    return;
   }
-  else {
-    // Instead of re-allocating memory for recieved airports server results,
-    // transger owenership of airports results to places results, the memory
-    // will then be freed on the next call to the places server
-    memcpy(&placesResult.places_ret_u.results.results[0],
-           &airportsResult->airports_ret_u.results[0],
-           sizeof(airports));
-    memset(&airportsResult->airports_ret_u.results[0], 0, sizeof(airports));
+  
+  // Instead of re-allocating memory for recieved airports server results,
+  // transger owenership of airports results to places results, the memory
+  // will then be freed once the places result has been sent
+  memcpy(&res->places_ret_u.results.results[0],
+         &airportsResult->airports_ret_u.results[0],
+         sizeof(airports));
+  memset(&airportsResult->airports_ret_u.results[0], 0, sizeof(airports));
+  cacheAirports(res, loc);
+}
+
+places_ret *airportsCallError(places_ret *res, const clnt_stat stat) {
+  if (stat == RPC_SYSTEMERROR)
+    return errorResult(res, "Unable to connect to airports server.");
+  return errorResult(res, "Remote call to airports server failed.");
+}
+
+places_ret *airportsQueryResult(places_ret *res, location *ploc) {
+  GridKey key;
+  if (!gridKey(*ploc, flightDecimals(), key))
+    return callAirportsServer(res, ploc);
+  
+  // The thread that calls fills its own result, the others copy it
+  bool called = false;
+  const AirportsOutcome outcome = inFlight.run(key, [&]() {
+    called = true;
+    return outcomeOf(callAirportsServer(res, ploc));
+  });
+  if (!called) setOutcome(res, outcome);
+  return res;
+}
+
+places_ret *callAirportsServer(places_ret *res, location *ploc) {
+  const clnt_stat stat = withAirportsClient(airportsTransport,
+                                            [=](CLIENT *clnt) {
+    airports_ret airportsResult{};
+    const clnt_stat callStat = airports_qry_1(ploc, &airportsResult, clnt);
+    if (callStat != RPC_SUCCESS) return callStat;
+    
+    takeAirportsResult(res, &airportsResult, *ploc);
+    clnt_freeres(clnt, (xdrproc_t)xdr_airports_ret, (caddr_t)&airportsResult);
+    return callStat;
+  });
+  
+  return stat == RPC_SUCCESS ? res : airportsCallError(res, stat);
+}
+
+void takeAirportsBatchResult(places_ret *rets, const u_int *indices,
+                             const size_t n, airports_batch_ret *batchResult) {
+  const auto &batch = batchResult->airports_batch_ret_u.results;
+  if (batchResult->err || batch.airports_batch_len != n) {
+    const char *msg = batchResult->err
+      ? batchResult->airports_batch_ret_u.error_msg
+      : "Airports server returned a short batch.";
+    for (size_t j = 0; j < n; ++j) errorResult(&rets[indices[j]], msg);
+    return;
+  }
+  
+  // Same ownership transfer as the single query, per batch entry
+  for (size_t j = 0; j < n; ++j) {
+    places_ret *res = &rets[indices[j]];
+    memcpy(&res->places_ret_u.results.results[0],
+           &batch.airports_batch_val[j][0], sizeof(airports));
+    memset(&batch.airports_batch_val[j][0], 0, sizeof(airports));
+    cacheAirports(res, res->places_ret_u.results.request.loc);
   }
+}
+
+void airportsBatchQueryResults(places_ret *rets,
+                               const std::vector<u_int> &pending) {
+  std::vector<location> locs;
+  locs.reserve(pending.size());
+  for (const u_int i : pending)
+    locs.push_back(rets[i].places_ret_u.results.request.loc);
   
-  clnt_freeres(clnt, (xdrproc_t)xdr_airports_ret, (caddr_t)airportsResult);
-  clnt_destroy(clnt);
+  locations args{ (u_int)locs.size(), locs.data() };
   
-  return &placesResult;
+  // Batch replies outgrow a UDP datagram, so they always go over TCP
+  const clnt_stat stat = withAirportsClient(AirportsClientPool::Transport::TCP,
+                                            [&](CLIENT *clnt) {
+    airports_batch_ret batchResult{};
+    const clnt_stat callStat = airports_qry_batch_1(&args, &batchResult, clnt);
+    if (callStat != RPC_SUCCESS) return callStat;
+    
+    takeAirportsBatchResult(rets, pending.data(), pending.size(), &batchResult);
+    clnt_freeres(clnt, (xdrproc_t)xdr_airports_batch_ret,
+                 (caddr_t)&batchResult);
+    return callStat;
+  });
+  
+  if (stat != RPC_SUCCESS) {
+    for (const u_int i : pending) airportsCallError(&rets[i], stat);
+  }
 }
@@ -0,0 +1,36 @@
+/*******************************************************************************
+ *   File: places_snapshot.cpp
+ * Author: Ben Targan
+ *   Desc: Compiles a places file into a trie snapshot places_server maps at
+ *         startup instead of parsing, sorting and building. Given an
+ *         airports file the closest airports of every place go in too.
+ *
+ *         usage: places_snapshot <placesFile> <snapshotFile> [airportsFile]
+ ******************************************************************************/
+#include <cstdio>
+#include <stdexcept>
+#include "airports/KDTree.h"
+#include "places/trie.h"
+
+int main(int argc, char **argv) {
+  if (argc < 3 || 4 < argc) {
+    printf("usage: %s <placesFile> <snapshotFile> [airportsFile]\n", argv[0]);
+    return 1;
+  }
+  
+  try {
+    Trie trie(loadPlacesFromFile(argv[1], 20000));
+    if (argc == 4)
+      trie.buildNearest(load_Airports(argv[3]), fileStamp(argv[3]));
+    trie.writeSnapshot(argv[2]);
+    
+    // Read it back so a bad snapshot fails here rather than at server start
+    const Trie mapped(Trie::openSnapshot(argv[2]));
+    printf("Wrote %zu places%s to %s.\n", mapped.size(),
+           mapped.nearest() ? " with their closest airports" : "", argv[2]);
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
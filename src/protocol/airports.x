@@ -3,5 +3,8 @@
 program AIRPORTS_PROG {
   version AIRPORTS_VERS {
     airports_ret AIRPORTS_QRY(location) = 2;
+    airports_batch_ret AIRPORTS_QRY_BATCH(locations) = 3;
+    airport_list_ret AIRPORTS_QRY_K(knn_req) = 4;
+    airport_list_ret AIRPORTS_QRY_RADIUS(radius_req) = 5;
   } = 1;
 } = 0x37699174;
@@ -76,3 +76,120 @@ union airports_ret switch (int err) {
   default:
     string error_msg<MAX_ERRMSG>;
 };
+
+/******************************************************************************
+ * Batch request & reply data structures
+ ******************************************************************************/
+
+/* Batch of points to look up the closest airports for */
+typedef location locations<MAX_BATCH>;
+
+/* Closest airports of each point in a batch, in request order */
+typedef airports airports_batch<MAX_BATCH>;
+
+/* Batch reply from airports to places with an optional errno */
+union airports_batch_ret switch (int err) {
+  case 0:
+    airports_batch results;
+  default:
+    string error_msg<MAX_ERRMSG>;
+};
+
+/* Batch of client requests to the places server */
+typedef places_req places_reqs<MAX_BATCH>;
+
+/* Reply of each request in a batch, in request order */
+typedef places_ret places_rets<MAX_BATCH>;
+
+/* Batch reply from places to client with an optional errno */
+union places_batch_ret switch (int err) {
+  case 0:
+    places_rets results;
+  default:
+    string err_msg<MAX_ERRMSG>;
+};
+
+/******************************************************************************
+ * Variable length airports queries
+ ******************************************************************************/
+
+/* Closest airports first, at most MAX_KRESULTS */
+typedef airport airport_list<MAX_KRESULTS>;
+
+/* Request for the k closest airports, k is capped at MAX_KRESULTS */
+struct knn_req {
+  location  loc;
+  int       k;
+};
+
+/* Request for the airports within miles of loc, closest max_results first */
+struct radius_req {
+  location  loc;
+  double    miles;
+  int       max_results;
+};
+
+/* Reply from airports with a variable number of airports */
+union airport_list_ret switch (int err) {
+  case 0:
+    airport_list results;
+  default:
+    string error_msg<MAX_ERRMSG>;
+};
+
+/******************************************************************************
+ * Place name completion
+ ******************************************************************************/
+
+/* Request for the most populous places whose names start with prefix */
+struct complete_req {
+  string    prefix<MAX_NAME>;
+  int       max_results;
+};
+
+/* Completed place with the population it is ranked by */
+struct completion {
+  place     pl;
+  u_int     population;
+};
+
+/* Completions, most populous first, at most MAX_COMPLETIONS */
+typedef completion completions<MAX_COMPLETIONS>;
+
+/* Reply from places with the completions of a prefix */
+union complete_ret switch (int err) {
+  case 0:
+    completions results;
+  default:
+    string err_msg<MAX_ERRMSG>;
+};
+
+/******************************************************************************
+ * Typo tolerant place lookup
+ ******************************************************************************/
+
+/* Request for the places whose names are within max_distance edits of the
+   name (capped at MAX_EDIT_DISTANCE), in the state unless it is empty */
+struct fuzzy_req {
+  name_state named;
+  int        max_distance;
+  int        max_results;
+};
+
+/* Place matched with the edits between its name and the requested one */
+struct fuzzy_match {
+  place     pl;
+  int       distance;
+  u_int     population;
+};
+
+/* Closest names first, then most populous, at most MAX_FUZZY_MATCHES */
+typedef fuzzy_match fuzzy_matches<MAX_FUZZY_MATCHES>;
+
+/* Reply from places with the places matching a possibly misspelled name */
+union fuzzy_ret switch (int err) {
+  case 0:
+    fuzzy_matches results;
+  default:
+    string err_msg<MAX_ERRMSG>;
+};
@@ -3,5 +3,8 @@
 program PLACES_PROG {
   version PLACES_VERS {
     places_ret PLACES_QRY(places_req) = 1;
+    places_batch_ret PLACES_QRY_BATCH(places_reqs) = 2;
+    complete_ret PLACES_COMPLETE(complete_req) = 3;
+    fuzzy_ret PLACES_FUZZY(fuzzy_req) = 4;
   } = 1;
 } = 0x27699174;
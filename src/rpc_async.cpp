@@ -0,0 +1,381 @@
+/*******************************************************************************
+ *   File: rpc_async.cpp
+ * Author: Ben Targan
+ *   Desc: Single threaded event loop serving and making ONC RPC calls over UDP
+ *         without blocking, replies are matched to their calls by XID.
+ ******************************************************************************/
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <rpc/pmap_clnt.h>
+#include "common.h"
+#include "rpc_async.h"
+#include "stats.h"
+
+// Counters exported through the stats dump
+static StatCounter serverCalls("rpc_async.server_calls");
+static StatCounter serverGarbage("rpc_async.server_garbage");
+static StatCounter serverSendFailures("rpc_async.server_send_failures");
+static StatCounter clientCalls("rpc_async.client_calls");
+static StatCounter clientRetransmits("rpc_async.client_retransmits");
+static StatCounter clientTimeouts("rpc_async.client_timeouts");
+static StatCounter clientStrayReplies("rpc_async.client_stray_replies");
+static StatCounter clientLookupFailures("rpc_async.client_lookup_failures");
+
+void runEventLoop(const std::vector<EventSource *> &sources) {
+  std::vector<pollfd> fds(sources.size());
+  for (;;) {
+    // Sockets may come and go between iterations, e.g. on reconnects
+    int timeout = -1;
+    for (size_t i = 0; i < sources.size(); ++i) {
+      fds[i] = { sources[i]->fd(), POLLIN, 0 };
+      const int t = sources[i]->timeoutMs();
+      if (t >= 0 && (timeout < 0 || t < timeout)) timeout = t;
+    }
+
+    if (poll(fds.data(), fds.size(), timeout) < 0) {
+      if (errno == EINTR) continue;
+      perror("runEventLoop: poll");
+      return;
+    }
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+      if (fds[i].fd >= 0 && fds[i].revents) sources[i]->onReadable();
+      sources[i]->expire();
+    }
+  }
+}
+
+// Accepted reply header of a call, without results
+static rpc_msg acceptedReply(const uint32_t xid, const accept_stat stat) {
+  rpc_msg msg{};
+  msg.rm_xid = xid;
+  msg.rm_direction = REPLY;
+  msg.rm_reply.rp_stat = MSG_ACCEPTED;
+  msg.acpted_rply.ar_verf = _null_auth;
+  msg.acpted_rply.ar_stat = stat;
+  return msg;
+}
+
+// Server
+/******************************************************************************/
+
+AsyncUdpServer::AsyncUdpServer(const rpcprog_t prog, const rpcvers_t vers,
+                               TDispatch dispatch) :
+  prog(prog), vers(vers), dispatch(std::move(dispatch)),
+  sock(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)),
+  recvBuf(UDPMSGSIZE), sendBuf(UDPMSGSIZE) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (sock < 0 || bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    const std::string err = std::strerror(errno);
+    if (sock >= 0) close(sock);
+    throw std::runtime_error("Unable to open UDP socket: " + err);
+  }
+}
+
+AsyncUdpServer::~AsyncUdpServer() {
+  close(sock);
+}
+
+bool AsyncUdpServer::registerPortmapper() const {
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  if (getsockname(sock, (sockaddr *)&addr, &len) < 0) return false;
+  return pmap_set(prog, vers, IPPROTO_UDP, ntohs(addr.sin_port));
+}
+
+void AsyncUdpServer::onReadable() {
+  for (;;) {
+    Call call{};
+    socklen_t len = sizeof(call.caller);
+    const ssize_t n = recvfrom(sock, recvBuf.data(), recvBuf.size(), 0,
+                               (sockaddr *)&call.caller, &len);
+    if (n < 0) return;
+
+    // Credentials are decoded in place instead of allocated
+    char credArea[2 * MAX_AUTH_BYTES];
+    rpc_msg msg{};
+    msg.rm_call.cb_cred.oa_base = credArea;
+    msg.rm_call.cb_verf.oa_base = credArea + MAX_AUTH_BYTES;
+
+    XDR xdrs;
+    xdrmem_create(&xdrs, recvBuf.data(), (u_int)n, XDR_DECODE);
+    if (!xdr_callmsg(&xdrs, &msg) || msg.rm_direction != CALL ||
+        msg.rm_call.cb_rpcvers != RPC_MSG_VERSION) {
+      serverGarbage.inc();
+    }
+    else {
+      call.xid = msg.rm_xid;
+      call.proc = msg.rm_call.cb_proc;
+      if (msg.rm_call.cb_prog != prog)
+        replyError(call, PROG_UNAVAIL);
+      else if (msg.rm_call.cb_vers != vers)
+        replyError(call, PROG_MISMATCH);
+      else if (call.proc == NULLPROC)
+        reply(call, (xdrproc_t)xdr_void, nullptr);
+      else {
+        serverCalls.inc();
+        dispatch(call, &xdrs);
+      }
+    }
+    XDR_DESTROY(&xdrs);
+  }
+}
+
+void AsyncUdpServer::reply(const Call &call, const xdrproc_t xres,
+                           const void *res) {
+  rpc_msg msg = acceptedReply(call.xid, SUCCESS);
+  msg.acpted_rply.ar_results.where = (caddr_t)res;
+  msg.acpted_rply.ar_results.proc = xres;
+  if (!send(call, msg)) replyError(call, SYSTEM_ERR);
+}
+
+void AsyncUdpServer::replyError(const Call &call, const accept_stat stat) {
+  rpc_msg msg = acceptedReply(call.xid, stat);
+  msg.acpted_rply.ar_vers.low = vers;
+  msg.acpted_rply.ar_vers.high = vers;
+  send(call, msg);
+}
+
+bool AsyncUdpServer::send(const Call &call, rpc_msg &msg) {
+  XDR xdrs;
+  xdrmem_create(&xdrs, sendBuf.data(), (u_int)sendBuf.size(), XDR_ENCODE);
+  // Fails when the results do not fit a datagram
+  const bool encoded = xdr_replymsg(&xdrs, &msg);
+  const size_t len = XDR_GETPOS(&xdrs);
+  XDR_DESTROY(&xdrs);
+  if (!encoded) return false;
+
+  if (sendto(sock, sendBuf.data(), len, 0, (const sockaddr *)&call.caller,
+             sizeof(call.caller)) < 0)
+    serverSendFailures.inc();
+  return true;
+}
+
+// Client
+/******************************************************************************/
+
+AsyncRpcClient::AsyncRpcClient(std::string host, const rpcprog_t prog,
+                               const rpcvers_t vers,
+                               const std::chrono::milliseconds retransmit,
+                               const std::chrono::milliseconds timeout) :
+  host(std::move(host)), prog(prog), vers(vers), retransmit(retransmit),
+  timeout(timeout), sock(-1), port(0),
+  nextXid((uint32_t)getpid() ^ (uint32_t)time(nullptr) * 2654435761u) { }
+
+AsyncRpcClient::~AsyncRpcClient() {
+  disconnect();
+}
+
+void AsyncRpcClient::setPort(const in_port_t serverPort) {
+  disconnect();
+  port = serverPort;
+  lastLookup = TClock::time_point();
+}
+
+bool AsyncRpcClient::connectServer() {
+  if (sock >= 0) return true;
+
+  // At most one lookup per retransmit interval while the server is away
+  const auto now = TClock::now();
+  if (lastLookup != TClock::time_point() && now - lastLookup < retransmit)
+    return false;
+  lastLookup = now;
+
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *found = nullptr;
+  if (getaddrinfo(host.c_str(), nullptr, &hints, &found) != 0) {
+    clientLookupFailures.inc();
+    return false;
+  }
+  sockaddr_in addr = *(const sockaddr_in *)found->ai_addr;
+  freeaddrinfo(found);
+
+  const u_short serverPort =
+    port ? port : pmap_getport(&addr, prog, vers, IPPROTO_UDP);
+  if (serverPort == 0) {
+    clientLookupFailures.inc();
+    return false;
+  }
+  addr.sin_port = htons(serverPort);
+
+  // Connected, so the kernel drops datagrams from anyone but the server
+  const int s = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (s < 0 || connect(s, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    if (s >= 0) close(s);
+    clientLookupFailures.inc();
+    return false;
+  }
+  sock = s;
+  log_printf("Connected to %s port %u.", host.c_str(), (unsigned)serverPort);
+  return true;
+}
+
+void AsyncRpcClient::disconnect() {
+  if (sock >= 0) close(sock);
+  sock = -1;
+}
+
+void AsyncRpcClient::call(const rpcproc_t proc, const xdrproc_t xargs,
+                          const void *args, const xdrproc_t xres,
+                          const size_t resSize, TDone done) {
+  if (!connectServer()) {
+    done(RPC_SYSTEMERROR, nullptr);
+    return;
+  }
+
+  // XIDs of calls still in flight are never reused
+  uint32_t xid;
+  do { xid = nextXid++; } while (pending.count(xid));
+
+  rpc_msg msg{};
+  msg.rm_xid = xid;
+  msg.rm_direction = CALL;
+  msg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+  msg.rm_call.cb_prog = prog;
+  msg.rm_call.cb_vers = vers;
+  msg.rm_call.cb_proc = proc;
+  msg.rm_call.cb_cred = _null_auth;
+  msg.rm_call.cb_verf = _null_auth;
+
+  Pending call;
+  call.request.resize(UDPMSGSIZE);
+  XDR xdrs;
+  xdrmem_create(&xdrs, call.request.data(), (u_int)call.request.size(),
+                XDR_ENCODE);
+  const bool encoded = xdr_callmsg(&xdrs, &msg) &&
+                       xargs(&xdrs, const_cast<void *>(args));
+  call.request.resize(XDR_GETPOS(&xdrs));
+  XDR_DESTROY(&xdrs);
+  if (!encoded) {
+    done(RPC_CANTENCODEARGS, nullptr);
+    return;
+  }
+
+  // Lost datagrams are covered by the retransmits
+  clientCalls.inc();
+  ::send(sock, call.request.data(), call.request.size(), 0);
+
+  call.xres = xres;
+  call.resSize = resSize;
+  call.done = std::move(done);
+  call.sent = TClock::now();
+  call.retransmitAt = call.sent + retransmit;
+  timers.emplace(call.retransmitAt, xid);
+  pending.emplace(xid, std::move(call));
+}
+
+void AsyncRpcClient::onReadable() {
+  char reply[UDPMSGSIZE];
+  for (;;) {
+    const ssize_t n = recv(sock, reply, sizeof(reply), 0);
+    if (n < 0) {
+      // Nothing listens on the port any more, look the server up again
+      if (errno == ECONNREFUSED) {
+        disconnect();
+        failAll(RPC_CANTRECV);
+      }
+      return;
+    }
+
+    uint32_t xid;
+    if ((size_t)n < sizeof(xid)) continue;
+    std::memcpy(&xid, reply, sizeof(xid));
+    const auto it = pending.find(ntohl(xid));
+    if (it == pending.end()) {
+      // Duplicate reply to a retransmitted call, or one that already failed
+      clientStrayReplies.inc();
+      continue;
+    }
+
+    // Taken out first, the completion may make new calls
+    Pending call = std::move(it->second);
+    pending.erase(it);
+    lastReply = TClock::now();
+    complete(call, reply, (size_t)n);
+  }
+}
+
+void AsyncRpcClient::complete(Pending &call, const char *reply,
+                              const size_t len) {
+  std::unique_ptr<char[]> res(new char[call.resSize]());
+
+  rpc_msg msg{};
+  msg.acpted_rply.ar_verf = _null_auth;
+  msg.acpted_rply.ar_results.where = res.get();
+  msg.acpted_rply.ar_results.proc = call.xres;
+
+  XDR xdrs;
+  xdrmem_create(&xdrs, const_cast<char *>(reply), (u_int)len, XDR_DECODE);
+  clnt_stat stat = RPC_CANTDECODERES;
+  if (xdr_replymsg(&xdrs, &msg)) {
+    rpc_err err{};
+    _seterr_reply(&msg, &err);
+    stat = err.re_status;
+  }
+  if (msg.acpted_rply.ar_verf.oa_base != nullptr) {
+    xdrs.x_op = XDR_FREE;
+    xdr_opaque_auth(&xdrs, &msg.acpted_rply.ar_verf);
+  }
+  XDR_DESTROY(&xdrs);
+
+  call.done(stat, stat == RPC_SUCCESS ? res.get() : nullptr);
+  xdr_free(call.xres, res.get());
+}
+
+void AsyncRpcClient::failAll(const clnt_stat stat) {
+  std::unordered_map<uint32_t, Pending> failed;
+  failed.swap(pending);
+  timers = decltype(timers)();
+  for (auto &entry : failed) entry.second.done(stat, nullptr);
+}
+
+int AsyncRpcClient::timeoutMs() const {
+  if (timers.empty()) return -1;
+  // Rounded up, waking early would only spin until the timer is due
+  const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+    timers.top().first - TClock::now()).count() + 1;
+  return (int)std::max<decltype(wait)>(wait, 0);
+}
+
+void AsyncRpcClient::expire() {
+  const auto now = TClock::now();
+  while (!timers.empty() && timers.top().first <= now) {
+    const auto timer = timers.top();
+    timers.pop();
+    const auto it = pending.find(timer.second);
+    if (it == pending.end() || it->second.retransmitAt != timer.first)
+      continue;
+
+    if (now - it->second.sent >= timeout) {
+      // Silent since this call was sent, the server may have moved
+      if (lastReply < it->second.sent) disconnect();
+
+      clientTimeouts.inc();
+      Pending call = std::move(it->second);
+      pending.erase(it);
+      call.done(RPC_TIMEDOUT, nullptr);
+      continue;
+    }
+
+    Pending &call = it->second;
+    if (connectServer()) {
+      clientRetransmits.inc();
+      ::send(sock, call.request.data(), call.request.size(), 0);
+    }
+    call.retransmitAt = std::min(now + retransmit, call.sent + timeout);
+    timers.emplace(call.retransmitAt, timer.second);
+  }
+}
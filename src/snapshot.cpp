@@ -0,0 +1,173 @@
+/*******************************************************************************
+ *   File: snapshot.cpp
+ * Author: Ben Targan
+ *   Desc: Versioned, checksummed binary snapshot files of prebuilt data
+ *         structures, mapped read-only into memory.
+ ******************************************************************************/
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+uint64_t snapshotChecksum(const void *data, const size_t size) {
+  const auto *words = static_cast<const uint64_t *>(data);
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size / sizeof(uint64_t); ++i) {
+    hash ^= words[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+FileStamp fileStamp(const char *path) {
+  FileStamp stamp;
+  struct stat st;
+  if (stat(path, &st) == 0) {
+    stamp.size = (uint64_t)st.st_size;
+    stamp.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 +
+                    st.st_mtim.tv_nsec;
+  }
+  return stamp;
+}
+
+// Mapping
+/******************************************************************************/
+
+MappedFile::MappedFile(const char *path) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error(std::string("Unable to open ") + path + ": " +
+                             std::strerror(errno));
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw std::runtime_error(std::string("Unable to map empty or unreadable ") +
+                             path);
+  }
+
+  len = (size_t)st.st_size;
+  void *mem = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    throw std::runtime_error(std::string("Unable to map ") + path + ": " +
+                             std::strerror(errno));
+  addr = static_cast<const char *>(mem);
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<char *>(addr), len);
+}
+
+// Writing
+/******************************************************************************/
+
+SnapshotWriter::SnapshotWriter(const char *magic) : header() {
+  std::strncpy(header.magic, magic, sizeof(header.magic) - 1);
+  header.version = SNAPSHOT_VERSION;
+  header.byteOrder = BYTE_ORDER_MARK;
+}
+
+void SnapshotWriter::addBytes(const void *data, const size_t size,
+                              const size_t elemSize) {
+  if (header.nSections == SNAPSHOT_MAX_SECTIONS)
+    throw std::logic_error("Too many snapshot sections.");
+
+  auto &sect = header.sections[header.nSections++];
+  sect.offset = sizeof(SnapshotHeader) + payload.size();
+  sect.size = size;
+  sect.elemSize = elemSize;
+
+  const auto *bytes = static_cast<const char *>(data);
+  payload.insert(payload.end(), bytes, bytes + size);
+  payload.resize((payload.size() + 7) & ~(size_t)7, '\0');
+}
+
+void SnapshotWriter::write(const char *path, const uint64_t count) const {
+  SnapshotHeader hdr = header;
+  hdr.count = count;
+  hdr.checksum = snapshotChecksum(payload.data(), payload.size());
+
+  // Written next to the target and renamed over it, so servers mapping the
+  // old file keep their pages and never see a half written one
+  const std::string tmpPath = std::string(path) + ".tmp";
+  FILE *out = fopen(tmpPath.c_str(), "wb");
+  if (!out)
+    throw std::runtime_error("Unable to open " + tmpPath + " for writing.");
+
+  const bool ok =
+    fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+    fwrite(payload.data(), 1, payload.size(), out) == payload.size();
+  if (fclose(out) != 0 || !ok || rename(tmpPath.c_str(), path) != 0) {
+    unlink(tmpPath.c_str());
+    throw std::runtime_error(std::string("Unable to write snapshot ") + path);
+  }
+}
+
+// Reading
+/******************************************************************************/
+
+// Validates the mapping before any section is handed out
+static void validate(const MappedFile &file, const char *magic) {
+  if (file.size() < sizeof(SnapshotHeader))
+    throw std::invalid_argument("Snapshot is truncated.");
+
+  const auto &hdr = *reinterpret_cast<const SnapshotHeader *>(file.data());
+  if (std::strncmp(hdr.magic, magic, sizeof(hdr.magic)) != 0)
+    throw std::invalid_argument("Not a snapshot of the expected kind.");
+  if (hdr.version != SNAPSHOT_VERSION)
+    throw std::invalid_argument("Snapshot version is not supported, rebuild it.");
+  if (hdr.byteOrder != BYTE_ORDER_MARK)
+    throw std::invalid_argument("Snapshot was written with another byte order.");
+  if (hdr.nSections > SNAPSHOT_MAX_SECTIONS)
+    throw std::invalid_argument("Snapshot header is corrupt.");
+
+  for (uint32_t i = 0; i < hdr.nSections; ++i) {
+    const auto &sect = hdr.sections[i];
+    if (sect.offset % 8 != 0 || sect.offset > file.size() ||
+        sect.size > file.size() - sect.offset)
+      throw std::invalid_argument("Snapshot section is out of bounds.");
+  }
+
+  const size_t payloadSize = file.size() - sizeof(SnapshotHeader);
+  if (payloadSize % 8 != 0 ||
+      snapshotChecksum(file.data() + sizeof(SnapshotHeader), payloadSize) !=
+      hdr.checksum)
+    throw std::invalid_argument("Snapshot checksum mismatch, file is corrupt.");
+}
+
+Snapshot::Snapshot(const char *path, const char *magic) : file(path) {
+  validate(file, magic);
+}
+
+bool Snapshot::isSnapshot(const char *path, const char *magic) {
+  char buf[sizeof(SnapshotHeader::magic)];
+  FILE *in = fopen(path, "rb");
+  if (!in) return false;
+  const bool read = fread(buf, sizeof(buf), 1, in) == 1;
+  fclose(in);
+  return read && std::strncmp(buf, magic, sizeof(buf)) == 0;
+}
+
+const void *Snapshot::sectionBytes(const size_t idx, const size_t n,
+                                   const size_t elemSize) const {
+  const auto &hdr = header();
+  if (idx >= hdr.nSections || hdr.sections[idx].elemSize != elemSize ||
+      hdr.sections[idx].size != n * elemSize)
+    throw std::invalid_argument("Snapshot section does not match this build.");
+  return file.data() + hdr.sections[idx].offset;
+}
+
+size_t Snapshot::sectionElems(const size_t idx, const size_t elemSize) const {
+  const auto &hdr = header();
+  if (idx >= hdr.nSections || hdr.sections[idx].elemSize != elemSize)
+    throw std::invalid_argument("Snapshot section does not match this build.");
+  return hdr.sections[idx].size / elemSize;
+}
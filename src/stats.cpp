@@ -0,0 +1,83 @@
+/*******************************************************************************
+ *   File: stats.cpp
+ * Author: Connor Wilding
+ *   Desc: Process wide runtime counters.
+ ******************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include "stats.h"
+
+// Fixed size registry so the dump never allocates or locks
+static constexpr int MAX_COUNTERS = 64;
+static StatCounter *counters[MAX_COUNTERS];
+static std::atomic<int> nCounters{0};
+
+static constexpr int MAX_RATIOS = 16;
+static StatRatio *ratios[MAX_RATIOS];
+static std::atomic<int> nRatios{0};
+
+StatCounter::StatCounter(const char *name) : cname(name), val(0) {
+  const int idx = nCounters.fetch_add(1);
+  if (idx < MAX_COUNTERS) counters[idx] = this;
+}
+
+StatRatio::StatRatio(const char *name, const StatCounter &numerator,
+                     const StatCounter &denominator) :
+  rname(name), numerator(numerator), denominator(denominator) {
+  const int idx = nRatios.fetch_add(1);
+  if (idx < MAX_RATIOS) ratios[idx] = this;
+}
+
+// Formats an unsigned value into buf without using stdio. Returns the length.
+static size_t formatULong(unsigned long v, char *buf) {
+  char tmp[24];
+  size_t n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  for (size_t i = 0; i < n; ++i) buf[i] = tmp[n - 1 - i];
+  return n;
+}
+
+void dumpStats(const int fd) {
+  const int count = std::min(nCounters.load(), MAX_COUNTERS);
+  for (int i = 0; i < count; ++i) {
+    char line[128];
+    size_t len = strnlen(counters[i]->name(), sizeof(line) - 26);
+    memcpy(line, counters[i]->name(), len);
+    line[len++] = ' ';
+    len += formatULong(counters[i]->value(), line + len);
+    line[len++] = '\n';
+    if (write(fd, line, len) < 0) return;
+  }
+
+  const int nRatio = std::min(nRatios.load(), MAX_RATIOS);
+  for (int i = 0; i < nRatio; ++i) {
+    char line[128];
+    size_t len = strnlen(ratios[i]->name(), sizeof(line) - 30);
+    memcpy(line, ratios[i]->name(), len);
+    line[len++] = ' ';
+    const unsigned long thousandths = ratios[i]->thousandths();
+    len += formatULong(thousandths / 1000, line + len);
+    line[len++] = '.';
+    line[len++] = (char)('0' + thousandths / 100 % 10);
+    line[len++] = (char)('0' + thousandths / 10 % 10);
+    line[len++] = (char)('0' + thousandths % 10);
+    line[len++] = '\n';
+    if (write(fd, line, len) < 0) return;
+  }
+}
+
+static void onStatsSignal(int) {
+  dumpStats(STDERR_FILENO);
+}
+
+void installStatsDumpHandler(const int signo) {
+  struct sigaction sa{};
+  sa.sa_handler = onStatsSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(signo, &sa, nullptr);
+}
@@ -0,0 +1,209 @@
+/*******************************************************************************
+ *   File: svc_pool.cpp
+ * Author: Ben Targan
+ *   Desc: Multi-threaded replacement for svc_run().
+ ******************************************************************************/
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "common.h"
+#include "svc_pool.h"
+
+// Opens a UDP socket bound with SO_REUSEPORT to the given port (0 for any).
+static int openReusePortSocket(const in_port_t port) {
+  const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) return -1;
+
+  const int on = 1;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0 ||
+      bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+SVCXPRT *svcUdpCreateShared() {
+  const int sock = openReusePortSocket(0);
+  if (sock < 0) return nullptr;
+  return svcudp_create(sock);
+}
+
+bool svcAddUdpReplicas(SVCXPRT *transp, const rpcprog_t prog,
+                       const rpcvers_t vers, const TSvcDispatch dispatch,
+                       const unsigned count) {
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  if (getsockname(transp->xp_fd, (sockaddr *)&addr, &len) < 0) return false;
+
+  for (unsigned i = 0; i < count; ++i) {
+    const int sock = openReusePortSocket(ntohs(addr.sin_port));
+    if (sock < 0) return false;
+
+    SVCXPRT *replica = svcudp_create(sock);
+    // Protocol 0 registers the dispatch routine without touching portmapper
+    if (replica == nullptr || !svc_register(replica, prog, vers, dispatch, 0))
+      return false;
+  }
+  return true;
+}
+
+// Listening TCP transports are served by the polling thread so that only it
+// ever accepts connections.
+static bool isListening(const int fd) {
+  int val = 0;
+  socklen_t len = sizeof(val);
+  return getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &val, &len) == 0 && val;
+}
+
+// Accepts a connection on a listening transport and serves it with a
+// transport of its own, as svctcp does. Returns the connection, -1 for none.
+static int acceptConnection(const int listenFd) {
+  const int sock = accept(listenFd, nullptr, nullptr);
+  if (sock < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+        errno != ECONNABORTED)
+      perror("svcRunPool: accept");
+    return -1;
+  }
+  if (sock >= FD_SETSIZE || svcfd_create(sock, 0, 0) == nullptr) {
+    fprintf(stderr, "svcRunPool: unable to serve connection %d\n", sock);
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+void svcRunPool(const unsigned nThreads) {
+  if (nThreads <= 1) {
+    svc_run();
+    return;
+  }
+
+  // libtirpc updates svc_fdset under a lock of its own, e.g. when a worker
+  // drops a closed connection, so the poller keeps its own view of the
+  // transports: the ones registered now, the connections it accepts, less
+  // the ones workers find closed.
+  std::vector<bool> served(FD_SETSIZE);     // Transports to poll
+  std::vector<bool> listening(FD_SETSIZE);  // Of those, the listening ones
+  int maxFd = -1;                           // Highest fd ever served
+  for (int fd = 0; fd <= svc_maxfd && fd < FD_SETSIZE; ++fd) {
+    served[fd] = FD_ISSET(fd, &svc_fdset);
+    listening[fd] = served[fd] && isListening(fd);
+    if (served[fd]) maxFd = fd;
+  }
+
+  std::mutex mtx;                     // Guards the members below and above
+  std::condition_variable readyCv;
+  std::deque<int> ready;              // Transports waiting for a worker
+  std::vector<bool> busy(FD_SETSIZE); // Transports queued or being served
+
+  // Workers wake the poller through this pipe when a transport is free again
+  int wakePipe[2];
+  if (pipe(wakePipe) < 0) exitWithMessage("Unable to create wake pipe");
+  fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < nThreads; ++i) {
+    workers.emplace_back([&]() {
+      for (;;) {
+        int fd;
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          readyCv.wait(lock, [&]() { return !ready.empty(); });
+          fd = ready.front();
+          ready.pop_front();
+        }
+
+        svc_getreq_common(fd);
+
+        {
+          // A connection that ended was destroyed and its socket closed.
+          // Checked under the lock the poller accepts under, so a new
+          // connection taking the same fd number is never dropped.
+          std::lock_guard<std::mutex> lock(mtx);
+          if (fcntl(fd, F_GETFD) < 0 && errno == EBADF) served[fd] = false;
+          busy[fd] = false;
+        }
+        const char b = 0;
+        if (write(wakePipe[1], &b, 1) < 0 && errno != EAGAIN)
+          perror("svcRunPool: wake");
+      }
+    });
+  }
+
+  log_printf("Serving with %u worker threads.", nThreads);
+
+  std::vector<pollfd> fds;
+  for (;;) {
+    fds.clear();
+    fds.push_back({wakePipe[0], POLLIN, 0});
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      for (int fd = 0; fd <= maxFd; ++fd) {
+        if (served[fd] && !busy[fd]) fds.push_back({fd, POLLIN, 0});
+      }
+    }
+
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("svcRunPool: poll");
+      return;
+    }
+
+    if (fds[0].revents) {
+      char buf[64];
+      while (read(wakePipe[0], buf, sizeof(buf)) > 0) { }
+    }
+
+    for (size_t i = 1; i < fds.size(); ++i) {
+      if (!fds[i].revents) continue;
+      const int fd = fds[i].fd;
+
+      std::lock_guard<std::mutex> lock(mtx);
+      if (listening[fd]) {
+        const int conn = acceptConnection(fd);
+        if (conn >= 0) {
+          served[conn] = true;
+          listening[conn] = false;
+          maxFd = std::max(maxFd, conn);
+        }
+        continue;
+      }
+
+      busy[fd] = true;
+      ready.push_back(fd);
+      readyCv.notify_one();
+    }
+  }
+}
+
+unsigned parseThreadCount(const char *arg) {
+  char *end = nullptr;
+  const long n = strtol(arg, &end, 10);
+  if (end == arg || *end != '\0' || n < 0 || 1024 < n) {
+    fprintf(stderr, "Invalid thread count: %s\n", arg);
+    exit(1);
+  }
+  if (n == 0) {
+    const unsigned hw = std::thread::hardware_concurrency();
+    return hw ? hw : 1;
+  }
+  return (unsigned)n;
+}
@@ -5,51 +5,124 @@
  ******************************************************************************/
 #include <cctype>
 #include <algorithm>
-#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <strings.h>
+#include "parallel.h"
 #include "places/trie.h"
 
 // Forward declarations for helper functions
 /******************************************************************************/
 
+/**
+ * Characters [begin, end) of a line of the places file, read in place.
+ */
+struct Span {
+  const char *begin;
+  const char *end;
+  
+  size_t size() const { return (size_t)(end - begin); }
+  Span sub(size_t pos, size_t len) const {
+    return {begin + pos, begin + pos + len};
+  }
+};
+
 // Trims whitespace at end
-inline std::string& trimRight(std::string& s);
+inline Span trimRight(Span s);
+
+// Removes last word in span. Returns the word.
+inline Span removeLastWord(Span &s);
 
-// Removes and erases last word in string. Returns the word.
-inline std::string removeLastWord(std::string& s);
+// Lower case of a char, also for the non-ASCII (negative) chars of names
+inline char lowerChar(char c);
 
-// Constructs a city record from places file line. Throws on err.
-CityRecord cityRecordFromLine(const std::string &line);
+// Parses a decimal coordinate column into millionths of a degree. Throws on
+// err.
+int32_t parseMicroDegrees(Span field);
 
-// Loads place records from a file. Throws on IO / parsing / mem errors.
-TPlaceRecs loadPlacesFromFile(const char *fname, const size_t approxCount);
+// Parses a whole number column. Throws on err.
+uint32_t parseCount(Span field);
+
+// Appends the city record of a places file line, its name to the arena.
+// Returns false when the line is skipped. Throws on err.
+bool cityRecordFromLine(Span line, PlaceRecs &places);
+
+// Appends the records of the lines starting in [begin, end) of the file.
+// Throws on err.
+void parseChunk(const char *data, size_t size, size_t begin, size_t end,
+                PlaceRecs &places);
 
 // Implementation of public interface methods to init and search
 /******************************************************************************/
 
-// State shared between two public api methods
-static std::unique_ptr<Trie> trie;
+static double msSince(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+}
 
-void initTrie(const char *placesPath) {
-  log_printf("Loading from file: %s.", placesPath);
-  try {
-    TPlaceRecs places = loadPlacesFromFile(placesPath, 20000);
-    
-    trie = std::unique_ptr<Trie>(new Trie(std::move(places)));
+// Bytes the records took as two std::strings and a double location each,
+// the layout before names and state codes moved out of the records
+static size_t stringRecordBytes(const PlaceRecs &places) {
+  const size_t inPlace = std::string().capacity();
+  size_t bytes = 0;
+  for (const CityRecord &rec : places.records) {
+    bytes += 2 * sizeof(std::string) + sizeof(location);
+    if (rec.nameLen > inPlace) bytes += rec.nameLen + 1u;
   }
-  catch (const std::exception &e) {
-    exitWithMessage(e.what());
+  return bytes;
+}
+
+// Logs the memory held by the trie, compared to string records when known
+static void logMemory(const Trie &t, const size_t stringBytes) {
+  const TrieMemory mem = t.memory();
+  info_printf("Places take %.1f KB: records %.1f KB (%d B each),"
+              " names %.1f KB, states %d B, trie %.1f KB,"
+              " ranked completions %.1f KB, closest airports %.1f KB.",
+              mem.total() / 1024.0, mem.records / 1024.0,
+              (int)sizeof(CityRecord), mem.names / 1024.0, (int)mem.states,
+              mem.nodes / 1024.0, mem.ranked / 1024.0, mem.nearest / 1024.0);
+  if (stringBytes > 0)
+    info_printf("Records, names and states take %.1f KB, were %.1f KB as"
+                " std::string records.",
+                (mem.records + mem.names + mem.states) / 1024.0,
+                stringBytes / 1024.0);
+}
+
+std::shared_ptr<Trie> loadTrie(const char *placesPath) {
+  log_printf("Loading from file: %s.", placesPath);
+  std::shared_ptr<Trie> loaded;
+  
+  // Snapshots hold the prebuilt trie and are served straight from disk
+  if (Trie::isSnapshot(placesPath)) {
+    const auto start = std::chrono::steady_clock::now();
+    loaded = std::make_shared<Trie>(Trie::openSnapshot(placesPath));
+    info_printf("Mapped %d places from snapshot (%.1f ms).",
+                (int)loaded->size(), msSince(start));
+    logMemory(*loaded, 0);
+    return loaded;
   }
   
-  log_printf("Loaded %d places.", (int)trie->size());
+  auto start = std::chrono::steady_clock::now();
+  TPlaceRecs places = loadPlacesFromFile(placesPath, 20000);
+  const double parseMs = msSince(start);
+  const size_t stringBytes = stringRecordBytes(*places);
+  
+  start = std::chrono::steady_clock::now();
+  loaded = std::make_shared<Trie>(std::move(places));
+  const double buildMs = msSince(start);
+  
+  info_printf("Loaded %d places (parse %.1f ms, build %.1f ms).",
+              (int)loaded->size(), parseMs, buildMs);
+  logMemory(*loaded, stringBytes);
+  return loaded;
 }
 
-TrieQueryResult queryPlace(const name_state &cityState) {
-  const std::string city = cityState.name;
-  const std::string state = cityState.state;
-  
+TrieQueryResult queryPlace(const Trie &t, const std::string &city,
+                           const std::string &state) {
   // Get set of cities with same name or ambiguous result
-  auto result = trie->query(city);
+  auto result = t.query(city);
   
   // Done when found an exact match, or city name is
   if (result.places.size() == 1 || result.isAmbiguous)
@@ -65,9 +138,8 @@ TrieQueryResult queryPlace(const name_state &cityState) {
   TFoundPlaces &p1 = result.places;
   p1.erase(std::remove_if(
              p1.begin(), p1.end(),
-             [=](const std::reference_wrapper<const CityRecord> &e) {
-               return strcasecmp(e.get().state.c_str(),
-                                 state.c_str()) != 0;
+             [&](const std::reference_wrapper<const CityRecord> &e) {
+               return strcasecmp(t.state(e.get()), state.c_str()) != 0;
      
     }), p1.end());
   
@@ -77,197 +149,601 @@ TrieQueryResult queryPlace(const name_state &cityState) {
 // Helper implementations
 /******************************************************************************/
 
-inline std::string& trimRight(std::string& s) {
-  const std::string::iterator trimEnd =
-    std::find_if_not(s.rbegin(), s.rend(), [](const unsigned char &c) {
-      return std::isspace(c);
-    }).base();
-  s.erase(trimEnd, s.end());
+inline Span trimRight(Span s) {
+  while (s.end > s.begin && std::isspace((unsigned char)s.end[-1])) --s.end;
   return s;
 }
 
-inline std::string removeLastWord(std::string& s) {
-  trimRight(s);
-  const std::string::iterator fstSpace =
-    std::find_if(s.rbegin(), s.rend(), [](const char &c) {
-      return std::isspace(c);
-    }).base();
-  std::string word(fstSpace, s.end());
-  s.erase(fstSpace, s.end());
-  trimRight(s);
+inline char lowerChar(const char c) {
+  return (char)std::tolower((unsigned char)c);
+}
+
+inline Span removeLastWord(Span &s) {
+  s = trimRight(s);
+  const char *fstSpace = s.end;
+  while (fstSpace > s.begin && !std::isspace((unsigned char)fstSpace[-1]))
+    --fstSpace;
+  const Span word{fstSpace, s.end};
+  s = trimRight({s.begin, fstSpace});
   return word;
 }
 
-CityRecord cityRecordFromLine(const std::string &line) {
-  if (!(164 < line.size() || line.size() < 165)) {
+int32_t parseMicroDegrees(const Span field) {
+  const char *p = field.begin;
+  while (p < field.end && *p == ' ') ++p;
+  
+  const bool negative = p < field.end && *p == '-';
+  if (p < field.end && (*p == '-' || *p == '+')) ++p;
+  
+  // Digits are gathered into an integer, then scaled to six decimals
+  uint64_t digits = 0;
+  int nDigits = 0, nFraction = 0;
+  bool fraction = false;
+  for (; p < field.end; ++p) {
+    if (*p >= '0' && *p <= '9') {
+      digits = digits * 10 + (uint64_t)(*p - '0');
+      ++nDigits;
+      nFraction += fraction;
+    }
+    else if (*p == '.' && !fraction) fraction = true;
+    else break;
+  }
+  while (p < field.end && *p == ' ') ++p;
+  
+  if (nDigits == 0 || nDigits > 18 || p != field.end)
+    throw std::invalid_argument("Places file has a malformed coordinate.");
+  
+  // Columns finer than a millionth of a degree are rounded to it
+  for (; nFraction < 6; ++nFraction) digits *= 10;
+  for (; nFraction > 6; --nFraction) digits = (digits + 5) / 10;
+  if (digits > 360000000)
+    throw std::invalid_argument("Places file has a coordinate out of range.");
+  
+  return negative ? -(int32_t)digits : (int32_t)digits;
+}
+
+uint32_t parseCount(const Span field) {
+  const char *p = field.begin;
+  while (p < field.end && *p == ' ') ++p;
+  
+  uint64_t count = 0;
+  const char *digits = p;
+  for (; p < field.end && *p >= '0' && *p <= '9'; ++p)
+    count = count * 10 + (uint64_t)(*p - '0');
+  const char *last = p;
+  while (p < field.end && *p == ' ') ++p;
+  
+  if (last == digits || last - digits > 9 || p != field.end)
+    throw std::invalid_argument("Places file has a malformed count.");
+  return (uint32_t)count;
+}
+
+bool cityRecordFromLine(const Span line, PlaceRecs &places) {
+  if (line.size() < 164) {
     throw std::invalid_argument(
       "Places file is mangled, each line needs to be 164 chars"
     );
   }
   
-  std::string name = line.substr(9, 64);  // Name - 9 to 73  len = 64
-  const std::string lastWord = removeLastWord(name);
-  if (lastWord == "CDP") return {};
+  Span name = line.sub(9, 64);            // Name - 9 to 73  len = 64
+  const Span lastWord = removeLastWord(name);
+  if (name.size() == 0 ||
+      (lastWord.size() == 3 && std::memcmp(lastWord.begin, "CDP", 3) == 0))
+    return false;
   
-  name.shrink_to_fit();
+  char state[MAX_STATE] = {};
+  std::memcpy(state, line.begin, 2);      // State: 0 to 2  len = 2
   
-  return CityRecord{
-    std::move(name),
-    line.substr(0, 2),            // State: 0 to 2  len = 2
-    {
-      std::stod(line.substr(143, 10)),  // Lat: 143 to 153 len = 10
-      std::stod(line.substr(153, 10))  // Long: 153 to 164 len = 10
-    }
+  const CityRecord rec{
+    parseMicroDegrees(line.sub(143, 10)), // Lat: 143 to 153 len = 10
+    parseMicroDegrees(line.sub(153, 10)), // Long: 153 to 164 len = 10
+    (uint32_t)places.names.size(),
+    parseCount(line.sub(73, 9)),          // Population: 73 to 82 len = 9
+    (uint8_t)name.size(),
+    places.internState(state)
   };
+  
+  places.names.insert(places.names.end(), name.begin, name.end);
+  places.names.push_back('\0');
+  places.records.push_back(rec);
+  return true;
 }
 
-TPlaceRecs loadPlacesFromFile(const char *fname, const size_t approxCount) {
-  std::ifstream placesFile(fname);
+void parseChunk(const char *data, const size_t size, const size_t begin,
+                const size_t end, PlaceRecs &places) {
+  const char *fileEnd = data + size;
   
-  if (!placesFile) {
-    throw std::invalid_argument(
-      "Unable to open " + std::string(fname) + " for reading.");
+  // The line running into the chunk belongs to the chunk before
+  const char *p = data + begin;
+  if (begin > 0) {
+    const void *nl = std::memchr(p - 1, '\n', (size_t)(fileEnd - p + 1));
+    p = nl ? static_cast<const char *>(nl) + 1 : fileEnd;
   }
   
-  auto places = std::unique_ptr<std::vector<CityRecord>>(
-    new std::vector<CityRecord>());
-  auto &p1 = *places;
-  p1.reserve(approxCount);
+  while (p < data + end) {
+    const void *nl = std::memchr(p, '\n', (size_t)(fileEnd - p));
+    const char *eol = nl ? static_cast<const char *>(nl) : fileEnd;
+    cityRecordFromLine({p, eol}, places);
+    p = nl ? eol + 1 : fileEnd;
+  }
+}
+
+TPlaceRecs loadPlacesFromFile(const char *fname, const size_t approxCount) {
+  const MappedFile file(fname);
+  
+  // Chunks of the file are parsed concurrently, each into its own records
+  // and arena, then merged in file order
+  constexpr size_t chunkBytes = 1 << 20;
+  const size_t nChunks = (file.size() + chunkBytes - 1) / chunkBytes;
+  std::vector<PlaceRecs> chunks(nChunks);
+  std::vector<std::exception_ptr> errors(nChunks);
   
-  std::string line;
-  while (std::getline(placesFile, line)) {
-    p1.emplace_back(cityRecordFromLine(line));
-    if (p1.back().cityName.empty()) p1.pop_back();
+  parallelFor(nChunks, 1, [&](size_t fm, size_t to) {
+    for (size_t i = fm; i < to; ++i) {
+      try {
+        chunks[i].records.reserve(approxCount / nChunks + 1);
+        parseChunk(file.data(), file.size(), i * chunkBytes,
+                   std::min((i + 1) * chunkBytes, file.size()), chunks[i]);
+      }
+      catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  });
+  for (const auto &err : errors)
+    if (err) std::rethrow_exception(err);
+  
+  size_t nRecords = 0, nNames = 0;
+  for (const auto &chunk : chunks) {
+    nRecords += chunk.records.size();
+    nNames += chunk.names.size();
   }
-  p1.shrink_to_fit();
   
-  std::sort(p1.begin(), p1.end(),
-            [](const CityRecord &a, const CityRecord &b) {
-              int cmp = strcasecmp(a.cityName.c_str(), b.cityName.c_str());
-                return cmp == 0
-                  ? strcasecmp(a.state.c_str(), b.state.c_str()) < 0
-                  : cmp < 0;
-            });
+  auto places = std::unique_ptr<PlaceRecs>(new PlaceRecs());
+  places->records.reserve(nRecords);
+  places->names.reserve(nNames);
+  for (const auto &chunk : chunks) {
+    const auto nameBase = (uint32_t)places->names.size();
+    places->names.insert(places->names.end(), chunk.names.begin(),
+                         chunk.names.end());
+    
+    // State ids of the chunk become ids of the merged table
+    uint8_t stateIds[MAX_STATES];
+    for (size_t i = 0; i < chunk.states.size() / MAX_STATE; ++i)
+      stateIds[i] = places->internState(&chunk.states[i * MAX_STATE]);
+    
+    for (CityRecord rec : chunk.records) {
+      rec.nameOff += nameBase;
+      rec.stateId = stateIds[rec.stateId];
+      places->records.push_back(rec);
+    }
+  }
   
   return places;
 }
 
+uint8_t PlaceRecs::internState(const char *code) {
+  // Places files are grouped by state, the latest code is the likely one
+  const size_t nStates = states.size() / MAX_STATE;
+  for (size_t i = nStates; i-- > 0; ) {
+    if (std::strncmp(&states[i * MAX_STATE], code, MAX_STATE) == 0)
+      return (uint8_t)i;
+  }
+  
+  if (nStates == MAX_STATES)
+    throw std::invalid_argument("Places file has too many state codes.");
+  states.resize(states.size() + MAX_STATE, '\0');
+  std::strncpy(&states[nStates * MAX_STATE], code, MAX_STATE - 1);
+  return (uint8_t)nStates;
+}
+
 // Implementation of the Trie members
 /******************************************************************************/
+// Kind of snapshot holding a trie
+static const char *SNAPSHOT_MAGIC = "PLRADIX";
+
+// Sections of a trie snapshot, in the order they are written. The closest
+// airports follow when there are.
+enum SnapshotSections {
+  SECT_RECORDS, SECT_NAMES, SECT_STATES, SECT_NODES, SECT_RANK_STARTS,
+  SECT_RANKED, SECT_NEAREST
+};
+
 Trie::Trie(TPlaceRecs cityRecords) :
-  places(std::move(cityRecords)),
-  root(0) {
-  construct(0, (int)places->size(), 0, root);
+  builtRecs(std::move(cityRecords->records)),
+  builtNames(std::move(cityRecords->names)),
+  builtStates(std::move(cityRecords->states)) {
+  // Construction reads the records through the bound arrays
+  bind(builtRecs.data(), builtRecs.size(), builtNames.data(),
+       builtNames.size(), builtStates.data(), builtStates.size(), nullptr, 0,
+       nullptr, nullptr, 0);
+  
+  std::sort(builtRecs.begin(), builtRecs.end(),
+            [this](const CityRecord &a, const CityRecord &b) {
+              int cmp = strcasecmp(name(a), name(b));
+                return cmp == 0
+                  ? strcasecmp(state(a), state(b)) < 0
+                  : cmp < 0;
+            });
+  
+  builtNodes.emplace_back(0);
+  construct(0, (int)count, 0, 0);
+  builtNodes.shrink_to_fit();
+  bind(builtRecs.data(), builtRecs.size(), builtNames.data(),
+       builtNames.size(), builtStates.data(), builtStates.size(),
+       builtNodes.data(), builtNodes.size(), nullptr, nullptr, 0);
+  
+  rankCompletions();
+  bind(builtRecs.data(), builtRecs.size(), builtNames.data(),
+       builtNames.size(), builtStates.data(), builtStates.size(),
+       builtNodes.data(), builtNodes.size(), builtStarts.data(),
+       builtRanked.data(), builtRanked.size());
+}
+
+Trie::Trie(std::unique_ptr<Snapshot> snap) : snapshot(std::move(snap)) {
+  const size_t n = snapshot->count();
+  const size_t nNames = snapshot->sectionLength<char>(SECT_NAMES);
+  const size_t nStates = snapshot->sectionLength<char>(SECT_STATES);
+  const size_t nNodes = snapshot->sectionLength<TrieNode>(SECT_NODES);
+  const size_t nRanks = snapshot->sectionLength<uint32_t>(SECT_RANKED);
+  if (nNodes == 0)
+    throw std::invalid_argument("Places snapshot has no trie.");
+  
+  bind(snapshot->section<CityRecord>(SECT_RECORDS, n), n,
+       snapshot->section<char>(SECT_NAMES, nNames), nNames,
+       snapshot->section<char>(SECT_STATES, nStates), nStates,
+       snapshot->section<TrieNode>(SECT_NODES, nNodes), nNodes,
+       snapshot->section<uint32_t>(SECT_RANK_STARTS, nNodes + 1),
+       snapshot->section<uint32_t>(SECT_RANKED, nRanks), nRanks);
+  
+  if (snapshot->sections() > SECT_NEAREST)
+    nearestTable = std::unique_ptr<NearestAirports>(
+      new NearestAirports(*snapshot, SECT_NEAREST, n));
+}
+
+void Trie::bind(const CityRecord *recs, const size_t n, const char *recNames,
+                const size_t nNames, const char *stateCodes,
+                const size_t nStates, const TrieNode *trieNodes,
+                const size_t nNodes, const uint32_t *rankStarts,
+                const uint32_t *rankRecs, const size_t nRanks) {
+  places = recs;
+  count = n;
+  names = recNames;
+  namesSize = nNames;
+  states = stateCodes;
+  statesSize = nStates;
+  nodes = trieNodes;
+  nodeCount = nNodes;
+  rankStart = rankStarts;
+  ranked = rankRecs;
+  nRanked = nRanks;
+}
+
+bool Trie::isSnapshot(const char *path) {
+  return Snapshot::isSnapshot(path, SNAPSHOT_MAGIC);
+}
+
+std::unique_ptr<Snapshot> Trie::openSnapshot(const char *path) {
+  return std::unique_ptr<Snapshot>(new Snapshot(path, SNAPSHOT_MAGIC));
+}
+
+void Trie::writeSnapshot(const char *path) const {
+  SnapshotWriter writer(SNAPSHOT_MAGIC);
+  writer.addSection(places, count);
+  writer.addSection(names, namesSize);
+  writer.addSection(states, statesSize);
+  writer.addSection(nodes, nodeCount);
+  writer.addSection(rankStart, nodeCount + 1);
+  writer.addSection(ranked, nRanked);
+  if (nearestTable) nearestTable->addSections(writer);
+  writer.write(path, count);
+}
+
+void Trie::buildNearest(TAirportRecs airRecs, const FileStamp &airportsStamp) {
+  nearestTable = std::unique_ptr<NearestAirports>(
+    new NearestAirports(places, count, std::move(airRecs), airportsStamp));
 }
 
 TrieQueryResult
 Trie::query(const std::string &cityName) const {
-  return query(cityName, root, 0);
+  const TrieNode *node = find(cityName);
+  
+  // Return empty result when not found
+  if (node == nullptr)
+    return TrieQueryResult{TFoundPlaces(), false };
+  
+  return getFirstCompletion(*node);
+}
+
+TFoundPlaces Trie::complete(const std::string &prefix,
+                            const size_t maxResults) const {
+  const TrieNode *node = find(prefix);
+  if (node == nullptr) return TFoundPlaces();
+  
+  // Ranked records are stored most populous first
+  const size_t idx = (size_t)(node - nodes);
+  const size_t n = std::min<size_t>(rankStart[idx + 1] - rankStart[idx],
+                                    std::min<size_t>(maxResults, MAX_COMPLETIONS));
+  TFoundPlaces found;
+  found.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    found.emplace_back(places[ranked[rankStart[idx] + i]]);
+  return found;
+}
+
+/**
+ * State of one fuzzy lookup. Row d of the edit distance table holds the edits
+ * between the first d chars on the path to a node and each prefix of the name
+ * looked up, only the rows of the current path are kept.
+ */
+struct Trie::FuzzySearch {
+  std::string                            name;     // Name, lower case
+  const std::string                     &state;    // State, empty for any
+  size_t                                 maxDist;  // Most edits of a match
+  std::vector<int>                       table;    // Rows of the path
+  std::vector<std::pair<int, uint32_t>>  matches;  // Edits and record index
+  
+  int *row(const size_t depth) { return &table[depth * (name.size() + 1)]; }
+};
+
+TFuzzyMatches Trie::fuzzy(const std::string &cityName,
+                          const std::string &state, const size_t maxDistance,
+                          const size_t maxResults) const {
+  FuzzySearch search{std::string(), state,
+                     std::min<size_t>(maxDistance, MAX_EDIT_DISTANCE), { },
+                     { }};
+  for (const char c : cityName) search.name += lowerChar(c);
+  
+  // A path longer than the name by more than maxDist cannot match, so the
+  // walk never needs more rows than that
+  const size_t width = search.name.size() + 1;
+  search.table.resize((width + search.maxDist + 1) * width);
+  for (size_t j = 0; j < width; ++j) search.row(0)[j] = (int)j;
+  fuzzyWalk(nodes[0], 0, search);
+  
+  // Fewest edits first, then most populous, records in name order break ties
+  auto &matches = search.matches;
+  const CityRecord *recs = places;
+  const size_t n = std::min(matches.size(),
+                            std::min<size_t>(maxResults, MAX_FUZZY_MATCHES));
+  std::partial_sort(matches.begin(), matches.begin() + n, matches.end(),
+                    [recs](const std::pair<int, uint32_t> &a,
+                           const std::pair<int, uint32_t> &b) {
+                      if (a.first != b.first) return a.first < b.first;
+                      if (recs[a.second].population !=
+                          recs[b.second].population)
+                        return recs[a.second].population >
+                               recs[b.second].population;
+                      return a.second < b.second;
+                    });
+  
+  TFuzzyMatches found;
+  found.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    found.push_back(FuzzyMatch{places[matches[i].second], matches[i].first});
+  return found;
 }
 
-size_t Trie::size() const { return places->size(); }
+size_t Trie::size() const { return count; }
+
+TrieMemory Trie::memory() const {
+  return TrieMemory{count * sizeof(CityRecord), namesSize, statesSize,
+                    nodeCount * sizeof(TrieNode),
+                    (nodeCount + 1 + nRanked) * sizeof(uint32_t),
+                    nearestTable ? nearestTable->memory() : 0};
+}
 
 Trie::TrieNode::TrieNode(const char ch) : c(ch) { }
 
-TrieQueryResult Trie::query(const std::string &cname,
-                            const TrieNode &node,
-                            const int depth) const {
-  // Base case, search string exhausted
-  if ((int)cname.size() == depth) return getFirstCompletion(node);
+const Trie::TrieNode *Trie::find(const std::string &prefix) const {
+  const TrieNode *node = nodes;
+  size_t depth = 0;
+  while (depth < prefix.size()) {
+    // Binary search on the next node to see if next char is in trie. Next
+    // nodes are in strcasecmp order, which compares chars unsigned.
+    const char c = lowerChar(prefix[depth]);
+    const TrieNode *end = nextEnd(*node);
+    const TrieNode *it = std::lower_bound(nextBegin(*node), end, c,
+                                          [](const TrieNode &tn, const char ch) {
+                                            return (unsigned char)tn.c <
+                                                   (unsigned char)ch;
+                                          });
+    if (it == end || c != it->c) return nullptr;
+    
+    // Match the rest of the label, the prefix may end inside it
+    const char *label = names + it->label;
+    for (size_t i = 1; i < it->labelLen && depth + i < prefix.size(); ++i) {
+      if (lowerChar(prefix[depth + i]) != lowerChar(label[i]))
+        return nullptr;
+    }
+    
+    // Continue searching past the label
+    node = it;
+    depth += it->labelLen;
+  }
   
-  // Binary search on the next node to see if next char is in trie
-  const char c = (char)std::tolower(cname[depth]);
-  const auto it = std::lower_bound(node.next.begin(), node.next.end(), c,
-                                   [](const TrieNode &tn, const char ch) {
-                                     return tn.c < ch;
-                                   });
+  return node;
+}
+
+void Trie::fuzzyWalk(const TrieNode &node, const size_t depth,
+                     FuzzySearch &search) const {
+  const size_t m = search.name.size();
   
-  // Return empty result when not found
-  if (it == node.next.cend() || c != it->c)
-    return TrieQueryResult{TFoundPlaces(places->cend(), places->cend()), false };
+  // Records named by the path match when the whole name is within reach
+  const int dist = search.row(depth)[m];
+  if (node.first != -1 && dist <= (int)search.maxDist) {
+    for (int idx = node.first; idx < node.last; ++idx) {
+      if (search.state.empty() ||
+          strcasecmp(state(places[idx]), search.state.c_str()) == 0)
+        search.matches.emplace_back(dist, (uint32_t)idx);
+    }
+  }
   
-  // Continue searching at next depth
-  return query(cname, *it, depth + 1);
+  for (const TrieNode *it = nextBegin(node); it != nextEnd(node); ++it) {
+    // Extend the table one row per char of the edge, giving up on the edge
+    // once no prefix of the name is within reach
+    const char *label = names + it->label;
+    bool reachable = true;
+    for (size_t i = 0; i < it->labelLen && reachable; ++i) {
+      const char c = lowerChar(label[i]);
+      const int *prev = search.row(depth + i);
+      int *curr = search.row(depth + i + 1);
+      
+      curr[0] = prev[0] + 1;
+      int rowMin = curr[0];
+      for (size_t j = 1; j <= m; ++j) {
+        const int subst = prev[j - 1] + (search.name[j - 1] == c ? 0 : 1);
+        curr[j] = std::min(subst, std::min(prev[j], curr[j - 1]) + 1);
+        rowMin = std::min(rowMin, curr[j]);
+      }
+      reachable = rowMin <= (int)search.maxDist;
+    }
+    
+    if (reachable)
+      fuzzyWalk(*it, depth + it->labelLen, search);
+  }
 }
 
 TrieQueryResult Trie::getFirstCompletion(const TrieNode &node) const {
   // Return the range of records stored in this node when nonempty
-  if (node.idxRange.first != -1)
+  if (node.first != -1)
     return TrieQueryResult{
-      TFoundPlaces(places->cbegin() + node.idxRange.first,
-                 places->cbegin() + node.idxRange.second),
+      TFoundPlaces(places + node.first, places + node.last),
                  false
     };
   
   // Return not found when last node (shouldn't happen if constructed right)
-  if (node.next.empty())
-    return TrieQueryResult{TFoundPlaces(places->cend(), places->cend()), false};
+  if (node.nNext == 0)
+    return TrieQueryResult{TFoundPlaces(), false};
   
   // Return the empty sentinel when this is the last node or is ambiguous
-  if (node.next.size() > 1)
+  if (node.nNext > 1)
     return getAmbiguousHints(node);
   
   // Continue searching the rest of the trie chain
-  return getFirstCompletion(node.next[0]);
+  return getFirstCompletion(*nextBegin(node));
 }
 
 TrieQueryResult Trie::getAmbiguousHints(const TrieNode &node) const {
   // Find leftmost of matched prefix
-  const TrieNode *curr = &node.next.front();
-  while (curr->idxRange.first == -1) {
+  const TrieNode *curr = nextBegin(node);
+  while (curr->first == -1) {
     // Check in case tree not properly constructed
-    if (curr->next.empty())
-      return TrieQueryResult{TFoundPlaces(places->cend(), places->cend()), false};
-    curr = &curr->next.front();
+    if (curr->nNext == 0)
+      return TrieQueryResult{TFoundPlaces(), false};
+    curr = nextBegin(*curr);
   }
-  const int idxLeft = curr->idxRange.first;
+  const int idxLeft = curr->first;
   
   // Find rightmost of matched prefix
-  curr = &node.next.back();
-  while (curr->idxRange.first == -1) {
+  curr = nextEnd(node) - 1;
+  while (curr->first == -1) {
     // Check in case tree not properly constructed
-    if (curr->next.empty())
-      return TrieQueryResult{TFoundPlaces(places->cend(), places->cend()), false};
-    curr = &curr->next.back();
+    if (curr->nNext == 0)
+      return TrieQueryResult{TFoundPlaces(), false};
+    curr = nextEnd(*curr) - 1;
   }
-  const int idxRight = curr->idxRange.first;
+  const int idxRight = curr->first;
   
   return TrieQueryResult{
-    TFoundPlaces(places->cbegin() + idxLeft,
-                 places->cbegin() + idxRight),
+    TFoundPlaces(places + idxLeft, places + idxRight),
                  true
   };
 }
 
 void Trie::construct(const int begin, const int end,
-                     const int depth, TrieNode &node) const {
-  // Start of the current sub-range being constructed
+                     const int depth, const size_t nodeIdx) {
+  // Next nodes go next to each other, one per distinct char of the range
+  const size_t next = builtNodes.size();
   int idx = begin;
   while (idx < end) {
     // End of the sub-range being constructed
     const int nextEnd = endOfSameLetterRange(idx, end, depth);
     
-    const char c = (char)std::tolower((*places)[idx].cityName[depth]);
+    const char c = lowerChar(name(places[idx])[depth]);
     if (c == '\0') {
       // Save the range of entries with same value
-      node.idxRange = { idx, nextEnd };
+      builtNodes[nodeIdx].first = idx;
+      builtNodes[nodeIdx].last = nextEnd;
     } else {
-      node.next.emplace_back(c);
-      construct(idx, nextEnd, depth + 1, node.next.back());
+      TrieNode child(c);
+      child.label = places[idx].nameOff + (uint32_t)depth;
+      child.labelLen = (uint8_t)commonLength(idx, nextEnd, depth);
+      builtNodes.push_back(child);
     }
     
-    // Continue building the next chunk of the sub-range
+    // Continue with the next chunk of the sub-range
+    idx = nextEnd;
+  }
+  builtNodes[nodeIdx].next = (uint32_t)next;
+  builtNodes[nodeIdx].nNext = (uint16_t)(builtNodes.size() - next);
+  
+  // Then build the subtree of each of them over the same chunks, past the
+  // label of its edge
+  size_t child = next;
+  idx = begin;
+  while (idx < end) {
+    const int nextEnd = endOfSameLetterRange(idx, end, depth);
+    if (name(places[idx])[depth] != '\0') {
+      const int labelLen = builtNodes[child].labelLen;
+      construct(idx, nextEnd, depth + labelLen, child++);
+    }
     idx = nextEnd;
   }
 }
 
 int Trie::endOfSameLetterRange(const int fm, const int to,
                                const size_t depth) const {
-  const char c = (char)std::tolower((*places)[fm].cityName[depth]);
+  const char c = lowerChar(name(places[fm])[depth]);
   for (int i = fm + 1; i < to; ++i) {
-    if (std::tolower((*places)[i].cityName[depth]) != c)
+    if (lowerChar(name(places[i])[depth]) != c)
       return i;
   }
   
   return to;
 }
+
+int Trie::commonLength(const int fm, const int to, const size_t depth) const {
+  // Records are in order, so the first and last of the range share the
+  // least. A name ending inside the others sorts first and stops the run.
+  const char *fst = name(places[fm]);
+  const char *lst = name(places[to - 1]);
+  size_t len = depth;
+  while (fst[len] != '\0' && lowerChar(fst[len]) == lowerChar(lst[len]))
+    ++len;
+  
+  return (int)(len - depth);
+}
+
+void Trie::rankCompletions() {
+  // Population first, records in name order break ties
+  const CityRecord *recs = places;
+  const auto morePopulous = [recs](const uint32_t a, const uint32_t b) {
+    return recs[a].population > recs[b].population ||
+           (recs[a].population == recs[b].population && a < b);
+  };
+  
+  builtStarts.reserve(nodeCount + 1);
+  std::vector<uint32_t> below;
+  for (size_t i = 0; i < nodeCount; ++i) {
+    builtStarts.push_back((uint32_t)builtRanked.size());
+    
+    // Records below a node are the range from its leftmost record to its
+    // rightmost one. Records of a node sort before those of its next nodes.
+    const TrieNode *lo = &nodes[i];
+    while (lo->first == -1 && lo->nNext > 0) lo = nextBegin(*lo);
+    const TrieNode *hi = &nodes[i];
+    while (hi->nNext > 0) hi = nextEnd(*hi) - 1;
+    if (lo->first == -1 || hi->first == -1) continue;
+    
+    below.clear();
+    for (int idx = lo->first; idx < hi->last; ++idx)
+      below.push_back((uint32_t)idx);
+    const size_t n = std::min(below.size(), (size_t)MAX_COMPLETIONS);
+    std::partial_sort(below.begin(), below.begin() + n, below.end(),
+                      morePopulous);
+    builtRanked.insert(builtRanked.end(), below.begin(), below.begin() + n);
+  }
+  builtStarts.push_back((uint32_t)builtRanked.size());
+  builtRanked.shrink_to_fit();
+}
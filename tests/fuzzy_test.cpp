@@ -0,0 +1,162 @@
+/*******************************************************************************
+ *   File: fuzzy_test.cpp
+ * Author: Ben Targan
+ *   Desc: Typo tolerant lookups in the places trie, checked against the edit
+ *         distance of every record's name.
+ ******************************************************************************/
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <strings.h>
+#include <gtest/gtest.h>
+#include "places/trie.h"
+
+static const std::string placesPath =
+  std::string(LOOKUP_DATA_DIR) + "/places2k.txt";
+
+static const Trie &trie() {
+  static const std::shared_ptr<Trie> built = loadTrie(placesPath.c_str());
+  return *built;
+}
+
+// Full scan of the records
+/******************************************************************************/
+
+static std::string lowered(const std::string &s) {
+  std::string low;
+  for (const char c : s) low += (char)std::tolower((unsigned char)c);
+  return low;
+}
+
+static int editDistance(const std::string &a, const std::string &b) {
+  std::vector<int> prev(b.size() + 1), curr(b.size() + 1);
+  for (size_t j = 0; j <= b.size(); ++j) prev[j] = (int)j;
+  for (size_t i = 1; i <= a.size(); ++i) {
+    curr[0] = (int)i;
+    for (size_t j = 1; j <= b.size(); ++j)
+      curr[j] = std::min(prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1),
+                         std::min(prev[j], curr[j - 1]) + 1);
+    std::swap(prev, curr);
+  }
+  return prev[b.size()];
+}
+
+// Index and distance of every record within maxDist edits, fewest edits
+// first, then most populous, then record order
+static std::vector<std::pair<size_t, int>>
+scanFuzzy(const std::string &name, const std::string &state, int maxDist) {
+  const Trie &t = trie();
+  const auto all = t.query("");
+  const CityRecord *recs = &all.places.front().get();
+  recs -= t.index(*recs);
+
+  std::vector<std::pair<size_t, int>> found;
+  const std::string low = lowered(name);
+  for (size_t i = 0; i < t.size(); ++i) {
+    const int dist = editDistance(low, lowered(t.name(recs[i])));
+    if (dist <= maxDist &&
+        (state.empty() || strcasecmp(t.state(recs[i]), state.c_str()) == 0))
+      found.emplace_back(i, dist);
+  }
+  std::sort(found.begin(), found.end(),
+            [recs](const std::pair<size_t, int> &a,
+                   const std::pair<size_t, int> &b) {
+              return std::make_tuple(a.second, -(long)recs[a.first].population,
+                                     a.first) <
+                     std::make_tuple(b.second, -(long)recs[b.first].population,
+                                     b.first);
+            });
+  return found;
+}
+
+static std::vector<std::pair<size_t, int>> indexed(const TFuzzyMatches &matches) {
+  std::vector<std::pair<size_t, int>> found;
+  for (const auto &match : matches)
+    found.emplace_back(trie().index(match.place), match.distance);
+  return found;
+}
+
+// Expected matches, the first maxResults of the scan
+static std::vector<std::pair<size_t, int>>
+expected(const std::string &name, const std::string &state, int maxDist,
+         size_t maxResults) {
+  auto found = scanFuzzy(name, state, maxDist);
+  found.resize(std::min(found.size(), maxResults));
+  return found;
+}
+
+// Lookups
+/******************************************************************************/
+
+TEST(TrieFuzzyTest, MatchesScanInOrder) {
+  // Fewest edits, then most populous, then record order
+  for (const char *name : { "Seattle", "Portland", "Springfeld", "Ausin",
+                            "sAN fRANCISCO", "Fruithurst", "Guy" }) {
+    for (int maxDist = 0; maxDist <= MAX_EDIT_DISTANCE; ++maxDist)
+      EXPECT_EQ(indexed(trie().fuzzy(name, "", maxDist, MAX_FUZZY_MATCHES)),
+                expected(name, "", maxDist, MAX_FUZZY_MATCHES))
+        << name << " within " << maxDist;
+  }
+}
+
+TEST(TrieFuzzyTest, DistanceClampedToMax) {
+  // Names three edits away exist and would fit, but are never returned
+  const auto within = scanFuzzy("Seattle", "", MAX_EDIT_DISTANCE);
+  ASSERT_LT(within.size(), (size_t)MAX_FUZZY_MATCHES);
+  ASSERT_GT(scanFuzzy("Seattle", "", MAX_EDIT_DISTANCE + 1).size(),
+            within.size());
+  const auto clamped = trie().fuzzy("Seattle", "", MAX_EDIT_DISTANCE + 3,
+                                    MAX_FUZZY_MATCHES);
+  EXPECT_EQ(indexed(clamped), within);
+}
+
+TEST(TrieFuzzyTest, ResultsCapped) {
+  ASSERT_GT(scanFuzzy("Springfeld", "", MAX_EDIT_DISTANCE).size(),
+            (size_t)MAX_FUZZY_MATCHES);
+  EXPECT_EQ(trie().fuzzy("Springfeld", "", 2, 1000).size(),
+            (size_t)MAX_FUZZY_MATCHES);
+  EXPECT_EQ(indexed(trie().fuzzy("Springfeld", "", 2, 3)),
+            expected("Springfeld", "", 2, 3));
+  EXPECT_EQ(indexed(trie().fuzzy("Springfeld", "", 2, 1)),
+            expected("Springfeld", "", 2, 1));
+  EXPECT_TRUE(trie().fuzzy("Springfeld", "", 2, 0).empty());
+}
+
+TEST(TrieFuzzyTest, StateFilter) {
+  for (const char *state : { "IL", "or", "ZZ" })
+    EXPECT_EQ(indexed(trie().fuzzy("Springfeld", state, 2, MAX_FUZZY_MATCHES)),
+              expected("Springfeld", state, 2, MAX_FUZZY_MATCHES)) << state;
+
+  const auto inState = trie().fuzzy("Portlnd", "or", 2, MAX_FUZZY_MATCHES);
+  ASSERT_FALSE(inState.empty());
+  for (const auto &match : inState)
+    EXPECT_STREQ(trie().state(match.place), "OR");
+  EXPECT_TRUE(trie().fuzzy("Portlnd", "ZZ", 2, MAX_FUZZY_MATCHES).empty());
+}
+
+TEST(TrieFuzzyTest, EmptyName) {
+  // Every name is as many edits away as it has chars
+  for (int maxDist = 0; maxDist <= MAX_EDIT_DISTANCE; ++maxDist) {
+    const auto found = trie().fuzzy("", "", maxDist, MAX_FUZZY_MATCHES);
+    EXPECT_EQ(indexed(found), expected("", "", maxDist, MAX_FUZZY_MATCHES));
+    for (const auto &match : found)
+      EXPECT_EQ((int)strlen(trie().name(match.place)), match.distance);
+  }
+}
+
+TEST(TrieFuzzyTest, TypoAtFirstChar) {
+  // Branches at the root are walked like any other
+  for (const char *name : { "Xeattle", "eattle", "SSeattle" }) {
+    const auto found = trie().fuzzy(name, "WA", 2, MAX_FUZZY_MATCHES);
+    ASSERT_FALSE(found.empty()) << name;
+    EXPECT_STREQ(trie().name(found.front().place), "Seattle") << name;
+    EXPECT_EQ(found.front().distance, 1) << name;
+    EXPECT_EQ(indexed(found), expected(name, "WA", 2, MAX_FUZZY_MATCHES))
+      << name;
+  }
+  EXPECT_TRUE(trie().fuzzy("Xeattle", "", 0, MAX_FUZZY_MATCHES).empty());
+}
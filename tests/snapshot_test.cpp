@@ -0,0 +1,230 @@
+/*******************************************************************************
+ *   File: snapshot_test.cpp
+ * Author: Ben Targan
+ *   Desc: Places and airports snapshots that are damaged or of another
+ *         kind or version are rejected with std::invalid_argument rather
+ *         than served.
+ ******************************************************************************/
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "airports/KDTree.h"
+#include "airports/SphereKDTree.h"
+#include "places/trie.h"
+
+static const std::string placesPath =
+  std::string(LOOKUP_DATA_DIR) + "/places2k.txt";
+static const std::string airportsPath =
+  std::string(LOOKUP_DATA_DIR) + "/airport-locations.txt";
+
+using TBytes = std::vector<char>;
+
+// Files
+/******************************************************************************/
+
+// Named per process, tests may run in parallel processes
+static std::string tempPath(const std::string &name) {
+  return testing::TempDir() + "snapshot_test." + std::to_string(getpid()) +
+         "." + name;
+}
+
+static TBytes readFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return TBytes(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string &path, const TBytes &bytes) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), (std::streamsize)bytes.size());
+}
+
+static SnapshotHeader &headerOf(TBytes &bytes) {
+  return *reinterpret_cast<SnapshotHeader *>(bytes.data());
+}
+
+// Checksums the payload again, so only the damage done is left to find
+static void reseal(TBytes &bytes) {
+  headerOf(bytes).checksum =
+    snapshotChecksum(bytes.data() + sizeof(SnapshotHeader),
+                     bytes.size() - sizeof(SnapshotHeader));
+}
+
+// Valid snapshot of the places with their closest airports
+static const TBytes &placesSnapshot() {
+  static const TBytes bytes = []() {
+    const auto trie = loadTrie(placesPath.c_str());
+    trie->buildNearest(load_Airports(airportsPath.c_str()),
+                       fileStamp(airportsPath.c_str()));
+    const std::string path = tempPath("places");
+    trie->writeSnapshot(path.c_str());
+    TBytes written = readFile(path);
+    std::remove(path.c_str());
+    return written;
+  }();
+  return bytes;
+}
+
+// Valid snapshot of the airports sphere tree
+static const TBytes &airportsSnapshot() {
+  static const TBytes bytes = []() {
+    const SphereKDTree tree(load_Airports(airportsPath.c_str()));
+    const std::string path = tempPath("airports");
+    tree.writeSnapshot(path.c_str());
+    TBytes written = readFile(path);
+    std::remove(path.c_str());
+    return written;
+  }();
+  return bytes;
+}
+
+// Rejections, for both kinds of snapshot
+/******************************************************************************/
+
+struct SnapshotKind {
+  const char *name;
+  std::function<const TBytes &()> valid;
+  std::function<void(const char *)> open;  ///< Maps and serves a snapshot
+};
+
+// Names the kind in test output
+static void PrintTo(const SnapshotKind &kind, std::ostream *os) {
+  *os << kind.name;
+}
+
+static const SnapshotKind kinds[] = {
+  { "Places", placesSnapshot,
+    [](const char *path) { Trie trie(Trie::openSnapshot(path)); } },
+  { "Airports", airportsSnapshot,
+    [](const char *path) {
+      SphereKDTree tree(SphereKDTree::openSnapshot(path));
+    } },
+};
+
+class SnapshotRejectTest : public testing::TestWithParam<SnapshotKind> {
+  protected:
+    void TearDown() override { std::remove(path.c_str()); }
+
+    // Copy of the valid snapshot to damage
+    TBytes valid() const { return GetParam().valid(); }
+
+    // Writes the bytes and opens them
+    void open(const TBytes &bytes) {
+      writeFile(path, bytes);
+      GetParam().open(path.c_str());
+    }
+
+    const std::string path = tempPath("damaged");
+};
+
+TEST_P(SnapshotRejectTest, ValidOpens) {
+  EXPECT_NO_THROW(open(valid()));
+}
+
+TEST_P(SnapshotRejectTest, Truncated) {
+  TBytes bytes = valid();
+  bytes.resize(bytes.size() / 2);
+  EXPECT_THROW(open(bytes), std::invalid_argument);
+
+  bytes.resize(sizeof(SnapshotHeader) - 1);
+  EXPECT_THROW(open(bytes), std::invalid_argument);
+
+  // Last word of the payload gone, sections still in bounds of the rest
+  bytes = valid();
+  bytes.resize(bytes.size() - 8);
+  EXPECT_THROW(open(bytes), std::invalid_argument);
+}
+
+TEST_P(SnapshotRejectTest, TenByteFile) {
+  TBytes bytes = valid();
+  bytes.resize(10);
+  EXPECT_THROW(open(bytes), std::invalid_argument);
+}
+
+TEST_P(SnapshotRejectTest, ChecksumMismatch) {
+  // One bit flipped in the first and in the last section
+  for (const size_t at : { sizeof(SnapshotHeader) + 3, valid().size() - 9 }) {
+    TBytes bytes = valid();
+    bytes[at] ^= 0x10;
+    EXPECT_THROW(open(bytes), std::invalid_argument) << "byte " << at;
+  }
+}
+
+TEST_P(SnapshotRejectTest, WrongMagic) {
+  TBytes bytes = valid();
+  headerOf(bytes).magic[0] ^= 0x20;
+  EXPECT_THROW(open(bytes), std::invalid_argument);
+
+  // The other kind of snapshot
+  const SnapshotKind &other =
+    strcmp(GetParam().name, kinds[0].name) == 0 ? kinds[1] : kinds[0];
+  EXPECT_THROW(open(other.valid()), std::invalid_argument);
+}
+
+TEST_P(SnapshotRejectTest, WrongVersion) {
+  for (const uint32_t version : { SNAPSHOT_VERSION - 1, SNAPSHOT_VERSION + 1 }) {
+    TBytes bytes = valid();
+    headerOf(bytes).version = version;
+    EXPECT_THROW(open(bytes), std::invalid_argument) << "version " << version;
+  }
+}
+
+TEST_P(SnapshotRejectTest, CountDisagreesWithSections) {
+  // The header is outside the checksum, its sections must still match
+  TBytes bytes = valid();
+  headerOf(bytes).count += 1;
+  EXPECT_THROW(open(bytes), std::invalid_argument);
+}
+
+TEST_P(SnapshotRejectTest, SectionOutOfBounds) {
+  TBytes bytes = valid();
+  auto &hdr = headerOf(bytes);
+  hdr.sections[hdr.nSections - 1].size += 8;
+  EXPECT_THROW(open(bytes), std::invalid_argument);
+}
+
+INSTANTIATE_TEST_SUITE_P(Kinds, SnapshotRejectTest, testing::ValuesIn(kinds),
+                         [](const testing::TestParamInfo<SnapshotKind> &info) {
+                           return std::string(info.param.name);
+                         });
+
+// Closest airports table
+/******************************************************************************/
+
+TEST(PlacesSnapshotTest, NearestIndexOutOfRange) {
+  // Checksum made to match, only the table can tell
+  TBytes bytes = placesSnapshot();
+  const auto &hdr = headerOf(bytes);
+  const SnapshotSection *table = nullptr, *airports = nullptr;
+  for (uint32_t i = 0; i < hdr.nSections; ++i) {
+    if (hdr.sections[i].elemSize == sizeof(NearestAirport) &&
+        hdr.sections[i].size == hdr.count * NRESULTS * sizeof(NearestAirport))
+      table = &hdr.sections[i];
+    if (hdr.sections[i].elemSize == sizeof(AirportRecord))
+      airports = &hdr.sections[i];
+  }
+  ASSERT_NE(table, nullptr);
+  ASSERT_NE(airports, nullptr);
+
+  auto *nearest = reinterpret_cast<NearestAirport *>(bytes.data() +
+                                                     table->offset);
+  nearest[table->size / sizeof(NearestAirport) - 1].airport =
+    (uint32_t)(airports->size / sizeof(AirportRecord));
+  reseal(bytes);
+
+  const std::string path = tempPath("nearest");
+  writeFile(path, bytes);
+  EXPECT_THROW(Trie trie(Trie::openSnapshot(path.c_str())),
+               std::invalid_argument);
+  std::remove(path.c_str());
+}
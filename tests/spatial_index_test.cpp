@@ -0,0 +1,165 @@
+/*******************************************************************************
+ *   File: spatial_index_test.cpp
+ * Author: Ben Targan
+ *   Desc: Every airport search engine checked against a full scan, over the
+ *         bundled airports joined by random points spread over the sphere.
+ *         Targets include the polar caps and the antimeridian, where
+ *         splitting on degrees is weakest.
+ ******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "airports/KDTree.h"
+#include "airports/SpatialIndex.h"
+#include "airports/geo.h"
+
+static const std::string airportsPath =
+  std::string(LOOKUP_DATA_DIR) + "/airport-locations.txt";
+
+static constexpr double radiusMiles = 150.0;
+static constexpr double tolerance = 1e-6;
+
+// Data set, targets and full scan answers, built once
+/******************************************************************************/
+
+// Uniformly distributed location on the sphere
+static location randomLocation(std::mt19937 &gen) {
+  std::uniform_real_distribution<double> unit(-1.0, 1.0), lon(-180.0, 180.0);
+  return { std::asin(unit(gen)) * 180.0 / M_PI, lon(gen) };
+}
+
+struct Scanned {
+  location target;
+  std::vector<double> closest;    ///< Every airport's miles, closest first
+};
+
+struct Fixture {
+  std::vector<AirportRecord> recs;
+  std::vector<Scanned> scans;
+
+  Fixture() {
+    std::mt19937 gen(4520);
+    recs = *load_Airports(airportsPath.c_str());
+    const std::string name = "Global", state = "ZZ";
+    for (size_t i = 0; i < 5000; ++i) {
+      char code[4];
+      snprintf(code, sizeof(code), "%03zu", i % 1000);
+      recs.push_back(AirportRecord{randomLocation(gen), code, name, state});
+    }
+
+    // Global targets, then a band around the antimeridian and the polar caps
+    std::uniform_real_distribution<double> edge(-2.0, 2.0), cap(75.0, 90.0);
+    for (size_t i = 0; i < 150; ++i) {
+      location target;
+      switch (i % 3) {
+        case 0: target = randomLocation(gen); break;
+        case 1: target = { randomLocation(gen).latitude,
+                           std::remainder(180.0 + edge(gen), 360.0) }; break;
+        default: target = { (i & 1 ? 1 : -1) * cap(gen),
+                            randomLocation(gen).longitude }; break;
+      }
+      addTarget(target);
+    }
+    // On the poles and the antimeridian themselves
+    for (const location &target : std::vector<location>{
+           { 90.0, 0.0 }, { -90.0, 0.0 }, { 0.0, 180.0 }, { 0.0, -180.0 },
+           { 65.0, 180.0 }, { -45.0, -180.0 }, { 33.07, -137.86 } })
+      addTarget(target);
+  }
+
+  void addTarget(const location &target) {
+    Scanned scan{ target, {} };
+    scan.closest.reserve(recs.size());
+    for (const auto &rec : recs)
+      scan.closest.push_back((double)greatCircleMiles(rec.loc, target));
+    std::sort(scan.closest.begin(), scan.closest.end());
+    scans.push_back(std::move(scan));
+  }
+};
+
+static const Fixture &fixture() {
+  static const Fixture built;
+  return built;
+}
+
+// Engines against the scan
+/******************************************************************************/
+
+class SpatialIndexTest : public testing::TestWithParam<SearchEngine> {
+  protected:
+    static std::unique_ptr<SpatialIndex> build() {
+      TAirportRecs recs(new std::vector<AirportRecord>(fixture().recs));
+      return makeSpatialIndex(GetParam(), std::move(recs));
+    }
+};
+
+TEST_P(SpatialIndexTest, KClosestMatchesScan) {
+  const auto index = build();
+  for (const size_t k : { 1, 5, 25, 256 }) {
+    for (const auto &scan : fixture().scans) {
+      const auto got = index->kClosestLocations(scan.target, k);
+      ASSERT_EQ(got.size(), k);
+      for (size_t i = 0; i < k; ++i)
+        ASSERT_NEAR(got[i].dist, scan.closest[i], tolerance)
+          << "k " << k << " rank " << i << " target "
+          << scan.target.latitude << ", " << scan.target.longitude;
+    }
+  }
+}
+
+TEST_P(SpatialIndexTest, RadiusMatchesScan) {
+  const auto index = build();
+  for (const auto &scan : fixture().scans) {
+    const auto got = index->locationsWithinRadius(scan.target, radiusMiles);
+    const size_t inRange =
+      std::upper_bound(scan.closest.begin(), scan.closest.end(), radiusMiles)
+      - scan.closest.begin();
+    ASSERT_EQ(got.size(), inRange)
+      << "target " << scan.target.latitude << ", " << scan.target.longitude;
+    for (size_t i = 0; i < got.size(); ++i)
+      ASSERT_NEAR(got[i].dist, scan.closest[i], tolerance);
+  }
+}
+
+TEST_P(SpatialIndexTest, LongitudeOutsideRangeWraps) {
+  // The same targets a turn east or west, e.g. 33.07, 222.14
+  const auto index = build();
+  for (const double turn : { -360.0, 360.0 }) {
+    for (const auto &scan : fixture().scans) {
+      const location target{ scan.target.latitude,
+                             scan.target.longitude + turn };
+      const auto closest = index->kClosestLocations(target, 25);
+      ASSERT_EQ(closest.size(), 25u);
+      for (size_t i = 0; i < closest.size(); ++i)
+        ASSERT_NEAR(closest[i].dist, scan.closest[i], tolerance)
+          << "rank " << i << " target "
+          << target.latitude << ", " << target.longitude;
+
+      const auto inRange = index->locationsWithinRadius(target, radiusMiles);
+      ASSERT_EQ(inRange.size(),
+                std::upper_bound(scan.closest.begin(), scan.closest.end(),
+                                 radiusMiles) - scan.closest.begin())
+        << "target " << target.latitude << ", " << target.longitude;
+    }
+  }
+}
+
+static std::string engineName(const testing::TestParamInfo<SearchEngine> &info) {
+  switch (info.param) {
+    case SearchEngine::LatLong: return "LatLong";
+    case SearchEngine::Sphere: return "Sphere";
+    case SearchEngine::BruteForce: return "BruteForce";
+    default: return "Auto";
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, SpatialIndexTest,
+                         testing::Values(SearchEngine::LatLong,
+                                         SearchEngine::Sphere,
+                                         SearchEngine::BruteForce,
+                                         SearchEngine::Auto),
+                         engineName);
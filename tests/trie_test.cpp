@@ -0,0 +1,165 @@
+/*******************************************************************************
+ *   File: trie_test.cpp
+ * Author: Ben Targan
+ *   Desc: Lookups by name in the places trie, built from the places file and
+ *         mapped from a snapshot of it.
+ ******************************************************************************/
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <strings.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "places/trie.h"
+
+static const std::string placesPath =
+  std::string(LOOKUP_DATA_DIR) + "/places2k.txt";
+
+// Tries built once and shared by the tests
+/******************************************************************************/
+
+static const Trie &textTrie() {
+  static const std::shared_ptr<Trie> trie = loadTrie(placesPath.c_str());
+  return *trie;
+}
+
+static const Trie &snapshotTrie() {
+  static const std::shared_ptr<Trie> trie = []() {
+    // Named per process, tests may run in parallel processes
+    const std::string path = testing::TempDir() + "trie_test." +
+                             std::to_string(getpid()) + ".snap";
+    textTrie().writeSnapshot(path.c_str());
+    auto mapped = loadTrie(path.c_str());
+    std::remove(path.c_str());    // Stays mapped
+    return mapped;
+  }();
+  return *trie;
+}
+
+using TNames = std::vector<std::pair<std::string, std::string>>;
+
+// Name and state of every place found, in order
+static TNames namesOf(const Trie &t, const TFoundPlaces &found) {
+  TNames named;
+  for (const CityRecord &rec : found)
+    named.emplace_back(t.name(rec), t.state(rec));
+  return named;
+}
+
+// Lookups, run on both tries
+/******************************************************************************/
+
+class TrieQueryTest : public testing::TestWithParam<bool> {
+  protected:
+    const Trie &trie() const {
+      return GetParam() ? snapshotTrie() : textTrie();
+    }
+
+    TNames query(const std::string &name) const {
+      return namesOf(trie(), trie().query(name).places);
+    }
+};
+
+TEST_P(TrieQueryTest, ExactHit) {
+  EXPECT_EQ(query("Seattle"), TNames({ { "Seattle", "WA" } }));
+  EXPECT_EQ(query("sEATTLE"), TNames({ { "Seattle", "WA" } }));
+  EXPECT_FALSE(trie().query("Seattle").isAmbiguous);
+}
+
+TEST_P(TrieQueryTest, Miss) {
+  for (const char *name : { "Xyzzy", "Seattlex", "Seatxle", "Zzz" }) {
+    const auto found = trie().query(name);
+    EXPECT_TRUE(found.places.empty()) << name;
+    EXPECT_FALSE(found.isAmbiguous) << name;
+    EXPECT_TRUE(queryPlace(trie(), name, "WA").places.empty()) << name;
+  }
+}
+
+TEST_P(TrieQueryTest, AmbiguousPrefixGivesFirstAndLastInRange) {
+  // Records from the first completion up to the first record of the last
+  // completion (Seattle), exclusive
+  const auto found = trie().query("Sea");
+  ASSERT_TRUE(found.isAmbiguous);
+  const auto named = namesOf(trie(), found.places);
+  ASSERT_EQ(named.size(), 27u);
+  EXPECT_EQ(named.front(), std::make_pair(std::string("Sea Bright"),
+                                          std::string("NJ")));
+  EXPECT_EQ(named.back(), std::make_pair(std::string("Seatonville"),
+                                         std::string("IL")));
+  for (const auto &place : named)
+    EXPECT_EQ(strncasecmp(place.first.c_str(), "sea", 3), 0) << place.first;
+}
+
+TEST_P(TrieQueryTest, SameNameInSeveralStates) {
+  // Every Portland, only ambiguous to queryPlace() without a state
+  const auto found = trie().query("Portland");
+  EXPECT_FALSE(found.isAmbiguous);
+  EXPECT_EQ(found.places.size(), 9u);
+  for (const auto &place : namesOf(trie(), found.places))
+    EXPECT_EQ(place.first, "Portland");
+
+  const auto anyState = queryPlace(trie(), "Portland", "");
+  EXPECT_TRUE(anyState.isAmbiguous);
+  EXPECT_EQ(anyState.places.size(), 9u);
+}
+
+TEST_P(TrieQueryTest, StateFilter) {
+  const auto inState = queryPlace(trie(), "Portland", "OR");
+  EXPECT_FALSE(inState.isAmbiguous);
+  EXPECT_EQ(namesOf(trie(), inState.places),
+            TNames({ { "Portland", "OR" } }));
+  EXPECT_EQ(namesOf(trie(), queryPlace(trie(), "portland", "or").places),
+            TNames({ { "Portland", "OR" } }));
+  EXPECT_TRUE(queryPlace(trie(), "Portland", "ZZ").places.empty());
+
+  // A single match is kept whatever the state
+  EXPECT_EQ(namesOf(trie(), queryPlace(trie(), "Seattle", "ZZ").places),
+            TNames({ { "Seattle", "WA" } }));
+}
+
+TEST_P(TrieQueryTest, PrefixEndingInsideLabel) {
+  // Chars past the last branch are one label, stopping inside it completes
+  // like stopping at its end
+  EXPECT_EQ(query("Seattl"), query("Seattle"));
+  EXPECT_EQ(query("Fruithur"), TNames({ { "Fruithurst", "AL" } }));
+  EXPECT_EQ(query("San Fr"), TNames({ { "San Francisco", "CA" } }));
+}
+
+TEST_P(TrieQueryTest, NamesSortedAroundLatin1Letters) {
+  // Found again since chars compare unsigned, as strcasecmp sorts them
+  EXPECT_EQ(query("Azusa"), TNames({ { "Azusa", "CA" } }));
+  EXPECT_EQ(query("Fruithurst"), TNames({ { "Fruithurst", "AL" } }));
+  EXPECT_EQ(query("Guy"), TNames({ { "Guy", "AR" } }));
+}
+
+INSTANTIATE_TEST_SUITE_P(Loaded, TrieQueryTest, testing::Bool(),
+                         [](const testing::TestParamInfo<bool> &info) {
+                           return std::string(info.param ? "Snapshot" : "Text");
+                         });
+
+// Text and snapshot agree
+/******************************************************************************/
+
+TEST(TrieSnapshotTest, AnswersMatchTextTrie) {
+  const Trie &text = textTrie(), &mapped = snapshotTrie();
+  ASSERT_EQ(text.size(), mapped.size());
+
+  // Every name, its first half and a mismatch inside it
+  const auto all = text.query("");
+  std::vector<std::string> queries;
+  for (const CityRecord &rec : all.places) {
+    const std::string name = text.name(rec);
+    queries.push_back(name);
+    queries.push_back(name.substr(0, (name.size() + 1) / 2));
+    queries.push_back(name.substr(0, name.size() - 1) + "#");
+  }
+
+  for (const auto &name : queries) {
+    const auto expect = text.query(name), got = mapped.query(name);
+    ASSERT_EQ(expect.isAmbiguous, got.isAmbiguous) << name;
+    ASSERT_EQ(namesOf(text, expect.places), namesOf(mapped, got.places))
+      << name;
+  }
+}